@@ -23,6 +23,9 @@ static std::string to_string(const AddressSpace::Type &t) {
 std::string AddressSpace::json() const {
   ptree pt;
   pt.put("type", to_string(type_));
+  if (device_ >= 0) {
+    pt.put("device", device_);
+  }
   std::ostringstream buf;
   write_json(buf, pt, false);
   return buf.str();
@@ -30,5 +33,9 @@ std::string AddressSpace::json() const {
 
 bool AddressSpace::maybe_equal(const AddressSpace &other) const {
   assert(is_valid());
-  return other == *this || is_unknown() || other.is_unknown();
+  if (is_unknown() || other.is_unknown()) {
+    return true;
+  }
+  return type_ == other.type_ &&
+         (device_ < 0 || other.device_ < 0 || device_ == other.device_);
 }
\ No newline at end of file
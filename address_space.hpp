@@ -3,37 +3,53 @@
 
 #include <map>
 #include <string>
+#include <tuple>
 
+// Cuda address spaces may name the device the memory is on. One that doesn't
+// stands for any device, so lookups with AddressSpace::Cuda() find memory on
+// all devices (pointers are unique across devices with unified addressing).
 class AddressSpace {
 public:
   enum class Type { Unknown, Host, Cuda, Invalid };
-  AddressSpace() : type_(Type::Invalid) {}
-  AddressSpace(const AddressSpace &other) : type_(other.type_) {}
+  AddressSpace() : type_(Type::Invalid), device_(-1) {}
+  AddressSpace(const AddressSpace &other)
+      : type_(other.type_), device_(other.device_) {}
 
 private:
-  AddressSpace(Type type) : type_(type) {}
+  friend class Location;
+  AddressSpace(Type type, int device = -1) : type_(type), device_(device) {}
 
 public:
-  bool operator==(const AddressSpace &rhs) const { return type_ == rhs.type_; }
-  bool operator<(const AddressSpace &rhs) const { return type_ < rhs.type_; }
+  bool operator==(const AddressSpace &rhs) const {
+    return type_ == rhs.type_ && device_ == rhs.device_;
+  }
+  bool operator<(const AddressSpace &rhs) const {
+    return std::tie(type_, device_) < std::tie(rhs.type_, rhs.device_);
+  }
 
   bool is_valid() const { return type_ != Type::Invalid; }
   bool is_host() const { return type_ == Type::Host; }
   bool is_cuda() const { return type_ == Type::Cuda; }
   bool is_unknown() const { return type_ == Type::Unknown; }
+  Type type() const { return type_; }
+  // the device of a Cuda address space, -1 if not known
+  int device() const { return device_; }
 
   bool maybe_equal(const AddressSpace &other) const;
 
   std::string json() const;
 
   static AddressSpace Host() { return AddressSpace(AddressSpace::Type::Host); }
-  static AddressSpace Cuda() { return AddressSpace(AddressSpace::Type::Cuda); }
+  static AddressSpace Cuda(int device = -1) {
+    return AddressSpace(AddressSpace::Type::Cuda, device);
+  }
   static AddressSpace Unknown() {
     return AddressSpace(AddressSpace::Type::Unknown);
   }
 
 private:
   Type type_;
+  int device_;
 };
 
 #endif
@@ -11,21 +11,9 @@ const AllocationRecord::id_type AllocationRecord::noid =
 
 AllocationRecord::AllocationRecord(uintptr_t pos, size_t size,
                                    const AddressSpace &as, const Memory &mem,
-                                   PageType pt)
-    : Extent(pos, size), address_space_(as), memory_(mem), type_(pt) {
-  assert(address_space_.is_valid());
-}
-
-std::string to_string(AllocationRecord::PageType type) {
-  if (AllocationRecord::PageType::Pinned == type)
-    return "pinned";
-  if (AllocationRecord::PageType::Pageable == type) {
-    return "pageable";
-  }
-  if (AllocationRecord::PageType::Unknown == type) {
-    return "unknown";
-  }
-  assert(0 && "Unexpected AllocationRecord::type");
+                                   PageType pt, unsigned flags)
+    : Extent(pos, size), location_(as, mem, pt), flags_(flags) {
+  assert(as.is_valid());
 }
 
 std::string AllocationRecord::json() const {
@@ -33,9 +21,13 @@ std::string AllocationRecord::json() const {
   pt.put("allocation.id", std::to_string(uintptr_t(this)));
   pt.put("allocation.pos", std::to_string(pos_));
   pt.put("allocation.size", std::to_string(size_));
-  pt.put("allocation.addrsp", address_space_.json());
-  pt.put("allocation.mem", memory_.json());
-  pt.put("allocation.type", to_string(type_));
+  pt.put("allocation.loc", location_.bits());
+  pt.put("allocation.addrsp", address_space().json());
+  pt.put("allocation.mem", memory().json());
+  pt.put("allocation.type", to_string(page_type()));
+  if (flags_) {
+    pt.put("allocation.flags", flags_);
+  }
   std::ostringstream buf;
   write_json(buf, pt, false);
   return buf.str();
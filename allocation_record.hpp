@@ -6,44 +6,46 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <string>
 
 #include "address_space.hpp"
 #include "extent.hpp"
+#include "location.hpp"
 #include "memory.hpp"
-#include "thread.hpp"
 
 class AllocationRecord : public Extent {
 public:
-  enum class PageType { Pinned, Pageable, Unknown };
+  typedef Location::PageType PageType;
   typedef uintptr_t id_type;
   static const id_type noid;
 
 private:
-  AddressSpace address_space_;
-  Memory memory_;
-  PageType type_;
-  tid_t thread_id_;
+  Location location_;
+  unsigned flags_; // cudaMallocManaged flags, 0 otherwise
 
 public:
   friend std::ostream &operator<<(std::ostream &os, const AllocationRecord &v);
   AllocationRecord(uintptr_t pos, size_t size, const AddressSpace &as,
-                   const Memory &mem, PageType pt);
+                   const Memory &mem, PageType pt, unsigned flags = 0);
 
   std::string json() const;
 
   bool overlaps(const AllocationRecord &other) {
-    return (address_space_.maybe_equal(other.address_space_)) &&
+    return location_.maybe_same_address_space(other.location_) &&
            Extent::overlaps(other);
   }
 
   bool contains(const AllocationRecord &other) {
-    return (address_space_.maybe_equal(other.address_space_)) &&
+    return location_.maybe_same_address_space(other.location_) &&
            Extent::contains(other);
   }
 
   id_type Id() const { return reinterpret_cast<id_type>(this); }
-  AddressSpace address_space() const { return address_space_; }
-  Memory memory() const { return memory_; }
+  Location location() const { return location_; }
+  AddressSpace address_space() const { return location_.address_space(); }
+  Memory memory() const { return location_.memory(); }
+  PageType page_type() const { return location_.page_type(); }
+  unsigned flags() const { return flags_; }
 };
 
 #endif
@@ -1,5 +1,7 @@
 #include "allocations.hpp"
-#include "env.hpp"
+#include "trace_output.hpp"
+
+#include <algorithm>
 
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -26,11 +28,63 @@ Allocations::insert(const Allocations::value_type &v) {
     printf("WARN: inserting size %lu allocation", v->size());
   }
   const auto &valIdx = reinterpret_cast<id_type>(v.get());
-  std::ofstream buf(env::output_path(), std::ofstream::app);
-  buf << *v;
-  buf.flush();
+  TraceOutput::instance().write_record(*v);
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  if (!restored_.empty()) {
+    // the application made this allocation again since the snapshot
+    const Extent e(v->pos(), std::max(v->size(), size_t(1)));
+    for (size_t i = extents_.find_first(e); i < order_.size();) {
+      if (restored_.count(order_[i]) &&
+          locations_[i].maybe_same_address_space(v->location())) {
+        erase(order_[i]);
+        i = extents_.find_first(e, i);
+      } else {
+        i = extents_.find_first(e, i + 1);
+      }
+    }
+  }
+  auto p = allocations_.insert(std::make_pair(valIdx, v));
+  if (p.second) {
+    // a size 0 allocation is still found at its address
+    extents_.push_back(Extent(v->pos(), std::max(v->size(), size_t(1))));
+    locations_.push_back(v->location());
+    order_.push_back(valIdx);
+  }
+  return p;
+}
+
+void Allocations::erase(const id_type &k) {
+  allocations_.erase(k);
+  restored_.erase(k);
+  const auto it = std::find(order_.begin(), order_.end(), k);
+  if (it != order_.end()) {
+    extents_.erase(it - order_.begin());
+    locations_.erase(locations_.begin() + (it - order_.begin()));
+    order_.erase(it);
+  }
+}
+
+size_t Allocations::free(const id_type &k) {
   std::lock_guard<std::mutex> guard(access_mutex_);
-  return allocations_.insert(std::make_pair(valIdx, v));
+  const size_t numErased = allocations_.count(k);
+  assert(numErased);
+  erase(k);
+  return numErased;
+}
+
+std::vector<Allocations::value_type> Allocations::live() {
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  std::vector<value_type> ret;
+  ret.reserve(order_.size());
+  for (const auto &k : order_) {
+    ret.push_back(allocations_.at(k));
+  }
+  return ret;
+}
+
+void Allocations::mark_restored(const id_type &k) {
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  restored_.insert(k);
 }
 
 std::tuple<Allocations::id_type, Allocations::value_type>
@@ -39,20 +93,13 @@ Allocations::find_live(uintptr_t pos, size_t size, const AddressSpace &as) {
 
   std::lock_guard<std::mutex> guard(access_mutex_);
 
-  if (allocations_.empty()) {
-    return std::make_pair(noid, value_type(nullptr));
-  }
-
-  // FIXME - should be any page type
-  AllocationRecord dummy(pos, size, as, Memory(Memory::Any),
-                         AllocationRecord::PageType::Pageable);
-  for (const auto &alloc : allocations_) {
-    // printf("checkin\n");
-    const auto &key = alloc.first;
-    const auto &val = alloc.second;
-    assert(val.get());
-    if (dummy.overlaps(*val)) {
-      return std::make_pair(key, val);
+  const Extent e(pos, std::max(size, size_t(1)));
+  const Location loc(as);
+  for (size_t i = extents_.find_first(e); i < order_.size();
+       i = extents_.find_first(e, i + 1)) {
+    if (locations_[i].maybe_same_address_space(loc)) {
+      const auto &key = order_[i];
+      return std::make_pair(key, allocations_.at(key));
     }
   }
   return std::make_pair(noid, value_type(nullptr));
@@ -61,8 +108,9 @@ Allocations::find_live(uintptr_t pos, size_t size, const AddressSpace &as) {
 std::tuple<Allocations::id_type, Allocations::value_type>
 Allocations::new_allocation(uintptr_t pos, size_t size, const AddressSpace &as,
                             const Memory &am,
-                            const AllocationRecord::PageType &ty) {
-  auto val = value_type(new AllocationRecord(pos, size, as, am, ty));
+                            const AllocationRecord::PageType &ty,
+                            const unsigned flags) {
+  auto val = value_type(new AllocationRecord(pos, size, as, am, ty, flags));
   assert(val.get());
   return std::make_pair(insert(val).first->first, val);
 }
\ No newline at end of file
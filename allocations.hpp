@@ -9,6 +9,7 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <vector>
 
 #include "address_space.hpp"
 #include "allocation_record.hpp"
@@ -23,8 +24,17 @@ public:
 private:
   typedef std::map<id_type, value_type> map_type;
   map_type allocations_;
+  // the live allocations' extents, locations and ids, in the order they were
+  // made, so find_live tests blocks of extents without walking the map
+  ExtentArray extents_;
+  std::vector<Location> locations_;
+  std::vector<id_type> order_;
+  // allocations restored from a snapshot, dropped when one is made over them
+  std::set<id_type> restored_;
   std::mutex access_mutex_;
 
+  void erase(const id_type &k);
+
 public:
   // void lock() { access_mutex_.lock(); }
   // void unlock() { access_mutex_.unlock(); }
@@ -39,13 +49,25 @@ public:
 
   std::tuple<id_type, value_type>
   new_allocation(uintptr_t pos, size_t size, const AddressSpace &as,
-                 const Memory &am, const AllocationRecord::PageType &ty);
+                 const Memory &am, const AllocationRecord::PageType &ty,
+                 unsigned flags = 0);
+
+  size_t free(const id_type &k);
+
+  // the live allocations, copied under the lock
+  std::vector<value_type> live();
+  // k was restored from a snapshot, so a new allocation over it replaces it
+  void mark_restored(const id_type &k);
 
-  size_t free(const id_type &k) {
+  // the location of allocation k, with an unknown address space once k is
+  // freed or dropped, so values still in it match any lookup
+  Location location(const id_type &k) {
     std::lock_guard<std::mutex> guard(access_mutex_);
-    const size_t numErased = allocations_.erase(k);
-    assert(numErased);
-    return numErased;
+    const auto it = allocations_.find(k);
+    if (it == allocations_.end()) {
+      return Location(AddressSpace::Unknown());
+    }
+    return it->second->location();
   }
 
   value_type &at(const id_type &k) {
@@ -1,5 +1,6 @@
 #include "api_record.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 #include <boost/property_tree/json_parser.hpp>
@@ -21,10 +22,18 @@ void ApiRecord::add_output(const Value::id_type &id) {
   outputs_.push_back(id);
 }
 
+void ApiRecord::add_happens_after(const id_type &id) {
+  assert(noid != id);
+  if (std::find(happensAfter_.begin(), happensAfter_.end(), id) ==
+      happensAfter_.end()) {
+    happensAfter_.push_back(id);
+  }
+}
+
 void ApiRecord::record_start_time(const uint64_t start) { start_ = start; }
 void ApiRecord::record_end_time(const uint64_t end) { end_ = end; }
 
-static ptree to_json(const std::vector<Values::id_type> &v) {
+template <typename T> static ptree to_json(const std::vector<T> &v) {
   ptree array;
   for (const auto &e : v) {
     ptree elem;
@@ -40,10 +49,27 @@ std::string ApiRecord::json() const {
   pt.put("api.name", apiName_);
   pt.put("api.device", device_);
   pt.put("api.symbolname", kernelName_);
+  if (!callsite_.empty()) {
+    pt.put("api.callsite", callsite_);
+  }
   pt.add_child("api.inputs", to_json(inputs_));
   pt.add_child("api.outputs", to_json(outputs_));
   pt.put("api.start", start_);
   pt.put("api.end", end_);
+  if (stream_) {
+    pt.put("api.stream", stream_.value());
+  }
+  if (stream_ || !happensAfter_.empty()) {
+    pt.add_child("api.happens_after", to_json(happensAfter_));
+  }
+  if (op_.is_known()) {
+    pt.put("api.op.kind", op_.kind);
+    pt.add_child("api.op.shape", to_json(op_.shape));
+    pt.put("api.op.dtype", op_.dtype);
+    pt.put("api.op.flops", op_.flops);
+    pt.put("api.op.bytes_read", op_.bytesRead);
+    pt.put("api.op.bytes_written", op_.bytesWritten);
+  }
   std::ostringstream buf;
   write_json(buf, pt, false);
   return buf.str();
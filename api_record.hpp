@@ -2,10 +2,32 @@
 #define API_RECORD_HPP
 
 #include <cupti.h>
+#include <string>
 #include <vector>
 
+#include "optional.hpp"
 #include "values.hpp"
 
+// What a known operation (GEMM, convolution, ...) computes, for roofline
+// analysis
+class OpInfo {
+public:
+  std::string kind;           // e.g. "gemm", "conv_fwd". Empty if unknown.
+  std::vector<int64_t> shape; // dimensions, as documented by each kind
+  std::string dtype;          // e.g. "f32", "f16"
+  uint64_t flops;
+  uint64_t bytesRead;    // bytes spanned by the operands read
+  uint64_t bytesWritten; // bytes spanned by the operands written
+
+  OpInfo() : flops(0), bytesRead(0), bytesWritten(0) {}
+  OpInfo(const std::string &k, const std::vector<int64_t> &s,
+         const std::string &dt, uint64_t f)
+      : kind(k), shape(s), dtype(dt), flops(f), bytesRead(0),
+        bytesWritten(0) {}
+
+  bool is_known() const { return !kind.empty(); }
+};
+
 class ApiRecord {
 public:
   typedef uintptr_t id_type;
@@ -16,9 +38,13 @@ private:
   std::vector<Values::id_type> outputs_;
   std::string apiName_;
   std::string kernelName_;
+  std::string callsite_;
   int device_;
   uint64_t start_;
   uint64_t end_;
+  OpInfo op_;
+  optional<uintptr_t> stream_;        // set if the record is stream-ordered
+  std::vector<id_type> happensAfter_; // records that finish before it starts
 
   CUpti_CallbackDomain domain_;
   CUpti_CallbackId cbid_;
@@ -45,10 +71,17 @@ public:
 
   void record_start_time(const uint64_t start);
   void record_end_time(const uint64_t end);
+  void set_callsite(const std::string &callsite) { callsite_ = callsite; }
+  void set_op(const OpInfo &op) { op_ = op; }
+  void set_stream(uintptr_t stream) { stream_ = optional<uintptr_t>(stream); }
+  void add_happens_after(const id_type &id);
 
   int device() const { return device_; }
+  uint64_t start() const { return start_; }
+  uint64_t end() const { return end_; }
   id_type Id() const { return reinterpret_cast<id_type>(this); }
   const std::string &name() const { return apiName_; }
+  const OpInfo &op() const { return op_; }
 
   std::string json() const;
 
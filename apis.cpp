@@ -1,16 +1,17 @@
 
 #include "apis.hpp"
-#include "env.hpp"
+#include "clock_samples.hpp"
+#include "trace_output.hpp"
 
 const APIs::id_type noid = ApiRecord::noid;
 
 APIs::value_type APIs::_record(const APIs::mapped_type &m) {
+  ClockSamples::instance().sample_if_due();
   auto id = m->Id();
+  std::lock_guard<std::mutex> guard(mutex_);
   auto p = records_.insert(std::make_pair(id, m));
 
-  std::ofstream buf(env::output_path(), std::ofstream::app);
-  buf << *m;
-  buf.flush();
+  TraceOutput::instance().write_record(*m);
 
   return *p.first;
 }
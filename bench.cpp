@@ -0,0 +1,337 @@
+/*
+Microbenchmarks for the profiler's core data structures.
+
+  ./bench [-s scenario] [-t seconds-per-benchmark] [-q queries] [-r seed]
+
+Each scenario populates Allocations and Values with a different address
+distribution, then times Extent::overlaps one at a time and batched in an
+ExtentArray, Value::overlaps of strided and range list values,
+Allocations::find_live, Values::insert, Values::find_live, and the JSON
+serializers. Each scenario runs in its own process so that it
+starts with empty Allocations and Values.
+
+Results are printed one JSON object per line, e.g.
+  {"bench":{"scenario":"small","name":"values_find_live","n":"16384",...}}
+
+Records are written to CPROF_OUT as usual, /dev/null unless set.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "allocations.hpp"
+#include "api_record.hpp"
+#include "values.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+typedef std::chrono::steady_clock Clock;
+
+// Allocations are carved out of pools. Each pool starts on its own 1 TB
+// boundary, and gaps are left between allocations in a pool.
+struct Scenario {
+  const char *name;
+  size_t pools;
+  size_t allocsPerPool;
+  size_t minSize;
+  size_t maxSize;
+  size_t minGap;
+  size_t maxGap;
+};
+
+static const Scenario scenarios[] = {
+    // many small allocations, packed
+    {"small", 1, 16384, 256, 64 * 1024, 0, 256},
+    // a few huge allocations
+    {"huge", 8, 1, size_t(1) << 30, size_t(16) << 30, 0, 0},
+    // many mid-size allocations in pools with freed holes between them
+    {"fragmented", 32, 256, 4096, 4 << 20, 4096, 16 << 20},
+};
+
+struct Options {
+  std::string scenario;
+  double seconds = 0.2;
+  size_t queries = 4096;
+  unsigned seed = 1;
+};
+
+static std::vector<Extent> make_extents(const Scenario &s,
+                                        std::mt19937_64 &rng) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  auto log_uniform = [&](const size_t lo, const size_t hi) {
+    if (lo >= hi) {
+      return lo;
+    }
+    return size_t(std::exp(std::log(double(lo)) +
+                           uniform(rng) * std::log(double(hi) / lo)));
+  };
+
+  std::vector<Extent> extents;
+  for (size_t p = 0; p < s.pools; ++p) {
+    uintptr_t next = uintptr_t(p + 1) << 40;
+    for (size_t i = 0; i < s.allocsPerPool; ++i) {
+      const size_t size = log_uniform(s.minSize, s.maxSize);
+      extents.push_back(Extent(next, size));
+      next += (size + 0xFF) & ~uintptr_t(0xFF);
+      next += s.maxGap ? log_uniform(std::max(s.minGap, size_t(1)), s.maxGap)
+                       : 0;
+    }
+  }
+  return extents;
+}
+
+// Half of the queries land inside an allocation, half just past the end of
+// one, which is usually a gap.
+static std::vector<Extent> make_queries(const std::vector<Extent> &extents,
+                                        const size_t n, std::mt19937_64 &rng) {
+  std::uniform_int_distribution<size_t> pick(0, extents.size() - 1);
+  std::vector<Extent> queries;
+  for (size_t i = 0; i < n; ++i) {
+    const auto &e = extents[pick(rng)];
+    if (i % 2) {
+      std::uniform_int_distribution<uintptr_t> offset(0, e.size() - 1);
+      queries.push_back(Extent(e.pos() + offset(rng), 1));
+    } else {
+      queries.push_back(Extent(e.pos() + e.size() + 1, 1));
+    }
+  }
+  return queries;
+}
+
+static void report(const Scenario &s, const std::string &name, const size_t n,
+                   const size_t ops, const double ns) {
+  ptree pt;
+  pt.put("bench.scenario", s.name);
+  pt.put("bench.name", name);
+  pt.put("bench.n", n);
+  pt.put("bench.ops", ops);
+  pt.put("bench.ns_per_op", ns / ops);
+  write_json(std::cout, pt, false);
+  std::cout.flush();
+}
+
+// Call f(i) for i in [0, n) until at least opts.seconds have passed, return
+// the number of calls and the elapsed nanoseconds.
+template <typename F>
+static std::pair<size_t, double> repeat(const Options &opts, const size_t n,
+                                        F f) {
+  size_t ops = 0;
+  const auto start = Clock::now();
+  double elapsed;
+  do {
+    for (size_t i = 0; i < n; ++i) {
+      f(i);
+    }
+    ops += n;
+    elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start)
+                  .count();
+  } while (elapsed < opts.seconds * 1e9);
+  return std::make_pair(ops, elapsed);
+}
+
+// Keep results live so the compiler can't drop the work
+static volatile size_t sink;
+
+static void run(const Scenario &s, const Options &opts) {
+  std::mt19937_64 rng(opts.seed);
+  const auto extents = make_extents(s, rng);
+  const auto queries = make_queries(extents, opts.queries, rng);
+  const auto as = AddressSpace::Cuda();
+  const size_t n = extents.size();
+
+  {
+    size_t hits = 0;
+    auto r = repeat(opts, queries.size(), [&](const size_t i) {
+      for (const auto &e : extents) {
+        hits += e.overlaps(queries[i]);
+      }
+    });
+    sink = hits;
+    report(s, "extent_overlaps", n, r.first * n, r.second);
+  }
+
+  // the same tests through ExtentArray, a block of extents at a time
+  {
+    ExtentArray array;
+    for (const auto &e : extents) {
+      array.push_back(e);
+    }
+    size_t hits = 0;
+    auto r = repeat(opts, queries.size(), [&](const size_t i) {
+      for (size_t j = array.find_first(queries[i]); j < n;
+           j = array.find_first(queries[i], j + 1)) {
+        ++hits;
+      }
+    });
+    sink = hits;
+    report(s, "extent_array_overlaps", n, r.first * n, r.second);
+  }
+
+  // Value::overlaps with each extent as 8 evenly spaced blocks, and as 8
+  // unevenly spaced ranges
+  {
+    std::vector<Value> strided, ranged;
+    for (const auto &e : extents) {
+      const size_t block = std::max(e.size() / 16, size_t(1));
+      strided.emplace_back(e.pos(), block, e.size() / 8, 8, 0, true);
+      std::vector<Extent> ranges;
+      for (size_t i = 0; i < 8; ++i) {
+        ranges.emplace_back(e.pos() + i * i * e.size() / 64, block);
+      }
+      ranged.emplace_back(ranges, 0, true);
+    }
+    auto time_overlaps = [&](const std::vector<Value> &vals,
+                             const std::string &name) {
+      size_t hits = 0;
+      auto r = repeat(opts, queries.size(), [&](const size_t i) {
+        for (const auto &v : vals) {
+          hits += v.overlaps(queries[i]);
+        }
+      });
+      sink = hits;
+      report(s, name, n, r.first * n, r.second);
+    };
+    time_overlaps(strided, "value_overlaps_strided");
+    time_overlaps(ranged, "value_overlaps_ranges");
+  }
+
+  auto &allocations = Allocations::instance();
+  std::vector<Allocations::id_type> allocIds;
+  {
+    const auto start = Clock::now();
+    for (const auto &e : extents) {
+      auto a = allocations.new_allocation(
+          e.pos(), e.size(), as, Memory(Memory::CudaDevice, 0),
+          AllocationRecord::PageType::Pageable);
+      allocIds.push_back(std::get<0>(a));
+    }
+    report(s, "allocations_insert", n, n,
+           std::chrono::duration<double, std::nano>(Clock::now() - start)
+               .count());
+  }
+
+  {
+    auto r = repeat(opts, queries.size(), [&](const size_t i) {
+      sink = std::get<0>(
+          allocations.find_live(queries[i].pos(), queries[i].size(), as));
+    });
+    report(s, "allocations_find_live", n, r.first, r.second);
+  }
+
+  auto &values = Values::instance();
+  std::vector<Values::value_type> vals;
+  {
+    const auto start = Clock::now();
+    for (size_t i = 0; i < n; ++i) {
+      vals.push_back(
+          values.new_value(extents[i].pos(), extents[i].size(), allocIds[i])
+              .second);
+    }
+    report(s, "values_insert", n, n,
+           std::chrono::duration<double, std::nano>(Clock::now() - start)
+               .count());
+  }
+
+  {
+    auto r = repeat(opts, queries.size(), [&](const size_t i) {
+      sink = values.find_live(queries[i].pos(), queries[i].size(), as).first;
+    });
+    report(s, "values_find_live", n, r.first, r.second);
+  }
+
+  {
+    auto r = repeat(opts, allocIds.size(), [&](const size_t i) {
+      sink = allocations.at(allocIds[i])->json().size();
+    });
+    report(s, "allocation_json", n, r.first, r.second);
+  }
+
+  {
+    auto r = repeat(opts, vals.size(),
+                    [&](const size_t i) { sink = vals[i]->json().size(); });
+    report(s, "value_json", n, r.first, r.second);
+  }
+
+  {
+    ApiRecord api("cudaLaunch", "kernel", 0);
+    for (size_t i = 0; i < std::min(vals.size(), size_t(8)); ++i) {
+      api.add_input(vals[i]->Id());
+      api.add_output(vals[vals.size() - 1 - i]->Id());
+    }
+    auto r = repeat(opts, 1, [&](const size_t) { sink = api.json().size(); });
+    report(s, "api_json", n, r.first, r.second);
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-s scenario] [-t seconds-per-benchmark] [-q queries] "
+          "[-r seed]\n",
+          argv0);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  Options opts;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:q:r:")) != -1) {
+    switch (opt) {
+    case 's':
+      opts.scenario = optarg;
+      break;
+    case 't':
+      opts.seconds = std::stod(optarg);
+      break;
+    case 'q':
+      opts.queries = std::stoul(optarg);
+      break;
+    case 'r':
+      opts.seed = std::stoul(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (opts.queries == 0) {
+    usage(argv[0]);
+  }
+  setenv("CPROF_OUT", "/dev/null", 0 /*don't overwrite*/);
+
+  int status = EXIT_SUCCESS;
+  bool found = false;
+  for (const auto &s : scenarios) {
+    if (!opts.scenario.empty() && opts.scenario != s.name) {
+      continue;
+    }
+    found = true;
+    std::cout.flush();
+    const pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+      run(s, opts);
+      exit(EXIT_SUCCESS);
+    }
+    int childStatus;
+    waitpid(pid, &childStatus, 0);
+    if (!WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != EXIT_SUCCESS) {
+      fprintf(stderr, "scenario %s failed\n", s.name);
+      status = EXIT_FAILURE;
+    }
+  }
+  if (!found) {
+    usage(argv[0]);
+  }
+  return status;
+}
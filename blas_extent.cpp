@@ -0,0 +1,93 @@
+#include "blas_extent.hpp"
+
+size_t blas_matrix_bytes(int rows, int cols, int ld, size_t elemSize) {
+  // cuBLAS fails calls with ld < rows, so there is nothing to look up
+  if (rows <= 0 || cols <= 0 || ld < rows) {
+    return 0;
+  }
+  return (size_t(cols - 1) * size_t(ld) + size_t(rows)) * elemSize;
+}
+
+size_t blas_vector_bytes(int n, int inc, size_t elemSize) {
+  if (n <= 0) {
+    return 0;
+  }
+  const size_t stride = inc < 0 ? size_t(-(long long)inc) : size_t(inc);
+  return (1 + size_t(n - 1) * stride) * elemSize;
+}
+
+size_t cuda_data_type_size(cudaDataType dataType) {
+  switch (dataType) {
+  case CUDA_R_8I:
+  case CUDA_R_8U:
+    return 1;
+  case CUDA_R_16F:
+  case CUDA_C_8I:
+  case CUDA_C_8U:
+    return 2;
+  case CUDA_R_32F:
+  case CUDA_R_32I:
+  case CUDA_R_32U:
+  case CUDA_C_16F:
+    return 4;
+  case CUDA_R_64F:
+  case CUDA_C_32F:
+  case CUDA_C_32I:
+  case CUDA_C_32U:
+    return 8;
+  case CUDA_C_64F:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+const char *cuda_data_type_name(cudaDataType dataType) {
+  switch (dataType) {
+  case CUDA_R_8I:
+    return "i8";
+  case CUDA_R_8U:
+    return "u8";
+  case CUDA_R_16F:
+    return "f16";
+  case CUDA_R_32F:
+    return "f32";
+  case CUDA_R_32I:
+    return "i32";
+  case CUDA_R_32U:
+    return "u32";
+  case CUDA_R_64F:
+    return "f64";
+  case CUDA_C_8I:
+    return "ci8";
+  case CUDA_C_8U:
+    return "cu8";
+  case CUDA_C_16F:
+    return "c16";
+  case CUDA_C_32F:
+    return "c32";
+  case CUDA_C_32I:
+    return "ci32";
+  case CUDA_C_32U:
+    return "cu32";
+  case CUDA_C_64F:
+    return "c64";
+  default:
+    return "unknown";
+  }
+}
+
+bool cuda_data_type_is_complex(cudaDataType dataType) {
+  switch (dataType) {
+  case CUDA_C_8I:
+  case CUDA_C_8U:
+  case CUDA_C_16F:
+  case CUDA_C_32F:
+  case CUDA_C_32I:
+  case CUDA_C_32U:
+  case CUDA_C_64F:
+    return true;
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef BLAS_EXTENT_HPP
+#define BLAS_EXTENT_HPP
+
+#include <cstdlib>
+
+#include <library_types.h>
+
+// Bytes spanned by a column-major rows x cols matrix with leading dimension
+// ld: ((cols - 1) * ld + rows) elements. 0 if the matrix is empty, or if ld is
+// smaller than rows, which cuBLAS rejects.
+size_t blas_matrix_bytes(int rows, int cols, int ld, size_t elemSize);
+
+// Bytes spanned by an n-element vector with stride inc: (1 + (n - 1) * |inc|)
+// elements. A negative inc walks the same bytes backwards. 0 if n <= 0.
+size_t blas_vector_bytes(int n, int inc, size_t elemSize);
+
+// Bytes per element of a cuBLAS Ex-call data type, 0 if unknown
+size_t cuda_data_type_size(cudaDataType dataType);
+
+// Short name of a data type, e.g. "f16", "c32", "i8"
+const char *cuda_data_type_name(cudaDataType dataType);
+bool cuda_data_type_is_complex(cudaDataType dataType);
+
+#endif
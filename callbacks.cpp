@@ -16,18 +16,25 @@
 #include "allocations.hpp"
 #include "apis.hpp"
 #include "backtrace.hpp"
+#include "callsite.hpp"
+#include "control.hpp"
+#include "device_topology.hpp"
+#include "dirty.hpp"
 #include "driver_state.hpp"
+#include "env.hpp"
 #include "hash.hpp"
 #include "memory.hpp"
 #include "memorycopykind.hpp"
 #include "numa.hpp"
+#include "streams.hpp"
+#include "transfer_stats.hpp"
 #include "thread.hpp"
+#include "unified_memory.hpp"
 #include "util_cuda.hpp"
 #include "util_cupti.hpp"
 #include "value.hpp"
 #include "values.hpp"
 
-// FIXME: this should be per-thread
 typedef struct {
   dim3 gridDim;
   dim3 blockDim;
@@ -38,10 +45,44 @@ typedef struct {
 } ConfiguredCall_t;
 
 ConfiguredCall_t &ConfiguredCall() {
-  static ConfiguredCall_t cc;
+  static thread_local ConfiguredCall_t cc;
   return cc;
 }
 
+// A timestamp for the start or end of asynchronous work. With
+// CPROF_SYNC_TIMING, the device is synchronized first so that the times
+// cover the work instead of only issuing it.
+static uint64_t work_timestamp(const CUpti_CallbackData *cbInfo) {
+  if (env::sync_timing()) {
+    DriverState::this_thread().pause_cupti_callbacks();
+    CUDA_CHECK(cudaDeviceSynchronize());
+    DriverState::this_thread().resume_cupti_callbacks();
+  }
+  uint64_t time;
+  CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &time));
+  return time;
+}
+
+// The ApiRecord of an asynchronous call, timestamped at its entry or exit
+static ApiRecordRef work_api(const CUpti_CallbackData *cbInfo) {
+  const uint64_t time = work_timestamp(cbInfo);
+  auto api = DriverState::this_thread().current_api();
+  assert(api->cb_info() == cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    api->record_start_time(time);
+  } else {
+    api->record_end_time(time);
+  }
+  return api;
+}
+
+// Whether the current driver call was made by a runtime call, which records
+// the work instead
+static bool in_runtime_call() {
+  auto &ts = DriverState::this_thread();
+  return ts.in_child_api() && ts.parent_api()->is_runtime();
+}
+
 static void handleCudaLaunch(Values &values, const CUpti_CallbackData *cbInfo) {
   printf("callback: cudaLaunch preamble\n");
 
@@ -73,7 +114,25 @@ static void handleCudaLaunch(Values &values, const CUpti_CallbackData *cbInfo) {
   if (kernelArgIds.empty()) {
     printf("WARN: didn't find any values for cudaLaunch\n");
   }
-  // static std::map<Value::id_type, hash_t> arg_hashes;
+
+  // With CPROF_DIRTY_TRACKING, digests of each argument value taken before
+  // the launch. "hash" takes one digest of the whole value, "chunk" one per
+  // CPROF_DIRTY_CHUNK_BYTES.
+  static const std::string dirtyMode = env::dirty_tracking();
+  static const bool trackDirty = dirtyMode == "hash" || dirtyMode == "chunk";
+  static thread_local std::map<Value::id_type, std::vector<hash_t>> arg_hashes;
+  static thread_local uint64_t launchStart;
+  auto chunk_size = [](const Values::value_type &v) {
+    static const size_t chunkBytes = env::dirty_chunk_bytes();
+    return dirtyMode == "chunk" ? chunkBytes : v->size();
+  };
+  // values are kept after their allocation is freed, and a freed device
+  // buffer can't be hashed
+  auto allocated = [](const Values::value_type &v) {
+    return Allocations::instance()
+               .location(v->allocation_id())
+               .address_space_type() == AddressSpace::Type::Cuda;
+  };
 
   if (cbInfo->callbackSite == CUPTI_API_ENTER) {
     // printf("callback: cudaLaunch entry\n");
@@ -84,15 +143,17 @@ static void handleCudaLaunch(Values &values, const CUpti_CallbackData *cbInfo) {
     // The kernel could modify each argument value.
     // Check the hash of each argument so that when the call exits, we can see
     // if it was modified.
-
-    // arg_hashes.clear();
-    // for (const auto &argKey : kernelArgIds) {
-    //   const auto &argValue = values[argKey];
-    //   assert(argValue->address_space().is_cuda());
-    // auto digest = hash_device(argValue->pos(), argValue->size());
-    // printf("digest: %llu\n", digest);
-    // arg_hashes[argKey] = digest;
-    // }
+    arg_hashes.clear();
+    if (trackDirty) {
+      for (const auto &argKey : kernelArgIds) {
+        const auto &argValue = values[argKey];
+        if (argValue->is_known_size() && allocated(argValue)) {
+          arg_hashes[argKey] = hash_device_chunks(
+              argValue->pos(), argValue->size(), chunk_size(argValue));
+        }
+      }
+    }
+    launchStart = work_timestamp(cbInfo);
 
   } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
     printf("callback: cudaLaunch exit\n");
@@ -100,6 +161,15 @@ static void handleCudaLaunch(Values &values, const CUpti_CallbackData *cbInfo) {
     auto api = std::make_shared<ApiRecord>(
         cbInfo->functionName, cbInfo->symbolName,
         DriverState::this_thread().current_device());
+    api->record_start_time(launchStart);
+    api->record_end_time(work_timestamp(cbInfo));
+
+    // The launch is asynchronous, wait for the kernel before hashing again
+    if (!arg_hashes.empty()) {
+      DriverState::this_thread().pause_cupti_callbacks();
+      CUDA_CHECK(cudaDeviceSynchronize());
+      DriverState::this_thread().resume_cupti_callbacks();
+    }
 
     // The kernel could have modified any argument values.
     // Hash each value and compare to the one recorded at kernel launch
@@ -107,23 +177,44 @@ static void handleCudaLaunch(Values &values, const CUpti_CallbackData *cbInfo) {
     for (const auto &argValId : kernelArgIds) {
       const auto &argValue = values[argValId];
       api->add_input(argValId);
-      // const auto digest = hash_device(argValue->pos(), argValue->size());
-
-      // if (arg_hashes.count(argKey)) {
-      //   printf("digest: %llu ==> %llu\n", arg_hashes[argKey], digest);
-      // }
-      // no recorded hash, or hash does not match => new value
-      // if (arg_hashes.count(argKey) == 0 || digest != arg_hashes[argKey]) {
-      Values::id_type newId;
-      Values::value_type newVal;
-      std::tie(newId, newVal) = values.duplicate_value(argValue);
-      for (const auto &depId : kernelArgIds) {
-        printf("launch: %lu deps on %lu\n", newId, depId);
-        newVal->add_depends_on(depId);
+      if (!allocated(argValue)) {
+        printf("WARN: launch argument %lu is in a freed allocation\n",
+               argValId);
+        continue;
+      }
+
+      // no recorded hash => assume the whole value was written
+      std::vector<Extent> written;
+      const auto &before = arg_hashes.find(argValId);
+      if (before == arg_hashes.end()) {
+        written.push_back(*argValue);
+      } else {
+        const auto after = hash_device_chunks(
+            argValue->pos(), argValue->size(), chunk_size(argValue));
+        written = dirty_extents(argValue->pos(), argValue->size(),
+                                chunk_size(argValue), before->second, after);
+        printf("launch: %lu dirty extents in %lu\n", written.size(),
+               argValId);
+      }
+
+      for (const auto &e : written) {
+        Values::id_type newId;
+        Values::value_type newVal;
+        if (e.pos() == argValue->pos() && e.size() == argValue->size()) {
+          std::tie(newId, newVal) = values.duplicate_value(argValue);
+        } else {
+          std::tie(newId, newVal) = values.new_value(
+              e.pos(), e.size(), argValue->allocation_id(), true);
+        }
+        for (const auto &depId : kernelArgIds) {
+          printf("launch: %lu deps on %lu\n", newId, depId);
+          newVal->add_depends_on(depId);
+        }
+        api->add_output(newId);
       }
-      api->add_output(newId);
-      // }
     }
+    arg_hashes.clear();
+    Streams::instance().enqueue(*api, stream);
     APIs::record(api);
     ConfiguredCall().valid = false;
     ConfiguredCall().args.clear();
@@ -155,24 +246,172 @@ Allocations::id_type best_effort_allocation(const uintptr_t p,
   return Allocations::noid;
 }
 
+// Hash the source of a memcpy, if CPROF_HASH_MEMCPY asks for it
+static optional<hash_t> memcpy_digest(const uintptr_t src, const size_t count) {
+  static const std::string mode = env::hash_memcpy();
+  static const size_t minBytes = env::hash_min_bytes();
+  static const size_t sampleBytes = env::hash_sample_bytes();
+
+  if (count < minBytes) {
+    return optional<hash_t>();
+  }
+  if (mode == "full") {
+    return optional<hash_t>(hash_host(src, count));
+  } else if (mode == "sampled") {
+    return optional<hash_t>(hash_host_sampled(src, count, sampleBytes));
+  }
+  return optional<hash_t>();
+}
+
+// Record the application frame that made api, if CPROF_CALLSITES asks for it
+// or CPROF_HASH_MEMCPY is set, since cprof2redundant.py groups by it. Walking
+// the stack costs a backtrace and a dladdr per frame.
+static void set_callsite(ApiRecord &api) {
+  static const std::string hashMode = env::hash_memcpy();
+  static const bool enabled =
+      env::callsites() || hashMode == "full" || hashMode == "sampled";
+  if (enabled) {
+    api.set_callsite(get_callsite());
+  }
+}
+
+// The start and end times of cbInfo cover its copy: it is synchronous, or
+// CPROF_SYNC_TIMING waited for it. Async and peer copies can return as soon
+// as the copy is issued.
+static bool copy_is_timed(const CUpti_CallbackData *cbInfo) {
+  if (env::sync_timing()) {
+    return true;
+  }
+  const std::string name(cbInfo->functionName);
+  return name.find("Async") == std::string::npos &&
+         name.find("Peer") == std::string::npos;
+}
+
+// Add a memcpy between the device and hostAlloc to the bandwidth totals
+static void record_transfer(const CUpti_CallbackData *cbInfo,
+                            const ApiRecord &api, const char *direction,
+                            const AllocationRecord &hostAlloc,
+                            const uintptr_t hostPtr, const size_t count) {
+  TransferStats::Key key;
+  key.direction = direction;
+  key.pageType = to_string(hostAlloc.page_type());
+  const Memory mem = hostAlloc.memory();
+  const int node = mem.id_ ? mem.id_.value() : get_numa_node(hostPtr);
+  key.numaNode = node < 0 ? -1 : node;
+  key.device = api.device();
+  key.deviceNumaNode = DeviceTopology::instance().numa_node(api.device());
+  TransferStats::instance().record(key, hostAlloc.Id(), count,
+                                   api.end() - api.start(),
+                                   copy_is_timed(cbInfo));
+}
+
+// One side of a memcpy, or what a memset writes: slices of rows of width
+// bytes, pitch bytes apart, with slicePitch bytes between slices, on device,
+// or -1 if the call doesn't say
+class MemcpyOperand {
+public:
+  uintptr_t ptr;
+  size_t width;
+  size_t pitch;
+  size_t rows; // per slice
+  size_t slices;
+  size_t slicePitch;
+  int device;
+
+  MemcpyOperand(uintptr_t p, size_t bytes, int d = -1)
+      : ptr(p), width(bytes), pitch(bytes), rows(1), slices(1), slicePitch(0),
+        device(d) {}
+  MemcpyOperand(uintptr_t p, size_t w, size_t pi, size_t r, int d = -1)
+      : ptr(p), width(w), pitch(pi), rows(r), slices(1), slicePitch(0),
+        device(d) {}
+  MemcpyOperand(uintptr_t p, size_t w, size_t pi, size_t r, size_t s,
+                size_t sp, int d = -1)
+      : ptr(p), width(w), pitch(pi), rows(r), slices(s), slicePitch(sp),
+        device(d) {}
+
+  // the rows of all slices are evenly spaced
+  bool is_even() const { return slices <= 1 || slicePitch == rows * pitch; }
+  bool is_contiguous() const {
+    return is_even() && (rows * slices <= 1 || pitch == width);
+  }
+  // bytes from the first row to the end of the last
+  size_t span() const {
+    if (!width || !rows || !slices) {
+      return 0;
+    }
+    return (slices - 1) * slicePitch + (rows - 1) * pitch + width;
+  }
+  Value *new_value(AllocationRecord::id_type allocId,
+                   bool initialized = false) const {
+    if (is_contiguous()) {
+      return new Value(ptr, span(), allocId, initialized);
+    }
+    if (is_even()) {
+      return new Value(ptr, width, pitch, rows * slices, allocId, initialized);
+    }
+    // a slice is one range if its rows are contiguous
+    const bool solid = rows <= 1 || pitch == width;
+    std::vector<Extent> ranges;
+    for (size_t s = 0; s < slices; ++s) {
+      const uintptr_t slice = ptr + s * slicePitch;
+      if (solid) {
+        ranges.emplace_back(slice, (rows - 1) * pitch + width);
+        continue;
+      }
+      for (size_t r = 0; r < rows; ++r) {
+        ranges.emplace_back(slice + r * pitch, width);
+      }
+    }
+    return new Value(ranges, allocId, initialized);
+  }
+};
+
+// The device alloc is on, from the call, its address space or its memory.
+// -1 for host memory, including memory the driver pinned. The current device
+// if nothing says.
+static int memcpy_device(const AllocationRecord &alloc,
+                         const MemcpyOperand &op, const int current) {
+  const AddressSpace as = alloc.address_space();
+  const Memory mem = alloc.memory();
+  if (!as.is_cuda() || mem.loc_ == Memory::Host) {
+    return -1;
+  }
+  if (op.device >= 0) {
+    return op.device;
+  }
+  if (as.device() >= 0) {
+    return as.device();
+  }
+  if (mem.loc_ == Memory::CudaDevice && mem.id_) {
+    return mem.id_.value();
+  }
+  return current;
+}
+
 void record_memcpy(const CUpti_CallbackData *cbInfo, Allocations &allocations,
-                   Values &values, const ApiRecordRef &api, const uintptr_t dst,
-                   const uintptr_t src, const MemoryCopyKind &kind,
-                   const size_t count, const int peerSrc, const int peerDst) {
+                   Values &values, const ApiRecordRef &api,
+                   const MemcpyOperand &dstOp, const MemcpyOperand &srcOp,
+                   const MemoryCopyKind &kind, const size_t count) {
+
+  const uintptr_t dst = dstOp.ptr;
+  const uintptr_t src = srcOp.ptr;
+  const size_t dstSpan = dstOp.span();
+  const size_t srcSpan = srcOp.span();
 
   Allocations::id_type srcAllocId = 0, dstAllocId = 0;
   AddressSpace srcAS, dstAS;
+  optional<hash_t> digest;
 
   // Set address space, and create missing allocations along the way
   if (MemoryCopyKind::CudaHostToDevice() == kind) {
     printf("%lu --[h2d]--> %lu\n", src, dst);
 
     // Look for, or create a source allocation
-    srcAllocId = best_effort_allocation(src, count);
+    srcAllocId = best_effort_allocation(src, srcSpan);
     if (!srcAllocId) {
-      Memory M(Memory::Host, get_numa_node(dst));
+      Memory M(Memory::Host, get_numa_node(src));
       std::tie(srcAllocId, std::ignore) =
-          allocations.new_allocation(src, count, AddressSpace::Host(), M,
+          allocations.new_allocation(src, srcSpan, AddressSpace::Host(), M,
                                      AllocationRecord::PageType::Unknown);
       printf("WARN: Couldn't find src alloc. Created implict host "
              "allocation=%lu.\n",
@@ -180,33 +419,39 @@ void record_memcpy(const CUpti_CallbackData *cbInfo, Allocations &allocations,
     }
 
     srcAS = allocations.at(srcAllocId)->address_space();
-    dstAS = AddressSpace::Cuda();
+    dstAS = AddressSpace::Cuda(dstOp.device);
+    if (srcOp.is_contiguous()) {
+      digest = memcpy_digest(src, count);
+    }
   } else if (MemoryCopyKind::CudaDeviceToHost() == kind) {
     printf("%lu --[d2h]--> %lu\n", src, dst);
 
     // Look for, or create a destination allocation
-    dstAllocId = best_effort_allocation(dst, count);
+    dstAllocId = best_effort_allocation(dst, dstSpan);
     if (!dstAllocId) {
       Memory M(Memory::Host, get_numa_node(dst));
       std::tie(dstAllocId, std::ignore) =
-          allocations.new_allocation(dst, count, AddressSpace::Host(), M,
+          allocations.new_allocation(dst, dstSpan, AddressSpace::Host(), M,
                                      AllocationRecord::PageType::Unknown);
       printf("WARN: Couldn't find dst alloc. Created implict host "
              "allocation=%lu.\n",
              src);
     }
 
-    srcAS = AddressSpace::Cuda();
+    srcAS = AddressSpace::Cuda(srcOp.device);
     dstAS = allocations.at(dstAllocId)->address_space();
-  } else if (MemoryCopyKind::CudaDeviceToDevice() == kind) {
-    srcAS = AddressSpace::Cuda();
-    dstAS = AddressSpace::Cuda();
+  } else if (MemoryCopyKind::CudaDeviceToDevice() == kind ||
+             MemoryCopyKind::CudaPeer() == kind) {
+    srcAS = AddressSpace::Cuda(srcOp.device);
+    dstAS = AddressSpace::Cuda(dstOp.device);
   } else if (MemoryCopyKind::CudaDefault() == kind) {
-    srcAS = AddressSpace::Cuda();
-    dstAS = AddressSpace::Cuda();
-  } else if (MemoryCopyKind::CudaPeer() == kind) {
-    srcAS = AddressSpace::Cuda();
-    dstAS = AddressSpace::Cuda();
+    // the pointers say where the memory is
+    srcAllocId = best_effort_allocation(src, srcSpan);
+    dstAllocId = best_effort_allocation(dst, dstSpan);
+    srcAS = srcAllocId ? allocations.at(srcAllocId)->address_space()
+                       : AddressSpace::Cuda();
+    dstAS = dstAllocId ? allocations.at(dstAllocId)->address_space()
+                       : AddressSpace::Cuda();
   } else if (MemoryCopyKind::CudaHostToHost() == kind) {
     assert(0 && "Unimplemented");
   } else {
@@ -217,12 +462,12 @@ void record_memcpy(const CUpti_CallbackData *cbInfo, Allocations &allocations,
   // Either we just made it, or it should already exist.
   if (!srcAllocId) {
     std::tie(srcAllocId, std::ignore) =
-        allocations.find_live(src, count, srcAS);
+        allocations.find_live(src, srcSpan, srcAS);
     assert(srcAllocId != Allocations::noid);
   }
   if (!dstAllocId) {
     std::tie(dstAllocId, std::ignore) =
-        allocations.find_live(dst, count, dstAS);
+        allocations.find_live(dst, dstSpan, dstAS);
     assert(dstAllocId != Allocations::noid);
   }
 
@@ -232,27 +477,45 @@ void record_memcpy(const CUpti_CallbackData *cbInfo, Allocations &allocations,
   Values::id_type srcValId;
   bool found;
   std::tie(found, srcValId) =
-      values.get_last_overlapping_value(src, count, srcAS);
+      values.get_last_overlapping_value(src, srcSpan, srcAS);
   if (found) {
     printf("memcpy: found src value srcId=%lu\n", srcValId);
     if (!values[srcValId]->is_known_size()) {
       printf("WARN: source is unknown size. Setting by memcpy count\n");
-      values[srcValId]->set_size(count);
+      values[srcValId]->set_size(srcSpan);
     }
   } else {
     printf("WARN: creating implicit src value during memcpy\n");
-    auto srcVal = std::shared_ptr<Value>(new Value(src, count, srcAllocId));
+    auto srcVal = std::shared_ptr<Value>(srcOp.new_value(srcAllocId));
     values.insert(srcVal);
     srcValId = srcVal->Id();
   }
 
   // always create a new dst value
-  Values::id_type dstValId;
-  Values::value_type dstVal;
-  std::tie(dstValId, dstVal) = values.new_value(dst, count, dstAllocId);
+  auto dstVal = std::shared_ptr<Value>(dstOp.new_value(dstAllocId));
+  if (digest) {
+    dstVal->set_digest(digest.value());
+  }
+  values.insert(dstVal);
+  const Values::id_type dstValId = dstVal->Id();
   dstVal->add_depends_on(srcValId);
   dstVal->record_meta_append(cbInfo->functionName);
 
+  const auto &srcAlloc = *allocations.at(srcAllocId);
+  const auto &dstAlloc = *allocations.at(dstAllocId);
+  const int srcDevice = memcpy_device(srcAlloc, srcOp, api->device());
+  const int dstDevice = memcpy_device(dstAlloc, dstOp, api->device());
+  if (srcDevice < 0 && dstDevice >= 0) {
+    record_transfer(cbInfo, *api, "h2d", srcAlloc, src, count);
+  } else if (srcDevice >= 0 && dstDevice < 0) {
+    record_transfer(cbInfo, *api, "d2h", dstAlloc, dst, count);
+  } else if (srcDevice >= 0 && dstDevice >= 0) {
+    TransferStats::instance().record_peer(srcDevice, dstDevice, count,
+                                          api->end() - api->start(),
+                                          copy_is_timed(cbInfo));
+  }
+
+  set_callsite(*api);
   api->add_input(srcValId);
   api->add_output(dstValId);
   APIs::record(api);
@@ -285,8 +548,12 @@ static void handleCudaMemcpy(Allocations &allocations, Values &values,
     assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
     api->record_end_time(end);
 
-    record_memcpy(cbInfo, allocations, values, api, dst, src,
-                  MemoryCopyKind(kind), count, 0 /*unused*/, 0 /*unused */);
+    // work on the default stream that the host waits for
+    Streams::instance().enqueue(*api, 0);
+    Streams::instance().synchronize_stream(*api, 0);
+
+    record_memcpy(cbInfo, allocations, values, api, MemcpyOperand(dst, count),
+                  MemcpyOperand(src, count), MemoryCopyKind(kind), count);
 
   } else {
     assert(0 && "How did we get here?");
@@ -305,23 +572,22 @@ static void handleCudaMemcpyAsync(Allocations &allocations, Values &values,
   if (cbInfo->callbackSite == CUPTI_API_ENTER) {
     printf("callback: cudaMemcpyAsync entry\n");
 
-    uint64_t start;
-    CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &start));
+    const uint64_t start = work_timestamp(cbInfo);
     auto api = DriverState::this_thread().current_api();
     assert(api->cb_info() == cbInfo);
     assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
     api->record_start_time(start);
 
   } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
-    uint64_t end;
-    CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &end));
+    const uint64_t end = work_timestamp(cbInfo);
     auto api = DriverState::this_thread().current_api();
     assert(api->cb_info() == cbInfo);
     assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
     api->record_end_time(end);
 
-    record_memcpy(cbInfo, allocations, values, api, dst, src,
-                  MemoryCopyKind(kind), count, 0 /*unused*/, 0 /*unused */);
+    Streams::instance().enqueue(*api, stream);
+    record_memcpy(cbInfo, allocations, values, api, MemcpyOperand(dst, count),
+                  MemcpyOperand(src, count), MemoryCopyKind(kind), count);
   } else {
     assert(0 && "How did we get here?");
   }
@@ -339,13 +605,85 @@ static void handleCudaMemcpyPeerAsync(Allocations &allocations, Values &values,
   const cudaStream_t stream = params->stream;
   if (cbInfo->callbackSite == CUPTI_API_ENTER) {
     printf("callback: cudaMemcpyPeerAsync entry\n");
+    const uint64_t start = work_timestamp(cbInfo);
+    auto api = DriverState::this_thread().current_api();
+    assert(api->cb_info() == cbInfo);
+    assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+    api->record_start_time(start);
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    const uint64_t end = work_timestamp(cbInfo);
+    auto api = DriverState::this_thread().current_api();
+    assert(api->cb_info() == cbInfo);
+    assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+    api->record_end_time(end);
+
+    Streams::instance().enqueue(*api, stream);
+    record_memcpy(cbInfo, allocations, values, api,
+                  MemcpyOperand(dst, count, dstDevice),
+                  MemcpyOperand(src, count, srcDevice),
+                  MemoryCopyKind::CudaPeer(), count);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaMemcpyPeer(Allocations &allocations, Values &values,
+                                 const CUpti_CallbackData *cbInfo) {
+  // extract API call parameters
+  auto params = ((cudaMemcpyPeer_v4000_params *)(cbInfo->functionParams));
+  const uintptr_t dst = (uintptr_t)params->dst;
+  const int dstDevice = params->dstDevice;
+  const uintptr_t src = (uintptr_t)params->src;
+  const int srcDevice = params->srcDevice;
+  const size_t count = params->count;
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpyPeer entry\n");
+    const uint64_t start = work_timestamp(cbInfo);
+    auto api = DriverState::this_thread().current_api();
+    assert(api->cb_info() == cbInfo);
+    assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+    api->record_start_time(start);
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    const uint64_t end = work_timestamp(cbInfo);
+    auto api = DriverState::this_thread().current_api();
+    assert(api->cb_info() == cbInfo);
+    assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+    api->record_end_time(end);
+
+    // asynchronous to the host, but ordered with the default stream
+    Streams::instance().enqueue(*api, 0);
+    record_memcpy(cbInfo, allocations, values, api,
+                  MemcpyOperand(dst, count, dstDevice),
+                  MemcpyOperand(src, count, srcDevice),
+                  MemoryCopyKind::CudaPeer(), count);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaMemcpy2D(Allocations &allocations, Values &values,
+                               const CUpti_CallbackData *cbInfo) {
+  // extract API call parameters
+  auto params = ((cudaMemcpy2D_v3020_params *)(cbInfo->functionParams));
+  const uintptr_t dst = (uintptr_t)params->dst;
+  const size_t dpitch = params->dpitch;
+  const uintptr_t src = (uintptr_t)params->src;
+  const size_t spitch = params->spitch;
+  const size_t width = params->width;
+  const size_t height = params->height;
+  const cudaMemcpyKind kind = params->kind;
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpy2D entry\n");
+
     uint64_t start;
     CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &start));
     auto api = DriverState::this_thread().current_api();
     assert(api->cb_info() == cbInfo);
     assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
     api->record_start_time(start);
+
   } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+
     uint64_t end;
     CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &end));
     auto api = DriverState::this_thread().current_api();
@@ -353,8 +691,344 @@ static void handleCudaMemcpyPeerAsync(Allocations &allocations, Values &values,
     assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
     api->record_end_time(end);
 
-    record_memcpy(cbInfo, allocations, values, api, dst, src,
-                  MemoryCopyKind::CudaPeer(), count, srcDevice, dstDevice);
+    Streams::instance().enqueue(*api, 0);
+    Streams::instance().synchronize_stream(*api, 0);
+
+    if (!width || !height) {
+      // nothing is copied
+      set_callsite(*api);
+      APIs::record(api);
+      return;
+    }
+    record_memcpy(cbInfo, allocations, values, api,
+                  MemcpyOperand(dst, width, dpitch, height),
+                  MemcpyOperand(src, width, spitch, height),
+                  MemoryCopyKind(kind), width * height);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+// One side of a 3D copy of linear memory. Slices are ysize rows apart.
+static MemcpyOperand memcpy3d_operand(const cudaPitchedPtr &p,
+                                      const cudaPos &pos, const cudaExtent &e,
+                                      const int device) {
+  const uintptr_t ptr =
+      (uintptr_t)p.ptr + (pos.z * p.ysize + pos.y) * p.pitch + pos.x;
+  return MemcpyOperand(ptr, e.width, p.pitch, e.height, e.depth,
+                       p.pitch * p.ysize, device);
+}
+
+// A 3D copy of cudaMemcpy3DParms or cudaMemcpy3DPeerParms p
+template <typename Parms>
+static void record_memcpy3d(const CUpti_CallbackData *cbInfo,
+                            Allocations &allocations, Values &values,
+                            const ApiRecordRef &api, const Parms &p,
+                            const MemoryCopyKind &kind, const int dstDevice,
+                            const int srcDevice) {
+  const cudaExtent &e = p.extent;
+  if (p.srcArray || p.dstArray) {
+    // FIXME
+    printf("WARN: not tracking %s to or from a CUDA array\n",
+           cbInfo->functionName);
+  } else if (e.width && e.height && e.depth) {
+    record_memcpy(cbInfo, allocations, values, api,
+                  memcpy3d_operand(p.dstPtr, p.dstPos, e, dstDevice),
+                  memcpy3d_operand(p.srcPtr, p.srcPos, e, srcDevice), kind,
+                  e.width * e.height * e.depth);
+    return;
+  }
+  set_callsite(*api);
+  APIs::record(api);
+}
+
+static void handleCudaMemcpy3D(Allocations &allocations, Values &values,
+                               const CUpti_CallbackData *cbInfo) {
+  // extract API call parameters
+  auto params = ((cudaMemcpy3D_v3020_params *)(cbInfo->functionParams));
+  const cudaMemcpy3DParms *p = params->p;
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpy3D entry\n");
+
+    uint64_t start;
+    CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &start));
+    auto api = DriverState::this_thread().current_api();
+    assert(api->cb_info() == cbInfo);
+    assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+    api->record_start_time(start);
+
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+
+    uint64_t end;
+    CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &end));
+    auto api = DriverState::this_thread().current_api();
+    assert(api->cb_info() == cbInfo);
+    assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+    api->record_end_time(end);
+
+    Streams::instance().enqueue(*api, 0);
+    Streams::instance().synchronize_stream(*api, 0);
+    record_memcpy3d(cbInfo, allocations, values, api, *p,
+                    MemoryCopyKind(p->kind), -1, -1);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaMemcpy2DAsync(Allocations &allocations, Values &values,
+                                    const CUpti_CallbackData *cbInfo) {
+  auto params = ((cudaMemcpy2DAsync_v3020_params *)(cbInfo->functionParams));
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpy2DAsync entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    Streams::instance().enqueue(*api, params->stream);
+    const size_t width = params->width;
+    const size_t height = params->height;
+    if (!width || !height) {
+      // nothing is copied
+      set_callsite(*api);
+      APIs::record(api);
+      return;
+    }
+    record_memcpy(
+        cbInfo, allocations, values, api,
+        MemcpyOperand((uintptr_t)params->dst, width, params->dpitch, height),
+        MemcpyOperand((uintptr_t)params->src, width, params->spitch, height),
+        MemoryCopyKind(params->kind), width * height);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaMemcpy3DAsync(Allocations &allocations, Values &values,
+                                    const CUpti_CallbackData *cbInfo) {
+  auto params = ((cudaMemcpy3DAsync_v3020_params *)(cbInfo->functionParams));
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpy3DAsync entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    Streams::instance().enqueue(*api, params->stream);
+    record_memcpy3d(cbInfo, allocations, values, api, *params->p,
+                    MemoryCopyKind(params->p->kind), -1, -1);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaMemcpy3DPeer(Allocations &allocations, Values &values,
+                                   const CUpti_CallbackData *cbInfo) {
+  auto params = ((cudaMemcpy3DPeer_v4000_params *)(cbInfo->functionParams));
+  const cudaMemcpy3DPeerParms *p = params->p;
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpy3DPeer entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    // asynchronous to the host, but ordered with the default stream
+    Streams::instance().enqueue(*api, 0);
+    record_memcpy3d(cbInfo, allocations, values, api, *p,
+                    MemoryCopyKind::CudaPeer(), p->dstDevice, p->srcDevice);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaMemcpy3DPeerAsync(Allocations &allocations,
+                                        Values &values,
+                                        const CUpti_CallbackData *cbInfo) {
+  auto params =
+      ((cudaMemcpy3DPeerAsync_v4000_params *)(cbInfo->functionParams));
+  const cudaMemcpy3DPeerParms *p = params->p;
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemcpy3DPeerAsync entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    Streams::instance().enqueue(*api, params->stream);
+    record_memcpy3d(cbInfo, allocations, values, api, *p,
+                    MemoryCopyKind::CudaPeer(), p->dstDevice, p->srcDevice);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+// cuMemcpyDtoD and cuMemcpyPeer, which don't synchronize with the host
+static void handleCuMemcpyDtoD(Allocations &allocations, Values &values,
+                               const CUpti_CallbackData *cbInfo,
+                               const uintptr_t dst, const uintptr_t src,
+                               const size_t count, const cudaStream_t stream) {
+  if (in_runtime_call()) {
+    return;
+  }
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: %s entry\n", cbInfo->functionName);
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    Streams::instance().enqueue(*api, stream);
+    record_memcpy(cbInfo, allocations, values, api, MemcpyOperand(dst, count),
+                  MemcpyOperand(src, count),
+                  MemoryCopyKind::CudaDeviceToDevice(), count);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+// A memset writes a new value, which depends on nothing
+static void record_memset(const CUpti_CallbackData *cbInfo,
+                          Allocations &allocations, Values &values,
+                          const ApiRecordRef &api, const MemcpyOperand &dst) {
+  set_callsite(*api);
+  if (!dst.span()) {
+    APIs::record(api);
+    return;
+  }
+
+  Allocations::id_type allocId;
+  std::tie(allocId, std::ignore) = allocations.find_live(
+      dst.ptr, dst.span(), AddressSpace::Cuda(dst.device));
+  if (allocId == Allocations::noid) {
+    printf("WARN: creating implicit allocation for %s of %lu\n",
+           cbInfo->functionName, dst.ptr);
+    std::tie(allocId, std::ignore) = allocations.new_allocation(
+        dst.ptr, dst.span(), AddressSpace::Cuda(), Memory(Memory::Unknown),
+        AllocationRecord::PageType::Unknown);
+  }
+
+  auto val = std::shared_ptr<Value>(dst.new_value(allocId, true));
+  values.insert(val);
+  val->record_meta_append(cbInfo->functionName);
+  api->add_output(val->Id());
+  APIs::record(api);
+}
+
+// What the memset cbid writes, and the stream it is issued to
+static MemcpyOperand memset_operand(const CUpti_CallbackId cbid,
+                                    const void *params, cudaStream_t &stream) {
+  const cudaPos origin = {0, 0, 0};
+  stream = 0;
+  switch (cbid) {
+  case CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020: {
+    auto p = (const cudaMemset_v3020_params *)params;
+    return MemcpyOperand((uintptr_t)p->devPtr, p->count);
+  }
+  case CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_v3020: {
+    auto p = (const cudaMemsetAsync_v3020_params *)params;
+    stream = p->stream;
+    return MemcpyOperand((uintptr_t)p->devPtr, p->count);
+  }
+  case CUPTI_RUNTIME_TRACE_CBID_cudaMemset2D_v3020: {
+    auto p = (const cudaMemset2D_v3020_params *)params;
+    return MemcpyOperand((uintptr_t)p->devPtr, p->width, p->pitch, p->height);
+  }
+  case CUPTI_RUNTIME_TRACE_CBID_cudaMemset2DAsync_v3020: {
+    auto p = (const cudaMemset2DAsync_v3020_params *)params;
+    stream = p->stream;
+    return MemcpyOperand((uintptr_t)p->devPtr, p->width, p->pitch, p->height);
+  }
+  case CUPTI_RUNTIME_TRACE_CBID_cudaMemset3D_v3020: {
+    auto p = (const cudaMemset3D_v3020_params *)params;
+    return memcpy3d_operand(p->pitchedDevPtr, origin, p->extent, -1);
+  }
+  case CUPTI_RUNTIME_TRACE_CBID_cudaMemset3DAsync_v3020: {
+    auto p = (const cudaMemset3DAsync_v3020_params *)params;
+    stream = p->stream;
+    return memcpy3d_operand(p->pitchedDevPtr, origin, p->extent, -1);
+  }
+  default:
+    assert(0 && "not a runtime memset");
+    return MemcpyOperand(0, 0);
+  }
+}
+
+// The driver memsets, by elements of 1, 2 or 4 bytes. The 2D forms set
+// Height rows of Width elements, dstPitch bytes apart.
+static MemcpyOperand cu_memset_operand(const CUpti_CallbackId cbid,
+                                       const void *params,
+                                       cudaStream_t &stream) {
+  stream = 0;
+  switch (cbid) {
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD8_v2: {
+    auto p = (const cuMemsetD8_v2_params *)params;
+    return MemcpyOperand((uintptr_t)p->dstDevice, p->N);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD16_v2: {
+    auto p = (const cuMemsetD16_v2_params *)params;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 2 * p->N);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD32_v2: {
+    auto p = (const cuMemsetD32_v2_params *)params;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 4 * p->N);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD8Async: {
+    auto p = (const cuMemsetD8Async_params *)params;
+    stream = (cudaStream_t)p->hStream;
+    return MemcpyOperand((uintptr_t)p->dstDevice, p->N);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD16Async: {
+    auto p = (const cuMemsetD16Async_params *)params;
+    stream = (cudaStream_t)p->hStream;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 2 * p->N);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD32Async: {
+    auto p = (const cuMemsetD32Async_params *)params;
+    stream = (cudaStream_t)p->hStream;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 4 * p->N);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D8_v2: {
+    auto p = (const cuMemsetD2D8_v2_params *)params;
+    return MemcpyOperand((uintptr_t)p->dstDevice, p->Width, p->dstPitch,
+                         p->Height);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D16_v2: {
+    auto p = (const cuMemsetD2D16_v2_params *)params;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 2 * p->Width, p->dstPitch,
+                         p->Height);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D32_v2: {
+    auto p = (const cuMemsetD2D32_v2_params *)params;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 4 * p->Width, p->dstPitch,
+                         p->Height);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D8Async: {
+    auto p = (const cuMemsetD2D8Async_params *)params;
+    stream = (cudaStream_t)p->hStream;
+    return MemcpyOperand((uintptr_t)p->dstDevice, p->Width, p->dstPitch,
+                         p->Height);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D16Async: {
+    auto p = (const cuMemsetD2D16Async_params *)params;
+    stream = (cudaStream_t)p->hStream;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 2 * p->Width, p->dstPitch,
+                         p->Height);
+  }
+  case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D32Async: {
+    auto p = (const cuMemsetD2D32Async_params *)params;
+    stream = (cudaStream_t)p->hStream;
+    return MemcpyOperand((uintptr_t)p->dstDevice, 4 * p->Width, p->dstPitch,
+                         p->Height);
+  }
+  default:
+    assert(0 && "not a driver memset");
+    return MemcpyOperand(0, 0);
+  }
+}
+
+static void handleMemset(Allocations &allocations, Values &values,
+                         const CUpti_CallbackId cbid,
+                         const CUpti_CallbackData *cbInfo) {
+  const bool driver = !DriverState::this_thread().current_api()->is_runtime();
+  if (driver && in_runtime_call()) {
+    return;
+  }
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: %s entry\n", cbInfo->functionName);
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    cudaStream_t stream;
+    const MemcpyOperand dst =
+        driver ? cu_memset_operand(cbid, cbInfo->functionParams, stream)
+               : memset_operand(cbid, cbInfo->functionParams, stream);
+    Streams::instance().enqueue(*api, stream);
+    record_memset(cbInfo, allocations, values, api, dst);
   } else {
     assert(0 && "How did we get here?");
   }
@@ -372,12 +1046,14 @@ static void handleCudaMallocManaged(Allocations &allocations, Values &values,
 
     printf("[cudaMallocManaged] %lu[%lu]\n", devPtr, size);
 
-    // Create the new allocation
-    Memory AM(Memory::CudaDevice, DriverState::this_thread().current_device());
+    // Create the new allocation, which migrates between the host and devices
+    Memory AM(Memory::CudaUnified,
+              DriverState::this_thread().current_device());
     Allocations::id_type aId;
-    std::tie(aId, std::ignore) =
-        allocations.new_allocation(devPtr, size, AddressSpace::Cuda(), AM,
-                                   AllocationRecord::PageType::Pageable);
+    std::tie(aId, std::ignore) = allocations.new_allocation(
+        devPtr, size, AddressSpace::Cuda(), AM,
+        AllocationRecord::PageType::Pageable, flags);
+    UnifiedMemoryStats::instance().add_allocation(aId, devPtr, size);
 
     // Create the new value
     values.new_value(devPtr, size, aId, false /*initialized*/);
@@ -386,6 +1062,64 @@ static void handleCudaMallocManaged(Allocations &allocations, Values &values,
   }
 }
 
+static void handleCudaMemPrefetchAsync(const CUpti_CallbackData *cbInfo) {
+  auto params =
+      ((cudaMemPrefetchAsync_v8000_params *)(cbInfo->functionParams));
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemPrefetchAsync entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    Streams::instance().enqueue(*api, params->stream);
+    UnifiedMemoryStats::instance().record(UnifiedMemoryStats::Event(
+        UnifiedMemoryStats::Kind::Prefetch, (uintptr_t)params->devPtr,
+        params->count));
+    set_callsite(*api);
+    APIs::record(api);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+// "read_mostly", "preferred_location:<device or host>" or
+// "accessed_by:<device or host>", and whether advice sets or unsets it
+static std::pair<std::string, bool> advice_name(const cudaMemoryAdvise advice,
+                                                const int device) {
+  const std::string where =
+      device == cudaCpuDeviceId ? "host" : std::to_string(device);
+  switch (advice) {
+  case cudaMemAdviseSetReadMostly:
+    return std::make_pair("read_mostly", true);
+  case cudaMemAdviseUnsetReadMostly:
+    return std::make_pair("read_mostly", false);
+  case cudaMemAdviseSetPreferredLocation:
+    return std::make_pair("preferred_location:" + where, true);
+  case cudaMemAdviseUnsetPreferredLocation:
+    return std::make_pair("preferred_location:" + where, false);
+  case cudaMemAdviseSetAccessedBy:
+    return std::make_pair("accessed_by:" + where, true);
+  case cudaMemAdviseUnsetAccessedBy:
+    return std::make_pair("accessed_by:" + where, false);
+  default:
+    return std::make_pair("unknown:" + std::to_string(int(advice)), true);
+  }
+}
+
+static void handleCudaMemAdvise(const CUpti_CallbackData *cbInfo) {
+  auto params = ((cudaMemAdvise_v8000_params *)(cbInfo->functionParams));
+  auto api = work_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaMemAdvise entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    const auto advice = advice_name(params->advice, params->device);
+    UnifiedMemoryStats::instance().advise((uintptr_t)params->devPtr,
+                                          advice.first, advice.second);
+    set_callsite(*api);
+    APIs::record(api);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
 void record_mallochost(Allocations &allocations, Values &values,
                        const uintptr_t ptr, const size_t size) {
 
@@ -506,12 +1240,11 @@ static void handleCudaMalloc(Allocations &allocations, Values &values,
     // FIXME: could be an existing allocation from an instrumented driver
     // API
 
-    // Create the new allocation
-    // FIXME: need to check which address space this is in
-    Memory AM =
-        Memory(Memory::CudaDevice, DriverState::this_thread().current_device());
+    // Create the new allocation, on the current device
+    const int device = DriverState::this_thread().current_device();
+    Memory AM = Memory(Memory::CudaDevice, device);
     std::shared_ptr<AllocationRecord> a(
-        new AllocationRecord(devPtr, size, AddressSpace::Cuda(), AM,
+        new AllocationRecord(devPtr, size, AddressSpace::Cuda(device), AM,
                              AllocationRecord::PageType::Pageable));
     Allocations::id_type aId = allocations.insert(a).first->first;
     printf("[cudaMalloc] new alloc id=%lu\n", aId);
@@ -608,14 +1341,54 @@ static void handleCudaSetupArgument(const CUpti_CallbackData *cbInfo) {
   }
 }
 
+// The ApiRecord of a runtime call, timestamped at its entry or exit
+static ApiRecordRef timed_api(const CUpti_CallbackData *cbInfo) {
+  uint64_t time;
+  CUPTI_CHECK(cuptiDeviceGetTimestamp(cbInfo->context, &time));
+  auto api = DriverState::this_thread().current_api();
+  assert(api->cb_info() == cbInfo);
+  assert(api->domain() == CUPTI_CB_DOMAIN_RUNTIME_API);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    api->record_start_time(time);
+  } else {
+    api->record_end_time(time);
+  }
+  return api;
+}
+
 static void handleCudaStreamCreate(const CUpti_CallbackData *cbInfo) {
   if (cbInfo->callbackSite == CUPTI_API_ENTER) {
   } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
-    printf("callback: cudaStreamCreate entry\n");
+    printf("callback: cudaStreamCreate exit\n");
     const auto params =
         ((cudaStreamCreate_v3020_params *)(cbInfo->functionParams));
     const cudaStream_t stream = *(params->pStream);
-    printf("WARN: ignoring cudaStreamCreate\n");
+    Streams::instance().create(stream, cudaStreamDefault);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaStreamCreateWithFlags(const CUpti_CallbackData *cbInfo) {
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    printf("callback: cudaStreamCreateWithFlags exit\n");
+    const auto params =
+        ((cudaStreamCreateWithFlags_v5000_params *)(cbInfo->functionParams));
+    Streams::instance().create(*(params->pStream), params->flags);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void
+handleCudaStreamCreateWithPriority(const CUpti_CallbackData *cbInfo) {
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    printf("callback: cudaStreamCreateWithPriority exit\n");
+    const auto params =
+        ((cudaStreamCreateWithPriority_v5050_params *)(cbInfo->functionParams));
+    Streams::instance().create(*(params->pStream), params->flags);
   } else {
     assert(0 && "How did we get here?");
   }
@@ -623,10 +1396,11 @@ static void handleCudaStreamCreate(const CUpti_CallbackData *cbInfo) {
 
 static void handleCudaStreamDestroy(const CUpti_CallbackData *cbInfo) {
   if (cbInfo->callbackSite == CUPTI_API_ENTER) {
-    printf("callback: cudaStreamCreate entry\n");
+    printf("callback: cudaStreamDestroy entry\n");
     const auto params =
         ((cudaStreamDestroy_v3020_params *)(cbInfo->functionParams));
     const cudaStream_t stream = params->stream;
+    Streams::instance().destroy(stream);
   } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
   } else {
     assert(0 && "How did we get here?");
@@ -634,12 +1408,81 @@ static void handleCudaStreamDestroy(const CUpti_CallbackData *cbInfo) {
 }
 
 static void handleCudaStreamSynchronize(const CUpti_CallbackData *cbInfo) {
+  auto api = timed_api(cbInfo);
   if (cbInfo->callbackSite == CUPTI_API_ENTER) {
     printf("callback: cudaStreamSynchronize entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
     const auto params =
         ((cudaStreamSynchronize_v3020_params *)(cbInfo->functionParams));
     const cudaStream_t stream = params->stream;
+    Streams::instance().synchronize_stream(*api, stream);
+    APIs::record(api);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaStreamWaitEvent(const CUpti_CallbackData *cbInfo) {
+  auto api = timed_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaStreamWaitEvent entry\n");
   } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    const auto params =
+        ((cudaStreamWaitEvent_v3020_params *)(cbInfo->functionParams));
+    Streams::instance().wait_event(*api, params->stream, params->event);
+    APIs::record(api);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaEventRecord(const CUpti_CallbackData *cbInfo) {
+  auto api = timed_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaEventRecord entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    const auto params =
+        ((cudaEventRecord_v3020_params *)(cbInfo->functionParams));
+    Streams::instance().record_event(*api, params->event, params->stream);
+    APIs::record(api);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaEventSynchronize(const CUpti_CallbackData *cbInfo) {
+  auto api = timed_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: cudaEventSynchronize entry\n");
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    const auto params =
+        ((cudaEventSynchronize_v3020_params *)(cbInfo->functionParams));
+    Streams::instance().synchronize_event(*api, params->event);
+    APIs::record(api);
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+static void handleCudaEventDestroy(const CUpti_CallbackData *cbInfo) {
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    const auto params =
+        ((cudaEventDestroy_v3020_params *)(cbInfo->functionParams));
+    Streams::instance().destroy_event(params->event);
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+  } else {
+    assert(0 && "How did we get here?");
+  }
+}
+
+// cudaDeviceSynchronize, or the deprecated cudaThreadSynchronize
+static void handleCudaDeviceSynchronize(const CUpti_CallbackData *cbInfo) {
+  auto api = timed_api(cbInfo);
+  if (cbInfo->callbackSite == CUPTI_API_ENTER) {
+    printf("callback: %s entry\n", cbInfo->functionName);
+  } else if (cbInfo->callbackSite == CUPTI_API_EXIT) {
+    Streams::instance().synchronize_device(*api);
+    APIs::record(api);
   } else {
     assert(0 && "How did we get here?");
   }
@@ -650,16 +1493,34 @@ void CUPTIAPI callback(void *userdata, CUpti_CallbackDomain domain,
                        const CUpti_CallbackData *cbInfo) {
   (void)userdata;
 
+  // the depth of this thread's API stack, so exits while tracing is off are
+  // only matched against it when a call is still open
+  static thread_local unsigned tracedCalls = 0;
+
+  if (!Control::tracing()) {
+    // finish calls that began while tracing was on
+    if (cbInfo->callbackSite != CUPTI_API_EXIT || !tracedCalls) {
+      return;
+    }
+  }
+
   if (!DriverState::this_thread().is_cupti_callbacks_enabled()) {
     return;
   }
 
+  // a call that began while tracing was off
+  if (cbInfo->callbackSite == CUPTI_API_EXIT &&
+      !DriverState::this_thread().is_current_api(cbInfo)) {
+    return;
+  }
+
   if ((domain == CUPTI_CB_DOMAIN_DRIVER_API) ||
       (domain == CUPTI_CB_DOMAIN_RUNTIME_API)) {
     if (cbInfo->callbackSite == CUPTI_API_ENTER) {
       // printf("tid=%d about to increase api stack\n", get_thread_id());
       DriverState::this_thread().api_enter(
           DriverState::this_thread().current_device(), domain, cbid, cbInfo);
+      ++tracedCalls;
     }
   }
   // Data is collected for the following APIs
@@ -677,6 +1538,39 @@ void CUPTIAPI callback(void *userdata, CUpti_CallbackDomain domain,
       handleCudaMemcpyPeerAsync(Allocations::instance(), Values::instance(),
                                 cbInfo);
       break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyPeer_v4000:
+      handleCudaMemcpyPeer(Allocations::instance(), Values::instance(), cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy2D_v3020:
+      handleCudaMemcpy2D(Allocations::instance(), Values::instance(), cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy3D_v3020:
+      handleCudaMemcpy3D(Allocations::instance(), Values::instance(), cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy2DAsync_v3020:
+      handleCudaMemcpy2DAsync(Allocations::instance(), Values::instance(),
+                              cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy3DAsync_v3020:
+      handleCudaMemcpy3DAsync(Allocations::instance(), Values::instance(),
+                              cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy3DPeer_v4000:
+      handleCudaMemcpy3DPeer(Allocations::instance(), Values::instance(),
+                             cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy3DPeerAsync_v4000:
+      handleCudaMemcpy3DPeerAsync(Allocations::instance(), Values::instance(),
+                                  cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_v3020:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemset2D_v3020:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemset2DAsync_v3020:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemset3D_v3020:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemset3DAsync_v3020:
+      handleMemset(Allocations::instance(), Values::instance(), cbid, cbInfo);
+      break;
     case CUPTI_RUNTIME_TRACE_CBID_cudaMalloc_v3020:
       handleCudaMalloc(Allocations::instance(), Values::instance(), cbInfo);
       break;
@@ -687,6 +1581,12 @@ void CUPTIAPI callback(void *userdata, CUpti_CallbackDomain domain,
       handleCudaMallocManaged(Allocations::instance(), Values::instance(),
                               cbInfo);
       break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemPrefetchAsync_v8000:
+      handleCudaMemPrefetchAsync(cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaMemAdvise_v8000:
+      handleCudaMemAdvise(cbInfo);
+      break;
     case CUPTI_RUNTIME_TRACE_CBID_cudaFree_v3020:
       handleCudaFree(Allocations::instance(), Values::instance(), cbInfo);
       break;
@@ -708,12 +1608,34 @@ void CUPTIAPI callback(void *userdata, CUpti_CallbackDomain domain,
     case CUPTI_RUNTIME_TRACE_CBID_cudaStreamCreate_v3020:
       handleCudaStreamCreate(cbInfo);
       break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaStreamCreateWithFlags_v5000:
+      handleCudaStreamCreateWithFlags(cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaStreamCreateWithPriority_v5050:
+      handleCudaStreamCreateWithPriority(cbInfo);
+      break;
     case CUPTI_RUNTIME_TRACE_CBID_cudaStreamDestroy_v3020:
       handleCudaStreamDestroy(cbInfo);
       break;
     case CUPTI_RUNTIME_TRACE_CBID_cudaStreamSynchronize_v3020:
       handleCudaStreamSynchronize(cbInfo);
       break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaStreamWaitEvent_v3020:
+      handleCudaStreamWaitEvent(cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaEventRecord_v3020:
+      handleCudaEventRecord(cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaEventSynchronize_v3020:
+      handleCudaEventSynchronize(cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaEventDestroy_v3020:
+      handleCudaEventDestroy(cbInfo);
+      break;
+    case CUPTI_RUNTIME_TRACE_CBID_cudaDeviceSynchronize_v3020:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaThreadSynchronize_v3020:
+      handleCudaDeviceSynchronize(cbInfo);
+      break;
     default:
       // printf("skipping runtime call %s...\n", cbInfo->functionName);
       break;
@@ -724,6 +1646,42 @@ void CUPTIAPI callback(void *userdata, CUpti_CallbackDomain domain,
     case CUPTI_DRIVER_TRACE_CBID_cuMemHostAlloc:
       handleCuMemHostAlloc(Allocations::instance(), Values::instance(), cbInfo);
       break;
+    case CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoD_v2: {
+      auto p = (const cuMemcpyDtoD_v2_params *)(cbInfo->functionParams);
+      handleCuMemcpyDtoD(Allocations::instance(), Values::instance(), cbInfo,
+                         p->dstDevice, p->srcDevice, p->ByteCount, 0);
+    } break;
+    case CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoDAsync_v2: {
+      auto p = (const cuMemcpyDtoDAsync_v2_params *)(cbInfo->functionParams);
+      handleCuMemcpyDtoD(Allocations::instance(), Values::instance(), cbInfo,
+                         p->dstDevice, p->srcDevice, p->ByteCount,
+                         (cudaStream_t)p->hStream);
+    } break;
+    case CUPTI_DRIVER_TRACE_CBID_cuMemcpyPeer: {
+      auto p = (const cuMemcpyPeer_params *)(cbInfo->functionParams);
+      handleCuMemcpyDtoD(Allocations::instance(), Values::instance(), cbInfo,
+                         p->dstDevice, p->srcDevice, p->ByteCount, 0);
+    } break;
+    case CUPTI_DRIVER_TRACE_CBID_cuMemcpyPeerAsync: {
+      auto p = (const cuMemcpyPeerAsync_params *)(cbInfo->functionParams);
+      handleCuMemcpyDtoD(Allocations::instance(), Values::instance(), cbInfo,
+                         p->dstDevice, p->srcDevice, p->ByteCount,
+                         (cudaStream_t)p->hStream);
+    } break;
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD8_v2:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD16_v2:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD32_v2:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD8Async:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD16Async:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD32Async:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D8_v2:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D16_v2:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D32_v2:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D8Async:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D16Async:
+    case CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D32Async:
+      handleMemset(Allocations::instance(), Values::instance(), cbid, cbInfo);
+      break;
     default:
       // printf("skipping driver call %s...\n", cbInfo->functionName);
       break;
@@ -738,6 +1696,7 @@ void CUPTIAPI callback(void *userdata, CUpti_CallbackDomain domain,
     if (cbInfo->callbackSite == CUPTI_API_EXIT) {
       // printf("tid=%d about to reduce api stack\n", get_thread_id());
       DriverState::this_thread().api_exit(domain, cbid, cbInfo);
+      --tracedCalls;
     }
   }
 }
@@ -0,0 +1,45 @@
+#include "callsite.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+static bool is_profiler_or_cuda(const char *fname) {
+  static Dl_info self;
+  static const int haveSelf =
+      dladdr(reinterpret_cast<void *>(&get_callsite), &self);
+
+  if (!fname) {
+    return false;
+  }
+  if (haveSelf && self.dli_fname && !std::strcmp(fname, self.dli_fname)) {
+    return true;
+  }
+  return std::strstr(fname, "libcuda") || std::strstr(fname, "libcupti") ||
+         std::strstr(fname, "libcublas") || std::strstr(fname, "libcudnn");
+}
+
+std::string get_callsite() {
+  void *buf[64];
+  const int sz = backtrace(buf, 64);
+
+  for (int i = 0; i < sz; ++i) {
+    Dl_info info;
+    if (!dladdr(buf[i], &info) || is_profiler_or_cuda(info.dli_fname)) {
+      continue;
+    }
+
+    char str[64];
+    if (info.dli_sname) {
+      snprintf(str, sizeof(str), "+0x%lx",
+               uintptr_t(buf[i]) - uintptr_t(info.dli_saddr));
+      return std::string(info.dli_sname) + str + " (" + info.dli_fname + ")";
+    }
+    snprintf(str, sizeof(str), "0x%lx",
+             uintptr_t(buf[i]) - uintptr_t(info.dli_fbase));
+    return std::string(str) + " (" + info.dli_fname + ")";
+  }
+  return "unknown";
+}
@@ -0,0 +1,10 @@
+#ifndef CALLSITE_HPP
+#define CALLSITE_HPP
+
+#include <string>
+
+// The first frame on the current stack that is not in the profiler or the
+// CUDA libraries, as "symbol+0xoffset (object)".
+std::string get_callsite();
+
+#endif
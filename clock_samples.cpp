@@ -0,0 +1,74 @@
+#include "clock_samples.hpp"
+
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <time.h>
+
+#include "env.hpp"
+#include "trace_output.hpp"
+#include "util_cupti.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+static uint64_t now_ns(const clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+ClockSamples::ClockSamples()
+    : period_(env::clock_sample_ms() * 1000000), nextSample_(0) {
+  sample("start");
+}
+
+ClockSamples::~ClockSamples() { sample("exit"); }
+
+ClockSamples &ClockSamples::instance() {
+  static ClockSamples s;
+  return s;
+}
+
+void ClockSamples::sample_if_due() {
+  if (!period_) {
+    return;
+  }
+  const uint64_t now = now_ns(CLOCK_MONOTONIC);
+  uint64_t next = nextSample_.load(std::memory_order_relaxed);
+  // one thread takes each periodic sample
+  if (now >= next && nextSample_.compare_exchange_strong(
+                         next, now + period_, std::memory_order_relaxed)) {
+    sample("periodic");
+  }
+}
+
+void ClockSamples::sample(const char *when) {
+  // the tightest of a few tries, in case one is preempted
+  uint64_t cupti = 0, monotonic = 0, realtime = 0, uncertainty = UINT64_MAX;
+  for (int i = 0; i < 3; ++i) {
+    uint64_t c;
+    const uint64_t before = now_ns(CLOCK_MONOTONIC);
+    CUPTI_CHECK(cuptiGetTimestamp(&c));
+    const uint64_t after = now_ns(CLOCK_MONOTONIC);
+    const uint64_t real = now_ns(CLOCK_REALTIME);
+    if (after - before < uncertainty) {
+      uncertainty = after - before;
+      cupti = c;
+      monotonic = before + uncertainty / 2;
+      // back to the midpoint, CLOCK_REALTIME was read after
+      realtime = real - (after - monotonic);
+    }
+  }
+
+  ptree pt;
+  pt.put("clock.when", when);
+  pt.put("clock.cupti", cupti);
+  pt.put("clock.monotonic", monotonic);
+  pt.put("clock.realtime", realtime);
+  pt.put("clock.uncertainty", uncertainty);
+  std::ostringstream buf;
+  write_json(buf, pt, false);
+  TraceOutput::instance().write(buf.str());
+}
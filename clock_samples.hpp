@@ -0,0 +1,33 @@
+#ifndef CLOCK_SAMPLES_HPP
+#define CLOCK_SAMPLES_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Samples of the CUPTI timestamp that trace times come from, against
+// CLOCK_MONOTONIC and CLOCK_REALTIME, so cprof_merge.py can put traces from
+// several processes and hosts on one timeline. The CUPTI timestamp is read
+// between two reads of CLOCK_MONOTONIC, and matched to their midpoint, which
+// is off by at most half the uncertainty.
+//
+// A sample is written at start, at most every CPROF_CLOCK_SAMPLE_MS
+// milliseconds while records are written, and at exit.
+class ClockSamples {
+private:
+  uint64_t period_;                 // ns, 0 for none
+  std::atomic<uint64_t> nextSample_; // monotonic ns
+
+public:
+  // write a sample if the period has passed since the last one
+  void sample_if_due();
+  // write a sample, when is "start", "periodic" or "exit"
+  void sample(const char *when);
+
+  static ClockSamples &instance();
+  ~ClockSamples();
+
+private:
+  ClockSamples();
+};
+
+#endif
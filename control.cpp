@@ -0,0 +1,167 @@
+#include "control.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <unistd.h>
+
+#include "env.hpp"
+#include "snapshot.hpp"
+#include "trace_output.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+// on until Control reads CPROF_TRACING
+std::atomic<bool> Control::tracing_(true);
+std::atomic<unsigned> Control::signalled_(0);
+
+static const unsigned toggled = 0x1;
+static const unsigned flushAndRotate = 0x2;
+
+static void record(const std::string &command) {
+  ptree pt;
+  pt.put("control.command", command);
+  std::ostringstream buf;
+  write_json(buf, pt, false);
+  TraceOutput::instance().write(buf.str());
+}
+
+void Control::handle_signal(const int sig) {
+  // only lock-free atomics here
+  if (sig == SIGUSR1) {
+    tracing_.store(!tracing_.load());
+    signalled_.fetch_or(toggled);
+  } else {
+    signalled_.fetch_or(flushAndRotate);
+  }
+}
+
+bool Control::command(const std::string &c) {
+  if (c != "start" && c != "stop" && c != "full" && c != "summary" &&
+      c != "flush" && c != "rotate") {
+    printf("WARN: unknown control command \"%s\"\n", c.c_str());
+    return false;
+  }
+  printf("control: %s\n", c.c_str());
+  record(c);
+
+  if (c == "start" || c == "stop") {
+    tracing_.store(c == "start");
+  } else if (c == "full" || c == "summary") {
+    TraceOutput::instance().set_summary(c == "summary");
+  } else if (c == "flush") {
+    std::vector<std::function<void()>> hooks;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      hooks = flushHooks_;
+    }
+    for (const auto &f : hooks) {
+      f();
+    }
+    Snapshots::instance().snapshot();
+  } else {
+    TraceOutput::instance().rotate();
+  }
+  return true;
+}
+
+void Control::add_flush_hook(const std::function<void()> &f) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  flushHooks_.push_back(f);
+}
+
+void Control::poll() {
+  const unsigned signalled = signalled_.exchange(0);
+  if (signalled & toggled) {
+    const std::string c = tracing() ? "start" : "stop";
+    printf("control: %s\n", c.c_str());
+    record(c);
+  }
+  if (signalled & flushAndRotate) {
+    command("flush");
+    command("rotate");
+  }
+
+  if (path_.empty()) {
+    return;
+  }
+  std::vector<std::string> commands;
+  {
+    std::ifstream f(path_);
+    if (!f) {
+      return;
+    }
+    std::string line;
+    while (std::getline(f, line)) {
+      const size_t first = line.find_first_not_of(" \t\r");
+      if (first == std::string::npos) {
+        continue;
+      }
+      const size_t last = line.find_last_not_of(" \t\r");
+      commands.push_back(line.substr(first, last - first + 1));
+    }
+  }
+  unlink(path_.c_str());
+  for (const auto &c : commands) {
+    command(c);
+  }
+}
+
+void Control::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopCv_.wait_for(lock, std::chrono::milliseconds(pollMs_),
+                           [this] { return stop_; })) {
+    lock.unlock();
+    poll();
+    lock.lock();
+  }
+}
+
+Control::Control()
+    : path_(env::control_path()), pollMs_(env::control_poll_ms()),
+      pid_(getpid()), stop_(false) {
+  tracing_.store(env::tracing() != 0);
+  if (!pollMs_) {
+    pollMs_ = 1;
+  }
+  const bool signals = env::control_signals() != 0;
+  if (signals) {
+    struct sigaction sa;
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, nullptr);
+    sigaction(SIGUSR2, &sa, nullptr);
+  }
+  if (signals || !path_.empty()) {
+    thread_ = std::thread(&Control::run, this);
+  }
+}
+
+Control &Control::instance() {
+  static Control c;
+  return c;
+}
+
+Control::~Control() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  if (getpid() != pid_) {
+    // the thread wasn't forked with the process
+    thread_.detach();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  stopCv_.notify_one();
+  thread_.join();
+}
@@ -0,0 +1,65 @@
+#ifndef CONTROL_HPP
+#define CONTROL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+// Turns tracing on and off while the application runs, so the profiler can
+// stay preloaded and be turned on when needed. While tracing is off, callbacks
+// return after one relaxed load, except for exits of calls that began while it
+// was on, and interposed library calls and host allocators call the real
+// function after one. Allocations made while it is off are unknown to the
+// profiler, so copies from them make implicit allocations.
+//
+// Commands are
+//   start    turn tracing on
+//   stop     turn tracing off
+//   full     write every record
+//   summary  write only totals, see trace_output.hpp
+//   flush    deliver buffered CUPTI records and write a snapshot
+//   rotate   continue the trace in new files
+// A background thread reads them, one per line, from the CPROF_CONTROL file
+// every CPROF_CONTROL_POLL_MS, then removes it. Write the file elsewhere and
+// rename it into place, so it is never read half-written. With
+// CPROF_CONTROL_SIGNALS set, SIGUSR1 toggles tracing, and SIGUSR2 flushes and
+// rotates. Each command is recorded in the trace.
+class Control {
+private:
+  static std::atomic<bool> tracing_;
+  static std::atomic<unsigned> signalled_; // commands from signal handlers
+
+  std::string path_; // empty for none
+  size_t pollMs_;
+  pid_t pid_; // that runs thread_
+  std::vector<std::function<void()>> flushHooks_;
+  std::mutex mutex_; // guards flushHooks_ and stop_
+  std::condition_variable stopCv_;
+  bool stop_;
+  std::thread thread_;
+
+public:
+  static bool tracing() { return tracing_.load(std::memory_order_relaxed); }
+
+  // run a command, false if there is no such command
+  bool command(const std::string &c);
+  // also run f on flush
+  void add_flush_hook(const std::function<void()> &f);
+
+  static Control &instance();
+  ~Control();
+
+private:
+  Control();
+  void run();
+  void poll();
+  static void handle_signal(int sig);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+
+""" Effective memcpy bandwidth by host page type, and the buffers to pin
+
+Uses the transfer totals the profiler writes at exit. Copies are grouped by
+direction, page type and NUMA node of the host memory, and device. Host
+buffers that were not pinned are ranked by the time their copies lost
+against the pinned bandwidth in the same direction to the same device.
+Without CPROF_SYNC_TIMING=1, async copies only time issuing the copy, so the
+profiler leaves them out of the timed bytes bandwidths are computed from.
+
+Without pinned copies in the trace, give the pinned GB/s to compare against.
+Small copies are latency-bound and always look slow.
+
+usage: cprof2bandwidth.py [output.cprof] [num-buffers] [pinned-GB/s]
+"""
+
+import sys
+
+import pycprof
+
+Transfers = []  # pycprof.Transfer
+Buffers = []    # pycprof.TransferBuffer
+Allocs = {}     # allocation id -> (pos, size)
+
+
+def handler(obj):
+    if type(obj) == pycprof.Transfer:
+        Transfers.append(obj)
+    elif type(obj) == pycprof.TransferBuffer:
+        Buffers.append(obj)
+    elif type(obj) == pycprof.Allocation:
+        Allocs[obj.id_] = (obj.pos, obj.size)
+
+
+def pinned_baselines():
+    """ (direction, device) -> pinned GB/s over all NUMA nodes """
+    totals = {}
+    for t in Transfers:
+        if t.page_type != "pinned":
+            continue
+        b = totals.setdefault((t.direction, t.device), [0, 0])
+        b[0] += t.timed_bytes
+        b[1] += t.ns
+    return dict((k, float(b) / ns) for k, (b, ns) in totals.iteritems() if ns)
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+    top = int(args[1]) if len(args) > 1 else 20
+    pinnedOverride = float(args[2]) if len(args) > 2 else None
+
+    pycprof.run_handler(handler, path)
+
+    if not Transfers:
+        print "no host<->device transfers"
+        return
+
+    print "== bandwidth by direction, page type, NUMA node, device =="
+    for t in sorted(Transfers, key=lambda t: (t.direction, t.device,
+                                              t.page_type, t.numa_node)):
+        print "%s  dev %d  %-8s  numa %2d  %8.2f GB/s  %6d calls  %14d B" % (
+            t.direction, t.device, t.page_type, t.numa_node, t.gbps,
+            t.count, t.bytes)
+
+    baselines = pinned_baselines()
+    ranked = []
+    for b in Buffers:
+        if b.page_type == "pinned":
+            continue
+        pinned = pinnedOverride or baselines.get((b.direction, b.device))
+        if not pinned or not b.ns:
+            continue
+        lost = b.ns - b.timed_bytes / pinned
+        if lost > 0:
+            ranked.append((lost, pinned, b))
+
+    print
+    print "== unpinned host buffers by copy time lost against pinned =="
+    if not ranked:
+        print "none" if baselines or pinnedOverride else \
+            "no pinned copies to compare against, give pinned GB/s"
+    for lost, pinned, b in sorted(ranked, key=lambda r: -r[0])[:top]:
+        pos, size = Allocs.get(b.allocation_id, (0, 0))
+        print "%12.3f ms lost  %8.2f of %8.2f GB/s%s  %s  %-8s  %6d calls  " \
+            "buffer %d (%d B)" % (lost / 1e6, b.gbps, pinned,
+                                  " (slow)" if b.slow else "", b.direction,
+                                  b.page_type, b.count, pos, size)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
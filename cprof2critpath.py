@@ -0,0 +1,265 @@
+#!/usr/bin/env python
+
+""" Critical-path and dataflow analysis over the value dependency graph
+
+Values are nodes, "dep" records are edges, and each value is weighted by the
+duration of the API that produced it. The graph is held in CSR form in flat
+arrays so it scales to ~10^8 edges.
+
+usage: cprof2critpath.py [output.cprof] [num-to-report]
+"""
+
+import sys
+from array import array
+
+import pycprof
+
+# node index and edge offset arrays are 32-bit
+INDEX_TYPE = 'I'
+NO_INDEX = 0xFFFFFFFF
+
+ValueIdx = {}     # value id -> dense node index
+ValueAlloc = array('L')   # node -> allocation id
+ValueSize = array('L')    # node -> size in bytes
+Producer = array(INDEX_TYPE)  # node -> producing api index
+
+AllocIsHost = {}  # allocation id -> True if in the host address space
+
+ApiName = []      # api index -> name (or kernel symbol)
+ApiStart = array('L')
+ApiEnd = array('L')
+ApiInputs = {}    # api index -> list of input node indices, memcpys only
+
+EdgeSrc = array(INDEX_TYPE)
+EdgeDst = array(INDEX_TYPE)
+
+
+def node(val_id):
+    return ValueIdx.get(val_id, NO_INDEX)
+
+
+def is_memcpy(name):
+    return "Memcpy" in name or "memcpy" in name
+
+
+def handler(obj):
+    if type(obj) == pycprof.Allocation:
+        AllocIsHost[obj.id_] = obj.address_space["type"] == "host"
+    elif type(obj) == pycprof.Value:
+        # values are re-emitted when their size is updated
+        if obj.id_ in ValueIdx:
+            ValueSize[ValueIdx[obj.id_]] = obj.size
+            return
+        ValueIdx[obj.id_] = len(ValueAlloc)
+        ValueAlloc.append(obj.allocation_id)
+        ValueSize.append(obj.size)
+        Producer.append(NO_INDEX)
+    elif type(obj) == pycprof.Dep:
+        src = node(obj.src_id)
+        dst = node(obj.dst_id)
+        if src == NO_INDEX or dst == NO_INDEX:
+            print "WARN: dep on unknown value", obj.src_id, "->", obj.dst_id
+            return
+        EdgeSrc.append(src)
+        EdgeDst.append(dst)
+    elif type(obj) == pycprof.API:
+        apiIdx = len(ApiName)
+        ApiName.append(obj.symbol if obj.symbol else obj.functionName)
+        ApiStart.append(obj.start)
+        ApiEnd.append(max(obj.start, obj.end))
+        for o in obj.outputs:
+            n = node(o)
+            if n != NO_INDEX:
+                Producer[n] = apiIdx
+        if is_memcpy(obj.functionName):
+            ApiInputs[apiIdx] = [node(i) for i in obj.inputs]
+
+
+def build_csr(numNodes, src, dst):
+    """ return (offsets, targets) so that the successors of n are
+    targets[offsets[n]:offsets[n+1]] """
+    offsets = array(INDEX_TYPE, [0]) * (numNodes + 1)
+    for s in src:
+        offsets[s + 1] += 1
+    for n in xrange(numNodes):
+        offsets[n + 1] += offsets[n]
+    cursor = array(INDEX_TYPE, offsets)
+    targets = array(INDEX_TYPE, [0]) * len(src)
+    for e in xrange(len(src)):
+        s = src[e]
+        targets[cursor[s]] = dst[e]
+        cursor[s] += 1
+    return offsets, targets
+
+
+def topo_order(numNodes, offsets, targets):
+    indegree = array(INDEX_TYPE, [0]) * numNodes
+    for t in targets:
+        indegree[t] += 1
+    order = array(INDEX_TYPE, [n for n in xrange(numNodes) if indegree[n] == 0])
+    head = 0
+    while head < len(order):
+        n = order[head]
+        head += 1
+        for e in xrange(offsets[n], offsets[n + 1]):
+            t = targets[e]
+            indegree[t] -= 1
+            if indegree[t] == 0:
+                order.append(t)
+    if len(order) != numNodes:
+        print "WARN:", numNodes - len(order), "values are on a cycle, ignoring them"
+    return order
+
+
+def find(parent, n):
+    root = n
+    while parent[root] != root:
+        root = parent[root]
+    while parent[n] != root:
+        parent[n], n = root, parent[n]
+    return root
+
+
+def components(numNodes):
+    """ label each node with the root of its weakly-connected component """
+    parent = array(INDEX_TYPE, xrange(numNodes))
+    for e in xrange(len(EdgeSrc)):
+        a = find(parent, EdgeSrc[e])
+        b = find(parent, EdgeDst[e])
+        if a != b:
+            parent[max(a, b)] = min(a, b)
+    for n in xrange(numNodes):
+        parent[n] = find(parent, n)
+    return parent
+
+
+def weight(n):
+    a = Producer[n]
+    if a == NO_INDEX:
+        return 0
+    return ApiEnd[a] - ApiStart[a]
+
+
+def is_h2d(apiIdx, n):
+    """ a memcpy whose output is on the device and some input is on the host """
+    if apiIdx not in ApiInputs:
+        return False
+    if AllocIsHost.get(ValueAlloc[n], True):
+        return False
+    for i in ApiInputs[apiIdx]:
+        if i != NO_INDEX and AllocIsHost.get(ValueAlloc[i], False):
+            return True
+    return False
+
+
+def fmt_ns(ns):
+    return "%.3f ms" % (ns / 1e6)
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+    top = int(args[1]) if len(args) > 1 else 20
+
+    pycprof.run_handler(handler, path)
+    numNodes = len(ValueAlloc)
+    print numNodes, "values,", len(EdgeSrc), "deps,", len(ApiName), "apis"
+    if numNodes == 0:
+        return
+
+    offsets, targets = build_csr(numNodes, EdgeSrc, EdgeDst)
+    order = topo_order(numNodes, offsets, targets)
+
+    # forward pass: longest weighted path ending at each node
+    finish = array('L', [0]) * numNodes
+    best = array('L', [0]) * numNodes
+    pred = array(INDEX_TYPE, [NO_INDEX]) * numNodes
+    for n in order:
+        finish[n] = best[n] + weight(n)
+        for e in xrange(offsets[n], offsets[n + 1]):
+            t = targets[e]
+            if finish[n] > best[t] or pred[t] == NO_INDEX:
+                best[t] = finish[n]
+                pred[t] = n
+    del best
+
+    # backward pass: longest weighted path starting at each node
+    tail = array('L', [0]) * numNodes
+    for i in xrange(len(order) - 1, -1, -1):
+        n = order[i]
+        longest = 0
+        for e in xrange(offsets[n], offsets[n + 1]):
+            longest = max(longest, tail[targets[e]])
+        tail[n] = longest + weight(n)
+
+    sink = max(order, key=lambda n: finish[n])
+    critical = finish[sink]
+    work = sum(ApiEnd[a] - ApiStart[a] for a in xrange(len(ApiName)))
+
+    path = []
+    n = sink
+    while n != NO_INDEX:
+        path.append(n)
+        n = pred[n]
+    path.reverse()
+
+    print
+    print "critical path:", fmt_ns(critical), "over", len(path), "values"
+    print "total api time:", fmt_ns(work)
+    if critical:
+        print "average parallelism: %.2f" % (float(work) / critical)
+
+    # critical path, ranked by the contribution of each api
+    onPath = {}
+    for n in path:
+        a = Producer[n]
+        if a != NO_INDEX:
+            onPath[a] = weight(n)
+    print
+    print "== top apis on the critical path =="
+    for a, w in sorted(onPath.iteritems(), key=lambda kv: -kv[1])[:top]:
+        print "%12s  %5.1f%%  %s" % (fmt_ns(w), 100.0 * w / max(critical, 1),
+                                     ApiName[a])
+
+    print
+    print "== host-to-device transfers on the critical path =="
+    h2d = [(weight(n), ValueSize[n], Producer[n]) for n in path
+           if Producer[n] != NO_INDEX and is_h2d(Producer[n], n)]
+    for w, size, a in sorted(h2d, reverse=True)[:top]:
+        print "%12s  %12d B  %s" % (fmt_ns(w), size, ApiName[a])
+    if not h2d:
+        print "none"
+
+    # slack of an api is how far it can slip without growing the critical path
+    apiSlack = {}
+    for n in order:
+        a = Producer[n]
+        if a == NO_INDEX:
+            continue
+        slack = critical - (finish[n] + tail[n] - weight(n))
+        if a not in apiSlack or slack < apiSlack[a]:
+            apiSlack[a] = slack
+    print
+    print "== apis with the most parallel slack =="
+    for a, s in sorted(apiSlack.iteritems(), key=lambda kv: -kv[1])[:top]:
+        print "%12s  %s" % (fmt_ns(s), ApiName[a])
+
+    # independent chains are the weakly-connected components of the graph
+    label = components(numNodes)
+    chainLength = {}
+    chainSize = {}
+    for n in xrange(numNodes):
+        c = label[n]
+        chainLength[c] = max(chainLength.get(c, 0), finish[n])
+        chainSize[c] = chainSize.get(c, 0) + 1
+    print
+    print "== independent chains ==", len(chainLength), "found"
+    ranked = sorted(chainLength.iteritems(), key=lambda kv: -kv[1])
+    for c, length in ranked[:top]:
+        print "%12s  slack %12s  %8d values" % (fmt_ns(length),
+                                                fmt_ns(critical - length),
+                                                chainSize[c])
+    print "total chain slack:", fmt_ns(sum(critical - l for c, l in ranked))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
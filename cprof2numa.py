@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+
+""" Host<->device copies whose host memory is on a remote NUMA node
+
+Uses the device records (the NUMA node each device is attached to, from
+sysfs) and the transfer totals the profiler writes at exit. A copy is remote
+when its host memory is on another node than the device's. The penalty of a
+remote buffer is the time its copies took beyond what they would have at the
+local bandwidth for the same direction, device and page type.
+
+usage: cprof2numa.py [output.cprof] [num-buffers]
+"""
+
+import sys
+
+import pycprof
+
+Devices = {}    # device id -> numa node
+Transfers = []  # pycprof.Transfer
+Buffers = []    # pycprof.TransferBuffer
+Allocs = {}     # allocation id -> (pos, size)
+
+
+def handler(obj):
+    if type(obj) == pycprof.Device:
+        Devices[obj.id_] = obj.numa_node
+    elif type(obj) == pycprof.Transfer:
+        Transfers.append(obj)
+    elif type(obj) == pycprof.TransferBuffer:
+        Buffers.append(obj)
+    elif type(obj) == pycprof.Allocation:
+        Allocs[obj.id_] = (obj.pos, obj.size)
+
+
+def placement(t):
+    """ "local", "remote" or "unknown" """
+    if t.numa_node < 0 or t.device_numa_node < 0:
+        return "unknown"
+    return "local" if t.numa_node == t.device_numa_node else "remote"
+
+
+def gbps(nbytes, ns):
+    return float(nbytes) / ns if ns else 0.0
+
+
+def local_bandwidths():
+    """ (direction, device, page type or None) -> local GB/s """
+    totals = {}
+    for t in Transfers:
+        if placement(t) != "local":
+            continue
+        for k in ((t.direction, t.device, t.page_type),
+                  (t.direction, t.device, None)):
+            b = totals.setdefault(k, [0, 0])
+            b[0] += t.bytes
+            b[1] += t.ns
+    return dict((k, gbps(b, ns)) for k, (b, ns) in totals.iteritems() if ns)
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+    top = int(args[1]) if len(args) > 1 else 20
+
+    pycprof.run_handler(handler, path)
+
+    print "== devices =="
+    for d, node in sorted(Devices.iteritems()):
+        print "device %d: numa node %s" % (d, node if node >= 0 else "unknown")
+
+    if not Transfers:
+        print "no host<->device transfers"
+        return
+
+    print
+    print "== bytes and bandwidth by placement of host memory =="
+    byPlacement = {}
+    for t in Transfers:
+        b = byPlacement.setdefault((t.direction, t.device, placement(t)),
+                                   [0, 0, 0])
+        b[0] += t.count
+        b[1] += t.bytes
+        b[2] += t.ns
+    for (direction, device, where), (calls, nbytes, ns) in \
+            sorted(byPlacement.iteritems()):
+        print "%s  dev %d  %-7s  %6d calls  %14d B  %8.2f GB/s" % (
+            direction, device, where, calls, nbytes, gbps(nbytes, ns))
+
+    local = local_bandwidths()
+    remote = []
+    for b in Buffers:
+        if placement(b) != "remote":
+            continue
+        bw = local.get((b.direction, b.device, b.page_type),
+                       local.get((b.direction, b.device, None)))
+        penalty = max(b.ns - b.bytes / bw, 0) if bw else None
+        remote.append((penalty, bw, b))
+
+    print
+    print "== host buffers on a remote node, by estimated penalty =="
+    if not remote:
+        print "none"
+    for penalty, bw, b in sorted(remote, key=lambda r: (-(r[0] or 0),
+                                                        -r[2].bytes))[:top]:
+        pos, size = Allocs.get(b.allocation_id, (0, 0))
+        cost = "%10.3f ms" % (penalty / 1e6) if penalty is not None \
+            else "%13s" % "n/a"
+        print "%s  %14d B  %8.2f GB/s (local %s)  %s dev %d on node %d, " \
+            "host node %d  %-8s  buffer %d (%d B)" % (
+                cost, b.bytes, b.gbps, "%.2f" % bw if bw else "n/a",
+                b.direction, b.device, b.device_numa_node, b.numa_node,
+                b.page_type, pos, size)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,198 @@
+#!/usr/bin/env python
+
+""" Copy/compute overlap per device, and the memcpys that prevent it
+
+Rebuilds a schedule of the device work from the trace: each stream-ordered
+call (kernel launch, library call, memcpy) starts once the calls it happens
+after have finished and its engine is free, then runs for its recorded
+duration. Host time between calls is ignored. A device has one compute engine
+and one copy engine per direction. Record with CPROF_SYNC_TIMING=1, otherwise
+durations of asynchronous calls only cover issuing them.
+
+For each device, reports how much of the copy engines' busy time overlapped
+kernel execution. Then lists the memcpy call sites that block overlap: those
+issued synchronously, and those from pageable or unknown host memory, which
+the driver copies through a staging buffer before the call returns. These are
+the transfers to convert to async copies from pinned memory. Call sites are
+only recorded with CPROF_CALLSITES=1.
+
+usage: cprof2overlap.py [output.cprof] [num-call-sites]
+"""
+
+import sys
+
+import pycprof
+
+AllocInfo = {}  # allocation id -> (is host, page type)
+ValueInfo = {}  # value id -> (allocation id, size)
+
+Finish = {}      # api id -> scheduled end
+EngineFree = {}  # (device, engine) -> when it is next free
+Busy = {}        # (device, engine) -> [(start, end), ...]
+
+Blockers = {}  # (call site, reasons) -> [calls, bytes, ns]
+
+
+def is_memcpy(name):
+    return "Memcpy" in name or "memcpy" in name
+
+
+def host_page_type(val_id):
+    """ the page type if val_id is in host memory, else None """
+    if val_id not in ValueInfo:
+        return None
+    allocId, size = ValueInfo[val_id]
+    isHost, pageType = AllocInfo.get(allocId, (False, None))
+    return pageType if isHost else None
+
+
+def copy_engine(api):
+    """ the copy engine a memcpy runs on, and its host page type if any """
+    src = api.inputs[0] if api.inputs else None
+    dst = api.outputs[0] if api.outputs else None
+    srcHost = host_page_type(src)
+    dstHost = host_page_type(dst)
+    if srcHost is not None and dstHost is None:
+        return "h2d", srcHost
+    if dstHost is not None and srcHost is None:
+        return "d2h", dstHost
+    if srcHost is None and dstHost is None:
+        return "d2d", None
+    return "h2h", srcHost
+
+
+def copy_bytes(api):
+    return sum(ValueInfo[o][1] for o in api.outputs if o in ValueInfo)
+
+
+def schedule(api):
+    """ schedule a stream-ordered call, or a synchronization, after what it
+    happens after """
+    start = 0
+    for p in api.happens_after:
+        start = max(start, Finish.get(p, 0))
+
+    duration = max(api.end - api.start, 0)
+    engine = None
+    pageType = None
+    if api.stream is None or "Event" in api.functionName:
+        duration = 0  # synchronizations and events take no engine time
+    elif is_memcpy(api.functionName):
+        engine, pageType = copy_engine(api)
+        if engine == "h2h":
+            engine = None
+    else:
+        engine = "compute"
+
+    if engine:
+        key = (api.device, engine)
+        start = max(start, EngineFree.get(key, 0))
+        EngineFree[key] = start + duration
+        if duration:
+            Busy.setdefault(key, []).append((start, start + duration))
+    Finish[api.id_] = start + duration
+
+    if is_memcpy(api.functionName):
+        reasons = []
+        if "Async" not in api.functionName:
+            reasons.append("sync")
+        if pageType in ("pageable", "unknown"):
+            reasons.append(pageType)
+        if reasons:
+            b = Blockers.setdefault((api.callsite, ", ".join(reasons)),
+                                    [0, 0, 0])
+            b[0] += 1
+            b[1] += copy_bytes(api)
+            b[2] += duration
+
+
+def handler(obj):
+    if type(obj) == pycprof.Allocation:
+        AllocInfo[obj.id_] = (obj.address_space["type"] == "host", obj.type)
+    elif type(obj) == pycprof.Value:
+        ValueInfo[obj.id_] = (obj.allocation_id, obj.size)
+    elif type(obj) == pycprof.API:
+        if obj.stream is not None or obj.happens_after:
+            schedule(obj)
+
+
+def union(intervals):
+    """ sorted, disjoint intervals covering intervals """
+    merged = []
+    for s, e in sorted(intervals):
+        if merged and s <= merged[-1][1]:
+            merged[-1] = (merged[-1][0], max(merged[-1][1], e))
+        else:
+            merged.append((s, e))
+    return merged
+
+
+def length(intervals):
+    return sum(e - s for s, e in intervals)
+
+
+def intersection(a, b):
+    """ total length of the overlap of two unions """
+    i = j = 0
+    total = 0
+    while i < len(a) and j < len(b):
+        s = max(a[i][0], b[j][0])
+        e = min(a[i][1], b[j][1])
+        if s < e:
+            total += e - s
+        if a[i][1] < b[j][1]:
+            i += 1
+        else:
+            j += 1
+    return total
+
+
+def pct(part, whole):
+    return 100.0 * part / whole if whole else 0.0
+
+
+def fmt_ns(ns):
+    return "%.3f ms" % (ns / 1e6)
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+    top = int(args[1]) if len(args) > 1 else 20
+
+    pycprof.run_handler(handler, path)
+
+    devices = sorted(set(d for d, e in Busy))
+    if not devices:
+        print "no stream-ordered calls with durations"
+        return
+
+    print "== copy/compute overlap by device =="
+    for d in devices:
+        compute = union(Busy.get((d, "compute"), []))
+        copies = union(sum((Busy.get((d, e), [])
+                            for e in ("h2d", "d2h", "d2d")), []))
+        overlapped = intersection(copies, compute)
+        print "device %s: kernels busy %s, copies busy %s, %s (%.1f%%) of " \
+            "copy time overlapped kernels" % (
+                d, fmt_ns(length(compute)), fmt_ns(length(copies)),
+                fmt_ns(overlapped), pct(overlapped, length(copies)))
+        for e in ("h2d", "d2h", "d2d"):
+            busy = union(Busy.get((d, e), []))
+            if busy:
+                o = intersection(busy, compute)
+                print "  %s: busy %s, %.1f%% overlapped" % (
+                    e, fmt_ns(length(busy)), pct(o, length(busy)))
+
+    print
+    print "== memcpy call sites that block overlap, most copy time first =="
+    if not Blockers:
+        print "none"
+    for (site, reasons), b in sorted(Blockers.iteritems(),
+                                     key=lambda kv: -kv[1][2])[:top]:
+        calls, nbytes, ns = b
+        print "%14s  %6d calls  %14d B  [%s]  %s" % (
+            fmt_ns(ns), calls, nbytes, reasons, site)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
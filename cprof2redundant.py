@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+
+""" Find identical data copied to the device more than once
+
+Needs a trace recorded with CPROF_HASH_MEMCPY=full (or sampled, which may
+report false positives), so memcpy destination values carry the digest of
+the source contents.
+
+usage: cprof2redundant.py [output.cprof] [num-to-report]
+"""
+
+import sys
+
+import pycprof
+
+Digests = {}    # value id -> (digest, size)
+Transfers = {}  # (digest, size) -> [call site, ...] in trace order
+
+
+def handler(obj):
+    if type(obj) == pycprof.Value:
+        if obj.digest is not None:
+            Digests[obj.id_] = (obj.digest, obj.size)
+    elif type(obj) == pycprof.API:
+        if "emcpy" not in obj.functionName:
+            return
+        for o in obj.outputs:
+            if o in Digests:
+                key = Digests[o]
+                if key not in Transfers:
+                    Transfers[key] = []
+                Transfers[key] += [obj.callsite]
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+    top = int(args[1]) if len(args) > 1 else 20
+
+    pycprof.run_handler(handler, path)
+
+    # every copy of some contents after the first is wasted
+    wastedBytes = {}
+    wastedCalls = {}
+    repeated = []
+    for (digest, size), sites in Transfers.iteritems():
+        if len(sites) < 2:
+            continue
+        repeated += [((len(sites) - 1) * size, len(sites), size, digest)]
+        for site in sites[1:]:
+            wastedBytes[site] = wastedBytes.get(site, 0) + size
+            wastedCalls[site] = wastedCalls.get(site, 0) + 1
+
+    total = sum(w for w, n, s, d in repeated)
+    print len(Transfers), "distinct contents hashed,", len(repeated), "copied more than once"
+    print "bytes wasted:", total
+
+    print
+    print "== call sites by bytes wasted =="
+    for site, wasted in sorted(wastedBytes.iteritems(), key=lambda kv: -kv[1])[:top]:
+        print "%14d B  %6d calls  %s" % (wasted, wastedCalls[site], site)
+
+    print
+    print "== most repeated contents =="
+    for wasted, count, size, digest in sorted(repeated, reverse=True)[:top]:
+        print "%14d B  %6d x %12d B  digest %s" % (wasted, count, size, digest)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+
+""" Achieved FLOP/s and arithmetic intensity of library calls
+
+Uses the op records (FLOPs, bytes read and written) of GEMM and convolution
+calls. Record with CPROF_SYNC_TIMING=1, otherwise call times only cover the
+launch and the FLOP/s are meaningless.
+
+With a device's peak GFLOP/s and GB/s, each row also shows the roofline
+bound at its intensity and the fraction of it achieved.
+
+usage: cprof2roofline.py [output.cprof] [peak-GFLOP/s peak-GB/s] [num-calls]
+"""
+
+import sys
+
+import pycprof
+
+Calls = []    # (name, op, duration ns)
+Symbols = {}  # (name, kind, dtype) -> [calls, flops, bytes, ns]
+
+
+def handler(obj):
+    if type(obj) != pycprof.API or obj.op is None:
+        return
+    op = obj.op
+    # kernels are named by their symbol, library calls by their function
+    name = obj.symbol if obj.symbol else obj.functionName
+    ns = obj.end - obj.start
+    Calls.append((name, op, ns))
+
+    key = (name, op.kind, op.dtype)
+    s = Symbols.setdefault(key, [0, 0, 0, 0])
+    s[0] += 1
+    s[1] += op.flops
+    s[2] += op.bytes_read + op.bytes_written
+    s[3] += ns
+
+
+def intensity(flops, nbytes):
+    return float(flops) / nbytes if nbytes else float("inf")
+
+
+def gflops(flops, ns):
+    return float(flops) / ns if ns else 0.0
+
+
+def roofline(ai, peakFlops, peakBw):
+    """ attainable GFLOP/s at intensity ai, and what bounds it """
+    if ai * peakBw < peakFlops:
+        return ai * peakBw, "memory"
+    return peakFlops, "compute"
+
+
+def row(achieved, ai, peak):
+    line = "%10.1f GFLOP/s  %8.2f FLOP/B" % (achieved, ai)
+    if peak:
+        bound, kind = roofline(ai, peak[0], peak[1])
+        line += "  %5.1f%% of %s bound" % (100 * achieved / bound, kind)
+    return line
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+    peak = None
+    if len(args) > 2:
+        peak = (float(args[1]), float(args[2]))
+    top = int(args[3]) if len(args) > 3 else 20
+
+    pycprof.run_handler(handler, path)
+
+    if not Calls:
+        print "no calls with op records"
+        return
+
+    print "== by symbol, most time first =="
+    for key, s in sorted(Symbols.iteritems(), key=lambda kv: -kv[1][3]):
+        name, kind, dtype = key
+        calls, flops, nbytes, ns = s
+        print "%12d ns  %6d calls  %s  %s %s %s" % (
+            ns, calls, row(gflops(flops, ns), intensity(flops, nbytes), peak),
+            kind, dtype, name)
+
+    print
+    print "== slowest calls =="
+    for name, op, ns in sorted(Calls, key=lambda c: -c[2])[:top]:
+        nbytes = op.bytes_read + op.bytes_written
+        print "%12d ns  %s  %s %s %s %s" % (
+            ns, row(gflops(op.flops, ns), intensity(op.flops, nbytes), peak),
+            op.kind, op.dtype, "x".join(str(d) for d in op.shape), name)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
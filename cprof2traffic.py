@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+
+""" Device-to-device memcpy traffic matrix
+
+Uses the peer transfer totals the profiler writes at exit: bytes copied from
+each device's memory (rows) to each device's memory (columns), including
+copies within one device on the diagonal. Then lists the device pairs by
+bytes, with their effective bandwidth. Record with CPROF_SYNC_TIMING=1,
+otherwise async copies only time issuing the copy.
+
+usage: cprof2traffic.py [output.cprof]
+"""
+
+import sys
+
+import pycprof
+
+Peers = {}  # (src device, dst device) -> pycprof.PeerTransfer
+
+
+def handler(obj):
+    if type(obj) == pycprof.PeerTransfer:
+        # one record per process, sum them in merged traces
+        k = (obj.src_device, obj.dst_device)
+        if k in Peers:
+            p = Peers[k]
+            p.count += obj.count
+            p.bytes += obj.bytes
+            p.ns += obj.ns
+            p.gbps = float(p.bytes) / p.ns if p.ns else 0.0
+        else:
+            Peers[k] = obj
+
+
+def fmt_bytes(n):
+    for unit in ("B", "KiB", "MiB", "GiB"):
+        if n < 1024:
+            return "%.1f %s" % (n, unit)
+        n /= 1024.0
+    return "%.1f TiB" % n
+
+
+def main(args):
+    path = args[0] if len(args) > 0 else None
+
+    pycprof.run_handler(handler, path)
+
+    if not Peers:
+        print "no device-to-device transfers"
+        return
+
+    devices = sorted(set(d for k in Peers for d in k))
+    print "== bytes copied, from device (row) to device (column) =="
+    print "%8s" % "" + "".join("%14s" % ("dev %d" % d) for d in devices)
+    for s in devices:
+        row = "%8s" % ("dev %d" % s)
+        for d in devices:
+            p = Peers.get((s, d))
+            row += "%14s" % (fmt_bytes(p.bytes) if p else "-")
+        print row
+
+    print
+    print "== device pairs by bytes =="
+    for (s, d), p in sorted(Peers.iteritems(), key=lambda kv: -kv[1].bytes):
+        print "dev %d -> dev %d  %6d calls  %14d B  %8.2f GB/s" % (
+            s, d, p.count, p.bytes, p.gbps)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
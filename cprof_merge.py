@@ -0,0 +1,226 @@
+#!/usr/bin/env python
+
+""" Merge the shards of a sharded trace into one time-aligned trace
+
+Reads the shards listed in a manifest (see CPROF_OUT), or the shard files
+given, and writes one trace ordered by start time, streaming through the
+shards. Records without a start time (values, allocations, ...) stay after
+the record before them in their shard. The merged trace starts with the
+manifest's shard records.
+
+Start and end times come from each process's CUPTI clock. They are aligned
+using the clock samples in the shards (see clock_samples.hpp): a least
+squares fit of CLOCK_MONOTONIC against the CUPTI clock gives each process's
+offset and drift, and the median of CLOCK_REALTIME - CLOCK_MONOTONIC over
+the samples of each host puts the hosts on one timeline. Aligned times are
+CLOCK_REALTIME nanoseconds, so hosts are only as aligned as NTP or PTP keeps
+them. The fit of each process is added to its shard records. With --raw,
+times are left as recorded.
+
+Ids (of records, values, allocations and streams) are addresses in the
+process that wrote them, so they are offset by (process index + 1) << 48 to
+stay unique across processes. Shards of threads of one process share ids;
+shard files given without a manifest are taken to be one process each.
+
+A shard the manifest lists that is not at its path is looked for next to the
+manifest, so the directory of shards can be moved.
+
+usage: cprof_merge.py [--raw] cprof.manifest|shard... > merged.cprof
+"""
+
+import heapq
+import json
+import os
+import sys
+from collections import OrderedDict
+
+# fields that hold ids, by record type
+ID_FIELDS = {
+    "api": ("id", "stream"),
+    "val": ("id", "allocation_id"),
+    "allocation": ("id",),
+    "dep": ("src_id", "dst_id"),
+    "meta": ("val_id",),
+    "transfer_buffer": ("allocation_id",),
+    "unified_memory": ("allocation_id",),
+    "restored": ("id",),
+}
+ID_LIST_FIELDS = {
+    "api": ("inputs", "outputs", "happens_after"),
+}
+
+
+def load(line):
+    return json.loads(line, object_pairs_hook=OrderedDict)
+
+
+def read_manifest(path):
+    """ shard records, one per shard path """
+    shards = OrderedDict()
+    base = os.path.dirname(path)
+    with open(path) as f:
+        for line in f:
+            shard = load(line)["shard"]
+            if not os.path.exists(shard["path"]):
+                moved = os.path.join(base, os.path.basename(shard["path"]))
+                if os.path.exists(moved):
+                    shard["path"] = moved
+            # a forked child without %p reopens its parent's shard
+            shards.setdefault(shard["path"], shard)
+    return shards.values()
+
+
+def remap(record, offset):
+    """ offset the ids in record, 0 (no id) stays 0 """
+    def shift(v):
+        return str(int(v) + offset) if int(v) else v
+
+    for kind, fields in ID_FIELDS.iteritems():
+        if kind not in record:
+            continue
+        r = record[kind]
+        for f in fields:
+            if f in r:
+                r[f] = shift(r[f])
+        for f in ID_LIST_FIELDS.get(kind, ()):
+            # an empty list is written as ""
+            if isinstance(r.get(f), list):
+                r[f] = [shift(v) for v in r[f]]
+    return record
+
+
+def median(xs):
+    xs = sorted(xs)
+    return xs[len(xs) // 2]
+
+
+def read_clock_samples(shards):
+    """ process -> [clock sample], from all of its shards """
+    samples = {}
+    for s in shards:
+        with open(s["path"]) as f:
+            for line in f:
+                if line.startswith('{"clock"'):
+                    c = load(line)["clock"]
+                    samples.setdefault(s["process"], []).append(
+                        dict((k, int(v)) for k, v in c.iteritems()
+                             if k != "when"))
+    return samples
+
+
+def fit(samples):
+    """ (cupti, monotonic, intercept, rate) with monotonic = the second +
+    intercept + rate * (t - the first) at CUPTI time t, from the samples with
+    the lowest uncertainty. Times stay integers, their doubles are too coarse.
+    """
+    bound = max(4 * median(s["uncertainty"] for s in samples), 1000)
+    samples = [s for s in samples if s["uncertainty"] <= bound]
+    c0 = samples[0]["cupti"]
+    m0 = samples[0]["monotonic"]
+    xs = [s["cupti"] - c0 for s in samples]
+    ys = [s["monotonic"] - m0 for s in samples]
+    xbar = float(sum(xs)) / len(xs)
+    ybar = float(sum(ys)) / len(ys)
+    sxx = sum((x - xbar) ** 2 for x in xs)
+    sxy = sum((x - xbar) * (y - ybar) for x, y in zip(xs, ys))
+    rate = sxy / sxx if sxx else 1.0
+    return c0, m0, ybar - rate * xbar, rate
+
+
+class Clock(object):
+    """ aligns a process's CUPTI times """
+
+    def __init__(self, samples, hostOffset):
+        self.cupti, self.monotonic, self.intercept, self.rate = fit(samples)
+        self.hostOffset = hostOffset
+        self.residual = max(abs(self.to_monotonic(s["cupti"]) -
+                                s["monotonic"]) for s in samples)
+        self.samples = len(samples)
+
+    def to_monotonic(self, t):
+        return self.monotonic + int(round(self.intercept +
+                                          self.rate * (t - self.cupti)))
+
+    def align(self, t):
+        return self.to_monotonic(t) + self.hostOffset
+
+    def json(self):
+        return OrderedDict([("samples", self.samples),
+                            ("drift_ppm", (self.rate - 1) * 1e6),
+                            ("offset_ns", self.align(0)),
+                            ("residual_ns", int(self.residual))])
+
+
+def clocks(shards):
+    """ process -> Clock """
+    samples = read_clock_samples(shards)
+    hosts = {}
+    for s in shards:
+        hosts.setdefault(s.get("host"), set()).add(s["process"])
+    result = {}
+    for host, processes in hosts.iteritems():
+        hostSamples = sum((samples.get(p, []) for p in processes), [])
+        if not hostSamples:
+            continue
+        offset = median(s["realtime"] - s["monotonic"] for s in hostSamples)
+        for p in processes:
+            if p in samples:
+                result[p] = Clock(samples[p], offset)
+    return result
+
+
+def shard_records(index, path, process, clock):
+    """ (start time, shard index, line number, record) for each record """
+    offset = (process + 1) << 48
+    start = 0
+    with open(path) as f:
+        for i, line in enumerate(f):
+            record = remap(load(line), offset)
+            if "api" in record:
+                api = record["api"]
+                if clock:
+                    for k in ("start", "end"):
+                        if int(api[k]):
+                            api[k] = str(clock.align(int(api[k])))
+                start = max(start, int(api["start"]))
+            yield start, index, i, record
+
+
+def main(args):
+    raw = args[:1] == ["--raw"]
+    if raw:
+        args = args[1:]
+    if not args:
+        sys.exit(__doc__.strip().splitlines()[-1])
+
+    if len(args) == 1 and args[0].endswith(".manifest"):
+        shards = read_manifest(args[0])
+    else:
+        shards = [OrderedDict([("path", p)]) for p in args]
+
+    processes = {}
+    for s in shards:
+        key = (s.get("host"), s.get("pid", s["path"]))
+        s["process"] = processes.setdefault(key, len(processes))
+
+    processClocks = {} if raw else clocks(shards)
+    for s in shards:
+        if s["process"] in processClocks:
+            s["clock"] = processClocks[s["process"]].json()
+        elif not raw:
+            sys.stderr.write("no clock samples for %s, its times are not "
+                             "aligned\n" % s["path"])
+
+    out = sys.stdout
+    for s in shards:
+        out.write(json.dumps({"shard": s}, separators=(",", ":")) + "\n")
+
+    merged = heapq.merge(*[shard_records(i, s["path"], s["process"],
+                                         processClocks.get(s["process"]))
+                           for i, s in enumerate(shards)])
+    for _, _, _, record in merged:
+        out.write(json.dumps(record, separators=(",", ":")) + "\n")
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
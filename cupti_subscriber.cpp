@@ -1,21 +1,122 @@
+#include <cstdlib>
+
 #include "callbacks.hpp"
+#include "clock_samples.hpp"
+#include "control.hpp"
+#include "env.hpp"
+#include "snapshot.hpp"
+#include "unified_memory.hpp"
 #include "util_cupti.hpp"
 
+// Unified memory counter records are delivered in activity buffers
+static const size_t activityBufferBytes = 1 << 20;
+
+static void CUPTIAPI buffer_requested(uint8_t **buffer, size_t *size,
+                                      size_t *maxNumRecords) {
+  // records must be 8-byte aligned
+  *buffer = static_cast<uint8_t *>(aligned_alloc(8, activityBufferBytes));
+  *size = *buffer ? activityBufferBytes : 0;
+  *maxNumRecords = 0;
+}
+
+static void CUPTIAPI buffer_completed(CUcontext ctx, uint32_t streamId,
+                                      uint8_t *buffer, size_t size,
+                                      size_t validSize) {
+  (void)size;
+  CUpti_Activity *record = nullptr;
+  while (cuptiActivityGetNextRecord(buffer, validSize, &record) ==
+         CUPTI_SUCCESS) {
+    if (record->kind == CUPTI_ACTIVITY_KIND_UNIFIED_MEMORY_COUNTER) {
+      const auto e = UnifiedMemoryStats::to_event(
+          *reinterpret_cast<CUpti_ActivityUnifiedMemoryCounter2 *>(record));
+      if (e) {
+        UnifiedMemoryStats::instance().record(e.value());
+      }
+    }
+  }
+  size_t dropped = 0;
+  CUPTI_CHECK(cuptiActivityGetNumDroppedRecords(ctx, streamId, &dropped));
+  if (dropped) {
+    printf("WARN: dropped %lu unified memory records\n", dropped);
+  }
+  free(buffer);
+}
+
+// Enable the unified memory counters. Page fault, thrashing and device to
+// device counters need newer devices and drivers, so fall back to the
+// transfers between host and device. False if not even those are supported.
+static bool enable_unified_memory_counters() {
+  static const CUpti_ActivityUnifiedMemoryCounterKind kinds[] = {
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_CPU_PAGE_FAULT_COUNT,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THRASHING,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THROTTLING,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_REMOTE_MAP,
+      CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD};
+  static const uint32_t numKinds = sizeof(kinds) / sizeof(kinds[0]);
+  static const uint32_t numBasicKinds = 3;
+
+  CUpti_ActivityUnifiedMemoryCounterConfig config[numKinds];
+  for (uint32_t i = 0; i < numKinds; ++i) {
+    config[i].scope =
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_SCOPE_PROCESS_SINGLE_DEVICE;
+    config[i].kind = kinds[i];
+    config[i].deviceId = 0;
+    config[i].enable = 1;
+  }
+
+  CUptiResult res =
+      cuptiActivityConfigureUnifiedMemoryCounter(config, numKinds);
+  if (res != CUPTI_SUCCESS) {
+    res = cuptiActivityConfigureUnifiedMemoryCounter(config, numBasicKinds);
+  }
+  if (res != CUPTI_SUCCESS) {
+    const char *errstr;
+    cuptiGetResultString(res, &errstr);
+    printf("WARN: no unified memory counters: %s\n", errstr);
+    return false;
+  }
+  CUPTI_CHECK(cuptiActivityRegisterCallbacks(buffer_requested,
+                                             buffer_completed));
+  CUPTI_CHECK(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_UNIFIED_MEMORY_COUNTER));
+  return true;
+}
+
 class CuptiSubscriber {
 private:
   CUpti_SubscriberHandle subscriber_;
+  bool umCounters_;
 
 public:
-  CuptiSubscriber(CUpti_CallbackFunc callback) {
+  CuptiSubscriber(CUpti_CallbackFunc callback) : umCounters_(false) {
     printf("Activating callbacks!\n");
     CUPTI_CHECK(
         cuptiSubscribe(&subscriber_, (CUpti_CallbackFunc)callback, nullptr));
     CUPTI_CHECK(cuptiEnableDomain(1, subscriber_, CUPTI_CB_DOMAIN_RUNTIME_API));
     CUPTI_CHECK(cuptiEnableDomain(1, subscriber_, CUPTI_CB_DOMAIN_DRIVER_API));
+    // the start sample, and the exit sample after unsubscribing
+    ClockSamples::instance();
+    // restores the last snapshot, before any new allocations
+    Snapshots::instance();
+    if (env::um_counters()) {
+      // written at exit, after the last buffer is flushed
+      UnifiedMemoryStats::instance();
+      umCounters_ = enable_unified_memory_counters();
+    }
+    // last, so its thread stops before the state it flushes is destroyed
+    Control &control = Control::instance();
+    if (umCounters_) {
+      control.add_flush_hook([] { CUPTI_CHECK(cuptiActivityFlushAll(0)); });
+    }
   }
 
   ~CuptiSubscriber() {
     printf("Deactivating callbacks!\n");
+    if (umCounters_) {
+      CUPTI_CHECK(cuptiActivityFlushAll(0));
+    }
     CUPTI_CHECK(cuptiUnsubscribe(subscriber_));
   }
 };
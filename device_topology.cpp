@@ -0,0 +1,52 @@
+#include "device_topology.hpp"
+
+#include <cstdio>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cuda_runtime.h>
+
+#include "driver_state.hpp"
+#include "env.hpp"
+#include "numa.hpp"
+#include "trace_output.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+const DeviceTopology::Device &DeviceTopology::device(const int id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const auto &found = devices_.find(id);
+  if (found != devices_.end()) {
+    return found->second;
+  }
+
+  Device d;
+  char busId[64];
+  DriverState::this_thread().pause_cupti_callbacks();
+  const cudaError_t err = cudaDeviceGetPCIBusId(busId, sizeof(busId), id);
+  DriverState::this_thread().resume_cupti_callbacks();
+  if (err == cudaSuccess) {
+    d.pciBusId = busId;
+    d.numaNode = pci_numa_node(env::sysfs_root(), d.pciBusId);
+  } else {
+    printf("WARN: couldn't get PCI bus id of device %d\n", id);
+    d.numaNode = -1;
+  }
+
+  ptree pt;
+  pt.put("device.id", id);
+  pt.put("device.pci_bus_id", d.pciBusId);
+  pt.put("device.numa_node", d.numaNode);
+  std::ostringstream json;
+  write_json(json, pt, false);
+  TraceOutput::instance().write(json.str());
+
+  return devices_[id] = d;
+}
+
+DeviceTopology &DeviceTopology::instance() {
+  static DeviceTopology t;
+  return t;
+}
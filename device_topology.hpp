@@ -0,0 +1,34 @@
+#ifndef DEVICE_TOPOLOGY_HPP
+#define DEVICE_TOPOLOGY_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+
+// Where each CUDA device is attached. The sysfs root is CPROF_SYSFS_ROOT, so
+// a fake tree can stand in for the machine's.
+//
+// The first lookup of each device writes a device record to the trace.
+class DeviceTopology {
+public:
+  class Device {
+  public:
+    std::string pciBusId; // empty if unknown
+    int numaNode;         // -1 if unknown
+  };
+
+private:
+  std::map<int, Device> devices_;
+  std::mutex mutex_;
+
+public:
+  const Device &device(int id);
+  int numa_node(int id) { return device(id).numaNode; }
+
+  static DeviceTopology &instance();
+
+private:
+  DeviceTopology() {}
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include "dirty.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+std::vector<hash_t> chunk_digests(const char *ptr, size_t size,
+                                  size_t chunkSize) {
+  assert(chunkSize && "Chunk size should be non-zero");
+
+  std::vector<hash_t> digests;
+  digests.reserve((size + chunkSize - 1) / chunkSize);
+  for (size_t off = 0; off < size; off += chunkSize) {
+    digests.push_back(hash_host(ptr + off, std::min(chunkSize, size - off)));
+  }
+  return digests;
+}
+
+std::vector<Extent> dirty_extents(uintptr_t pos, size_t size, size_t chunkSize,
+                                  const std::vector<hash_t> &before,
+                                  const std::vector<hash_t> &after) {
+  assert(before.size() == after.size() && "Digests of different buffers?");
+
+  std::vector<Extent> dirty;
+  size_t runStart = 0, runEnd = 0; // dirty chunk run [runStart, runEnd)
+  for (size_t i = 0; i <= before.size(); ++i) {
+    if (i < before.size() && before[i] != after[i]) {
+      if (runStart == runEnd) {
+        runStart = i;
+      }
+      runEnd = i + 1;
+    } else if (runStart != runEnd) {
+      const size_t off = runStart * chunkSize;
+      const size_t end = std::min(runEnd * chunkSize, size);
+      dirty.push_back(Extent(pos + off, end - off));
+      runStart = runEnd = 0;
+    }
+  }
+  return dirty;
+}
@@ -0,0 +1,22 @@
+#ifndef DIRTY_HPP
+#define DIRTY_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "extent.hpp"
+#include "hash.hpp"
+
+// Digest of each chunkSize-byte chunk of [ptr, ptr + size). The last chunk
+// may be short.
+std::vector<hash_t> chunk_digests(const char *ptr, size_t size,
+                                  size_t chunkSize);
+
+// The parts of [pos, pos + size) whose chunk digests changed from before to
+// after, with adjacent dirty chunks merged into one extent.
+std::vector<Extent> dirty_extents(uintptr_t pos, size_t size, size_t chunkSize,
+                                  const std::vector<hash_t> &before,
+                                  const std::vector<hash_t> &after);
+
+#endif
@@ -6,6 +6,7 @@
 #include <cupti.h>
 
 #include <map>
+#include <mutex>
 #include <vector>
 
 #include <cublas_v2.h>
@@ -33,6 +34,10 @@ public:
                 const CUpti_CallbackData *cbInfo);
 
   bool in_child_api() const { return apiStack_.size() >= 2; }
+  // the innermost call this thread entered is the one cbInfo describes
+  bool is_current_api(const CUpti_CallbackData *cbInfo) const {
+    return !apiStack_.empty() && apiStack_.back()->cb_info() == cbInfo;
+  }
   const ApiRecordRef &parent_api() const;
   ApiRecordRef &current_api();
 
@@ -42,7 +47,7 @@ public:
   bool is_cupti_callbacks_enabled() const { return cuptiCallbacksEnabled_; }
 };
 
-// FIXME: not thread-safe
+// FIXME: handle maps are not thread-safe
 class DriverState {
 public:
   typedef ThreadState mapped_type;
@@ -52,8 +57,11 @@ public:
 private:
   typedef std::map<key_type, mapped_type> ThreadMap;
   ThreadMap threadStates_;
+  std::mutex threadStatesMutex_;
   std::map<const cublasHandle_t, int> cublasHandleToDevice_;
   std::map<const cudnnHandle_t, int> cudnnHandleToDevice_;
+  std::map<const cublasHandle_t, cudaStream_t> cublasHandleToStream_;
+  std::map<const cudnnHandle_t, cudaStream_t> cudnnHandleToStream_;
 
   static DriverState &instance();
 
@@ -71,8 +79,32 @@ public:
   static int device_from_cudnn_handle(const cudnnHandle_t h) {
     return instance().cudnnHandleToDevice_.at(h);
   }
+  static void track_cublas_stream(const cublasHandle_t h,
+                                  const cudaStream_t stream) {
+    instance().cublasHandleToStream_[h] = stream;
+  }
+  static void track_cudnn_stream(const cudnnHandle_t h,
+                                 const cudaStream_t stream) {
+    instance().cudnnHandleToStream_[h] = stream;
+  }
+  // the default stream until one is set
+  static cudaStream_t stream_from_cublas_handle(const cublasHandle_t h) {
+    const auto &i = instance().cublasHandleToStream_.find(h);
+    return i == instance().cublasHandleToStream_.end() ? 0 : i->second;
+  }
+  static cudaStream_t stream_from_cudnn_handle(const cudnnHandle_t h) {
+    const auto &i = instance().cudnnHandleToStream_.find(h);
+    return i == instance().cudnnHandleToStream_.end() ? 0 : i->second;
+  }
   static mapped_type &this_thread() {
-    return instance().threadStates_[get_thread_id()];
+    // entries are never erased, so the reference stays valid
+    static thread_local mapped_type *ts = nullptr;
+    if (!ts) {
+      auto &s = instance();
+      std::lock_guard<std::mutex> guard(s.threadStatesMutex_);
+      ts = &s.threadStates_[get_thread_id()];
+    }
+    return *ts;
   }
 };
 
@@ -15,8 +15,60 @@
     }                                                                          \
   }
 
+#define READ_ENV_SIZE(env_var, fname, default)                                 \
+  inline size_t fname() {                                                      \
+    const char *fromEnv = std::getenv(env_var);                                \
+    if (fromEnv && (0 < std::strlen(fromEnv))) {                               \
+      return std::strtoull(fromEnv, nullptr, 0);                               \
+    } else {                                                                   \
+      return default;                                                          \
+    }                                                                          \
+  }
+
 namespace env {
+// pattern for the trace files, see trace_output.hpp
 READ_ENV_STR("CPROF_OUT", output_path, "output.cprof")
+// where sharded traces are listed, empty for next to each shard
+READ_ENV_STR("CPROF_MANIFEST", manifest_path, "")
+// sample the trace clocks against the host's this often, 0 for start and exit
+READ_ENV_SIZE("CPROF_CLOCK_SAMPLE_MS", clock_sample_ms, 1000)
+// "full" or "sampled" to hash memcpy sources, anything else to skip hashing
+READ_ENV_STR("CPROF_HASH_MEMCPY", hash_memcpy, "")
+READ_ENV_SIZE("CPROF_HASH_MIN_BYTES", hash_min_bytes, 0)
+READ_ENV_SIZE("CPROF_HASH_SAMPLE_BYTES", hash_sample_bytes, 64 * 1024)
+// non-zero to record the application call site of memcpys, memsets,
+// prefetches and advises, which is also done when hashing
+READ_ENV_SIZE("CPROF_CALLSITES", callsites, 0)
+// "hash" or "chunk" to only version kernel arguments that were written
+READ_ENV_STR("CPROF_DIRTY_TRACKING", dirty_tracking, "")
+READ_ENV_SIZE("CPROF_DIRTY_CHUNK_BYTES", dirty_chunk_bytes, 4096)
+// non-zero to synchronize the device around library calls, launches and
+// async memcpys, so their start and end times cover their GPU work
+READ_ENV_SIZE("CPROF_SYNC_TIMING", sync_timing, 0)
+// record host allocations of at least this many bytes, 0 for none
+READ_ENV_SIZE("CPROF_HOST_ALLOC_MIN_BYTES", host_alloc_min_bytes, 0)
+// where to read the device to NUMA node mapping from
+READ_ENV_STR("CPROF_SYSFS_ROOT", sysfs_root, "/sys")
+// host buffers copied below this percent of pinned bandwidth are slow
+READ_ENV_SIZE("CPROF_SLOW_TRANSFER_PCT", slow_transfer_pct, 50)
+// non-zero to collect CUPTI's unified memory counters, where supported
+READ_ENV_SIZE("CPROF_UM_COUNTERS", um_counters, 1)
+// where to snapshot live allocations and values, and restore them from at
+// start, empty for no snapshots
+READ_ENV_STR("CPROF_SNAPSHOT", snapshot_path, "")
+// seconds between snapshots, 0 for only at exit
+READ_ENV_SIZE("CPROF_SNAPSHOT_INTERVAL_S", snapshot_interval_s, 600)
+// how many of the newest values a snapshot looks at
+READ_ENV_SIZE("CPROF_SNAPSHOT_MAX_VALUES", snapshot_max_values, 65536)
+// 0 to load with tracing off, until a control command turns it on
+READ_ENV_SIZE("CPROF_TRACING", tracing, 1)
+// "full", or "summary" for totals only, see trace_output.hpp
+READ_ENV_STR("CPROF_MODE", mode, "full")
+// a file of control commands, see control.hpp, empty for none
+READ_ENV_STR("CPROF_CONTROL", control_path, "")
+READ_ENV_SIZE("CPROF_CONTROL_POLL_MS", control_poll_ms, 500)
+// non-zero to toggle tracing on SIGUSR1, and flush and rotate on SIGUSR2
+READ_ENV_SIZE("CPROF_CONTROL_SIGNALS", control_signals, 0)
 }
 
 #endif
\ No newline at end of file
@@ -1,25 +1,136 @@
 #include "extent.hpp"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Two extents overlap if either starts inside the other and neither is empty.
+// Differences of unsigned positions wrap, so each comparison covers both
+// sides of an extent without a branch.
+static inline bool overlaps(const uintptr_t pos, const size_t size,
+                            const uintptr_t qPos, const size_t qSize) {
+  return ((qPos - pos < size) & (qSize != 0)) |
+         ((pos - qPos < qSize) & (size != 0));
+}
+
 bool Extent::contains(const Extent::pos_t pos) const {
-  if (pos >= pos_ && pos < pos_ + size_) {
-    return true;
-  } else {
-    return false;
-  }
+  return pos - pos_ < size_;
 }
 
 bool Extent::contains(const Extent &other) const {
-  return contains(other.pos_) && contains(other.pos_ + other.size_);
+  const size_t offset = other.pos_ - pos_;
+  return (offset <= size_) & (other.size_ <= size_ - offset);
 }
 
 bool Extent::overlaps(const Extent &other) const {
-  if (other.contains(pos_))
-    return true;
-  if (other.contains(pos_ + size_ - 1))
-    return true;
-  if (contains(other.pos_))
-    return true;
-  if (contains(other.pos_ + other.size_ - 1))
-    return true;
-  return false;
-}
\ No newline at end of file
+  return ::overlaps(pos_, size_, other.pos_, other.size_);
+}
+
+static size_t find_first_scalar(const uintptr_t *pos, const size_t *size,
+                                size_t from, const size_t n, const Extent &q) {
+  for (; from < n; ++from) {
+    if (overlaps(pos[from], size[from], q.pos(), q.size())) {
+      return from;
+    }
+  }
+  return n;
+}
+
+static size_t find_last_scalar(const uintptr_t *pos, const size_t *size,
+                               size_t end, const size_t n, const Extent &q) {
+  while (end--) {
+    if (overlaps(pos[end], size[end], q.pos(), q.size())) {
+      return end;
+    }
+  }
+  return n;
+}
+
+#if defined(__x86_64__)
+
+// AVX2 has only signed 64-bit compares, so unsigned ones flip the sign bits
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// bit j set if extent i + j overlaps the query, which is not empty
+AVX2_TARGET static inline int overlaps4(const uintptr_t *pos,
+                                        const size_t *size, const size_t i,
+                                        const __m256i qPos,
+                                        const __m256i qSizeBiased,
+                                        const __m256i bias) {
+  const __m256i p = _mm256_loadu_si256((const __m256i *)(pos + i));
+  const __m256i s = _mm256_loadu_si256((const __m256i *)(size + i));
+  // qPos - p < s
+  const __m256i inThis =
+      _mm256_cmpgt_epi64(_mm256_xor_si256(s, bias),
+                         _mm256_xor_si256(_mm256_sub_epi64(qPos, p), bias));
+  // p - qPos < qSize, for non-empty extents
+  const __m256i inQuery = _mm256_andnot_si256(
+      _mm256_cmpeq_epi64(s, _mm256_setzero_si256()),
+      _mm256_cmpgt_epi64(qSizeBiased,
+                         _mm256_xor_si256(_mm256_sub_epi64(p, qPos), bias)));
+  return _mm256_movemask_pd(
+      _mm256_castsi256_pd(_mm256_or_si256(inThis, inQuery)));
+}
+
+AVX2_TARGET static size_t find_first_avx2(const uintptr_t *pos,
+                                          const size_t *size, size_t from,
+                                          const size_t n, const Extent &q) {
+  if (!q.size()) {
+    return n;
+  }
+  const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i qPos = _mm256_set1_epi64x(q.pos());
+  const __m256i qSizeBiased =
+      _mm256_xor_si256(_mm256_set1_epi64x(q.size()), bias);
+  for (; from + 4 <= n; from += 4) {
+    const int hits = overlaps4(pos, size, from, qPos, qSizeBiased, bias);
+    if (hits) {
+      return from + __builtin_ctz(hits);
+    }
+  }
+  return find_first_scalar(pos, size, from, n, q);
+}
+
+AVX2_TARGET static size_t find_last_avx2(const uintptr_t *pos,
+                                         const size_t *size, size_t end,
+                                         const size_t n, const Extent &q) {
+  if (!q.size()) {
+    return n;
+  }
+  const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i qPos = _mm256_set1_epi64x(q.pos());
+  const __m256i qSizeBiased =
+      _mm256_xor_si256(_mm256_set1_epi64x(q.size()), bias);
+  for (; end >= 4; end -= 4) {
+    const int hits = overlaps4(pos, size, end - 4, qPos, qSizeBiased, bias);
+    if (hits) {
+      return end - 4 + (31 - __builtin_clz(hits));
+    }
+  }
+  return find_last_scalar(pos, size, end, n, q);
+}
+
+static bool has_avx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+#endif
+
+size_t ExtentArray::find_first(const Extent &q, const size_t from) const {
+#if defined(__x86_64__)
+  if (has_avx2()) {
+    return find_first_avx2(pos_.data(), size_.data(), from, size(), q);
+  }
+#endif
+  return find_first_scalar(pos_.data(), size_.data(), from, size(), q);
+}
+
+size_t ExtentArray::find_last(const Extent &q, const size_t end) const {
+#if defined(__x86_64__)
+  if (has_avx2()) {
+    return find_last_avx2(pos_.data(), size_.data(), end, size(), q);
+  }
+#endif
+  return find_last_scalar(pos_.data(), size_.data(), end, size(), q);
+}
@@ -1,8 +1,11 @@
 #ifndef EXTENT_HPP
 #define EXTENT_HPP
 
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
+// The bytes [pos, pos + size). An empty extent overlaps nothing.
 class Extent {
 private:
   typedef uintptr_t pos_t;
@@ -14,6 +17,7 @@ protected:
 public:
   Extent(pos_t pos, std::size_t size) : pos_(pos), size_(size) {}
   bool overlaps(const Extent &other) const;
+  // other is entirely within this extent
   bool contains(const Extent &other) const;
   bool contains(pos_t pos) const;
 
@@ -21,4 +25,33 @@ public:
   const std::size_t &size() const { return size_; }
 };
 
-#endif
\ No newline at end of file
+// Extents as parallel arrays of first bytes and sizes, so one query is tested
+// against a block of them at a time, with AVX2 if the CPU has it. Extents
+// keep the order they were added in.
+class ExtentArray {
+private:
+  std::vector<uintptr_t> pos_;
+  std::vector<std::size_t> size_;
+
+public:
+  void push_back(const Extent &e) {
+    pos_.push_back(e.pos());
+    size_.push_back(e.size());
+  }
+  void erase(std::size_t i) {
+    pos_.erase(pos_.begin() + i);
+    size_.erase(size_.begin() + i);
+  }
+  std::size_t size() const { return pos_.size(); }
+  Extent operator[](std::size_t i) const { return Extent(pos_[i], size_[i]); }
+
+  // the first extent at or after from that overlaps q, size() if none
+  std::size_t find_first(const Extent &q, std::size_t from = 0) const;
+  // the last extent before end that overlaps q, size() if none
+  std::size_t find_last(const Extent &q, std::size_t end) const;
+  std::size_t find_last(const Extent &q) const {
+    return find_last(q, size());
+  }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// FNV-1a, one 64-bit word at a time
+static const hash_t FNV_OFFSET = 14695981039346656037ull;
+static const hash_t FNV_PRIME = 1099511628211ull;
+
+static hash_t hash_bytes(hash_t h, const char *ptr, size_t size) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, ptr + i, sizeof(word));
+    h = (h ^ word) * FNV_PRIME;
+  }
+  for (; i < size; ++i) {
+    h = (h ^ static_cast<unsigned char>(ptr[i])) * FNV_PRIME;
+  }
+  return h;
+}
+
+hash_t hash_host(const char *ptr, size_t size) {
+  return hash_bytes((FNV_OFFSET ^ size) * FNV_PRIME, ptr, size);
+}
+
+hash_t hash_host(const uintptr_t ptr, size_t size) {
+  return hash_host(reinterpret_cast<const char *>(ptr), size);
+}
+
+hash_t hash_host_sampled(const char *ptr, size_t size, size_t sampleSize) {
+  constexpr size_t BLOCK_SIZE = 256;
+
+  if (size <= sampleSize || size <= BLOCK_SIZE) {
+    return hash_host(ptr, size);
+  }
+
+  // numBlocks evenly-spaced blocks, the first and last always included
+  const size_t numBlocks = std::max(sampleSize / BLOCK_SIZE, size_t(1));
+  const size_t span = size - BLOCK_SIZE;
+  hash_t h = (FNV_OFFSET ^ size) * FNV_PRIME;
+  for (size_t b = 0; b < numBlocks; ++b) {
+    size_t off;
+    if (b == 0) {
+      off = 0;
+    } else if (b + 1 == numBlocks) {
+      off = span;
+    } else {
+      off = span / (numBlocks - 1) * b;
+    }
+    h = hash_bytes(h, ptr + off, BLOCK_SIZE);
+  }
+  return h;
+}
+
+hash_t hash_host_sampled(const uintptr_t ptr, size_t size, size_t sampleSize) {
+  return hash_host_sampled(reinterpret_cast<const char *>(ptr), size,
+                           sampleSize);
+}
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <vector>
 
 static_assert(sizeof(uint64_t) == sizeof(unsigned long long int),
               "Size no good");
@@ -15,7 +16,16 @@ typedef unsigned long long int hash_t;
 hash_t hash_host(const char *ptr, size_t size);
 hash_t hash_host(const uintptr_t ptr, size_t size);
 
+// Hash at most sampleSize bytes of [ptr, ptr + size), spread evenly over the
+// buffer. Identical buffers always collide, different ones may too.
+hash_t hash_host_sampled(const char *ptr, size_t size, size_t sampleSize);
+hash_t hash_host_sampled(const uintptr_t ptr, size_t size, size_t sampleSize);
+
 hash_t hash_device(const char *devPtr, size_t size);
 hash_t hash_device(const uintptr_t devPtr, size_t size);
 
+// chunk_digests() of a device buffer
+std::vector<hash_t> hash_device_chunks(const uintptr_t devPtr, size_t size,
+                                       size_t chunkSize);
+
 #endif
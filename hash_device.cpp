@@ -0,0 +1,37 @@
+#include "hash.hpp"
+
+#include "dirty.hpp"
+#include "driver_state.hpp"
+#include "util_cuda.hpp"
+
+hash_t hash_device(const char *devPtr, size_t size) {
+  // don't want to profile this
+  DriverState::this_thread().pause_cupti_callbacks();
+
+  char *buf = new char[size];
+  CUDA_CHECK(cudaMemcpy(buf, devPtr, size, cudaMemcpyDeviceToHost));
+  auto digest = hash_host(buf, size);
+  delete[] buf;
+
+  // start profiling stuff again
+  DriverState::this_thread().resume_cupti_callbacks();
+  return digest;
+}
+
+hash_t hash_device(const uintptr_t ptr, size_t size) {
+  return hash_device(reinterpret_cast<const char *>(ptr), size);
+}
+
+std::vector<hash_t> hash_device_chunks(const uintptr_t devPtr, size_t size,
+                                       size_t chunkSize) {
+  // don't want to profile this
+  DriverState::this_thread().pause_cupti_callbacks();
+
+  std::vector<char> buf(size);
+  CUDA_CHECK(cudaMemcpy(buf.data(), reinterpret_cast<const void *>(devPtr),
+                        size, cudaMemcpyDeviceToHost));
+
+  // start profiling stuff again
+  DriverState::this_thread().resume_cupti_callbacks();
+  return chunk_digests(buf.data(), size, chunkSize);
+}
\ No newline at end of file
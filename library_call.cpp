@@ -0,0 +1,185 @@
+#include "library_call.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <cuda_runtime.h>
+#include <cupti.h>
+
+#include "allocations.hpp"
+#include "env.hpp"
+#include "streams.hpp"
+#include "util_cupti.hpp"
+#include "values.hpp"
+
+std::vector<uintptr_t> Operand::block_ptrs() const {
+  std::vector<uintptr_t> blocks;
+  if (is_scattered()) {
+    for (const void *p : ptrs) {
+      blocks.push_back((uintptr_t)p);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      blocks.push_back((uintptr_t)ptr + i * stride);
+    }
+  }
+  return blocks;
+}
+
+// The allocation containing ptr. If there isn't one, make an implicit one
+// of size bytes.
+static Allocations::id_type operand_allocation(const char *name,
+                                               const uintptr_t ptr,
+                                               const size_t size) {
+  auto &allocations = Allocations::instance();
+
+  Allocations::id_type allocId;
+  std::tie(allocId, std::ignore) =
+      allocations.find_live(ptr, 1, AddressSpace::Cuda());
+  if (allocId == Allocations::noid) {
+    printf("WARN: creating implicit allocation for %s operand %lu\n", name,
+           ptr);
+    std::tie(allocId, std::ignore) = allocations.new_allocation(
+        ptr, std::max(size, size_t(1)), AddressSpace::Cuda(),
+        Memory(Memory::Unknown), AllocationRecord::PageType::Unknown);
+  }
+  assert(allocId && "If there is no allocation, we need to make one");
+  return allocId;
+}
+
+static Allocations::id_type operand_allocation(const char *name,
+                                               const Operand &o) {
+  return operand_allocation(
+      name, (uintptr_t)o.ptr,
+      o.count ? (o.count - 1) * o.stride + o.bytes : 0);
+}
+
+// The values a scattered operand writes, one per allocation its blocks are in
+static std::vector<Values::value_type>
+new_scattered_values(const char *name, const Operand &o) {
+  std::map<Allocations::id_type, std::vector<Extent>> byAllocation;
+  for (const uintptr_t p : o.block_ptrs()) {
+    byAllocation[operand_allocation(name, p, o.bytes)].emplace_back(p,
+                                                                    o.bytes);
+  }
+  std::vector<Values::value_type> written;
+  for (const auto &kv : byAllocation) {
+    written.push_back(
+        Values::instance().new_ranges_value(kv.second, kv.first, true).second);
+  }
+  return written;
+}
+
+ApiRecordRef library_call_api(const char *name, const int device,
+                              cudaStream_t stream, const OpInfo &op,
+                              const std::vector<Operand> &operands) {
+  auto &values = Values::instance();
+  auto api = std::make_shared<ApiRecord>(name, device);
+  Streams::instance().enqueue(*api, stream);
+
+  if (op.is_known()) {
+    OpInfo withBytes(op);
+    for (const auto &o : operands) {
+      if (!o.ptr) {
+        continue;
+      }
+      const uint64_t bytes = uint64_t(o.bytes) * o.count;
+      if (o.is_read()) {
+        withBytes.bytesRead += bytes;
+      }
+      if (o.is_written()) {
+        withBytes.bytesWritten += bytes;
+      }
+    }
+    api->set_op(withBytes);
+  }
+
+  // Find the values read by the call, one extent per block
+  std::vector<Extent> reads;
+  for (const auto &o : operands) {
+    if (!o.ptr || !o.is_read()) {
+      continue;
+    }
+    for (const uintptr_t p : o.block_ptrs()) {
+      reads.emplace_back(p, std::max(o.bytes, size_t(1)));
+    }
+  }
+  const auto readIds = values.find_all_live(reads, AddressSpace::Cuda());
+
+  std::vector<Values::id_type> inputs;
+  std::set<Values::id_type> seen;
+  for (size_t i = 0; i < reads.size(); ++i) {
+    if (readIds[i].empty()) {
+      printf("WARN: no value for %s operand %lu\n", name, reads[i].pos());
+      continue;
+    }
+    for (const auto id : readIds[i]) {
+      if (seen.insert(id).second) {
+        inputs.push_back(id);
+        api->add_input(id);
+      }
+    }
+  }
+
+  // Create values for everything written by the call
+  for (const auto &o : operands) {
+    if (!o.ptr || !o.is_written()) {
+      continue;
+    }
+    if (o.is_scattered() && o.bytes) {
+      for (const auto &outVal : new_scattered_values(name, o)) {
+        for (const auto &id : inputs) {
+          outVal->add_depends_on(id);
+        }
+        api->add_output(outVal->Id());
+      }
+      continue;
+    }
+    Values::id_type outId;
+    Values::value_type outVal;
+    Values::value_type prevVal;
+    if (!o.bytes) {
+      std::tie(std::ignore, prevVal) =
+          values.find_live((uintptr_t)o.ptr, 1, AddressSpace::Cuda());
+    }
+    if (prevVal) {
+      std::tie(outId, outVal) = values.duplicate_value(prevVal);
+    } else if (o.is_strided()) {
+      std::tie(outId, outVal) = values.new_strided_value(
+          (uintptr_t)o.ptr, o.bytes, o.stride, o.count,
+          operand_allocation(name, o), true);
+    } else {
+      std::tie(outId, outVal) = values.new_value(
+          (uintptr_t)o.ptr, o.bytes, operand_allocation(name, o), true);
+    }
+    for (const auto &id : inputs) {
+      outVal->add_depends_on(id);
+    }
+    api->add_output(outId);
+  }
+
+  return api;
+}
+
+static uint64_t library_call_timestamp() {
+  if (env::sync_timing()) {
+    const cudaError_t err = cudaDeviceSynchronize();
+    if (err != cudaSuccess) {
+      printf("WARN: cudaDeviceSynchronize for library call timing: %s\n",
+             cudaGetErrorString(err));
+    }
+  }
+  uint64_t timestamp;
+  CUPTI_CHECK(cuptiGetTimestamp(&timestamp));
+  return timestamp;
+}
+
+void library_call_begin(ApiRecord &api) {
+  api.record_start_time(library_call_timestamp());
+}
+
+void library_call_end(ApiRecord &api) {
+  api.record_end_time(library_call_timestamp());
+}
@@ -0,0 +1,144 @@
+#ifndef LIBRARY_CALL_HPP
+#define LIBRARY_CALL_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "api_record.hpp"
+#include "apis.hpp"
+#include "control.hpp"
+#include "driver_state.hpp"
+
+// A device pointer passed to a library call, and the bytes the call reads or
+// writes through it. A strided operand is count blocks of bytes each, stride
+// bytes apart, like the matrices of a strided batched GEMM. A scattered
+// operand is blocks of bytes each at the addresses in ptrs, like the matrices
+// of a batched GEMM, and ptr is the first.
+class Operand {
+public:
+  enum class Access { In, Out, InOut };
+
+  const void *ptr;
+  size_t bytes; // 0 if unknown
+  Access access;
+  size_t stride; // 0 if contiguous
+  size_t count;
+  std::vector<const void *> ptrs; // if scattered
+
+  bool is_read() const { return access != Access::Out; }
+  bool is_written() const { return access != Access::In; }
+  bool is_strided() const { return count > 1; }
+  bool is_scattered() const { return !ptrs.empty(); }
+  // the address of each block
+  std::vector<uintptr_t> block_ptrs() const;
+};
+
+namespace op {
+inline Operand in(const void *ptr, size_t bytes) {
+  return Operand{ptr, bytes, Operand::Access::In, 0, 1, {}};
+}
+inline Operand out(const void *ptr, size_t bytes) {
+  return Operand{ptr, bytes, Operand::Access::Out, 0, 1, {}};
+}
+inline Operand inout(const void *ptr, size_t bytes) {
+  return Operand{ptr, bytes, Operand::Access::InOut, 0, 1, {}};
+}
+inline Operand in(const void *ptr, size_t bytes, size_t stride, size_t count) {
+  return Operand{ptr, bytes, Operand::Access::In, stride, count, {}};
+}
+inline Operand out(const void *ptr, size_t bytes, size_t stride, size_t count) {
+  return Operand{ptr, bytes, Operand::Access::Out, stride, count, {}};
+}
+inline Operand inout(const void *ptr, size_t bytes, size_t stride,
+                     size_t count) {
+  return Operand{ptr, bytes, Operand::Access::InOut, stride, count, {}};
+}
+// bytes at each of the non-null ptrs
+inline Operand scattered(std::vector<const void *> ptrs, size_t bytes,
+                         Operand::Access access) {
+  ptrs.erase(std::remove(ptrs.begin(), ptrs.end(), nullptr), ptrs.end());
+  const void *first = ptrs.empty() ? nullptr : ptrs[0];
+  const size_t count = ptrs.size();
+  return Operand{first, bytes, access, 0, count, std::move(ptrs)};
+}
+inline Operand in(const std::vector<const void *> &ptrs, size_t bytes) {
+  return scattered(ptrs, bytes, Operand::Access::In);
+}
+inline Operand inout(const std::vector<const void *> &ptrs, size_t bytes) {
+  return scattered(ptrs, bytes, Operand::Access::InOut);
+}
+} // namespace op
+
+// Find the values a library call reads and create new values for what it
+// writes, each depending on everything read. Returns the call's ApiRecord,
+// ordered on stream, which the caller should record. A known op is attached
+// to the record with its bytes read and written filled in from the operands.
+//
+// Null operands are skipped. An operand of unknown size is looked up with a
+// 1-byte probe, and written as a copy of the value it overwrites. All inputs
+// are found with one bulk lookup, and an operand's inputs are every value still
+// live in its bytes; a strided output is a single strided value, and a
+// scattered output one value of ranges per allocation it writes.
+ApiRecordRef library_call_api(const char *name, int device,
+                              cudaStream_t stream, const OpInfo &op,
+                              const std::vector<Operand> &operands);
+
+// Timestamp the start and end of the real call. With CPROF_SYNC_TIMING, the
+// device is synchronized first so the times cover the call's GPU work.
+// CUPTI callbacks must be paused.
+void library_call_begin(ApiRecord &api);
+void library_call_end(ApiRecord &api);
+
+// Define an interposed library function, which only calls the real function
+// while tracing is off, from a spec:
+//   ret_t    the function's return type
+//   apiName  the name to record
+//   name     the function (after any _v2 renaming by the library's headers)
+//   params   its parenthesized parameter list
+//   args     the parenthesized argument list forwarding params
+//   device   expression for the device the call runs on
+//   stream   expression for the stream the call's work is issued to
+//   opInfo   expression for the OpInfo of what the call computes, or OpInfo()
+//   ...      the call's operands, as op::in / op::out / op::inout
+#define LIBRARY_CALL_WRAPPER(ret_t, apiName, name, params, args, device,       \
+                             stream, opInfo, ...)                              \
+  LIBRARY_CALL_WRAPPER_OPERANDS(ret_t, apiName, name, params, args, device,    \
+                                stream, opInfo,                                \
+                                (std::vector<Operand>{__VA_ARGS__}))
+
+// LIBRARY_CALL_WRAPPER, with the operands built by an expression of params
+// that returns a std::vector<Operand>, for calls whose operand count is only
+// known at run time
+#define LIBRARY_CALL_WRAPPER_OPERANDS(ret_t, apiName, name, params, args,      \
+                                      device, stream, opInfo, operands)        \
+  typedef ret_t(*name##Func) params;                                           \
+  extern "C" ret_t name params {                                               \
+    static name##Func real_##name = nullptr;                                   \
+    if (real_##name == nullptr) {                                              \
+      real_##name = (name##Func)dlsym(RTLD_NEXT, #name);                       \
+    }                                                                          \
+    assert(real_##name && "Will the real " #name " please stand up?");         \
+    if (!Control::tracing()) {                                                 \
+      return real_##name args;                                                 \
+    }                                                                          \
+    printf("LD_PRELOAD intercept: %s\n", apiName);                             \
+                                                                               \
+    auto api = library_call_api(apiName, device, stream, opInfo, operands);    \
+                                                                               \
+    DriverState::this_thread().pause_cupti_callbacks();                        \
+    library_call_begin(*api);                                                  \
+    const ret_t ret = real_##name args;                                        \
+    library_call_end(*api);                                                    \
+    DriverState::this_thread().resume_cupti_callbacks();                       \
+                                                                               \
+    APIs::record(api);                                                         \
+    return ret;                                                                \
+  }
+
+#endif
@@ -0,0 +1,33 @@
+#include "location.hpp"
+
+#include <cassert>
+
+constexpr Location::bits_t Location::MemoryKindMask;
+constexpr Location::bits_t Location::MemoryIdMask;
+constexpr Location::bits_t Location::AddressSpaceTypeMask;
+constexpr Location::bits_t Location::DeviceMask;
+constexpr Location::bits_t Location::AddressSpaceMask;
+constexpr Location::bits_t Location::PageTypeMask;
+
+AddressSpace Location::address_space() const {
+  return AddressSpace(address_space_type(), device());
+}
+
+Memory Location::memory() const {
+  if (has_memory_id()) {
+    return Memory(memory_kind(), memory_id());
+  }
+  return Memory(memory_kind());
+}
+
+std::string to_string(const Location::PageType type) {
+  if (Location::PageType::Pinned == type)
+    return "pinned";
+  if (Location::PageType::Pageable == type) {
+    return "pageable";
+  }
+  if (Location::PageType::Unknown == type) {
+    return "unknown";
+  }
+  assert(0 && "Unexpected Location::PageType");
+}
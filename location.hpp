@@ -0,0 +1,95 @@
+#ifndef LOCATION_HPP
+#define LOCATION_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+
+#include "address_space.hpp"
+#include "memory.hpp"
+
+// Where an allocation lives, packed into 64 bits so records stay small and
+// filtering by location is one mask compare:
+//
+//   bits  0-7   memory kind, Memory::loc_t bits, all set for Memory::Any
+//   bit   8     the memory has an id
+//   bits 16-31  memory id (NUMA node or device), signed
+//   bits 32-35  address space type
+//   bits 40-55  address space device + 1, 0 for any device
+//   bits 56-59  page type
+class Location {
+public:
+  typedef uint64_t bits_t;
+  enum class PageType { Pinned, Pageable, Unknown };
+
+  static constexpr bits_t MemoryKindMask = 0xFFull;
+  static constexpr bits_t MemoryIdMask = 0xFFFF01ull << 8;
+  static constexpr bits_t AddressSpaceTypeMask = 0xFull << 32;
+  static constexpr bits_t DeviceMask = 0xFFFFull << 40;
+  static constexpr bits_t AddressSpaceMask = AddressSpaceTypeMask | DeviceMask;
+  static constexpr bits_t PageTypeMask = 0xFull << 56;
+
+private:
+  bits_t bits_;
+
+  static bits_t pack_memory(const Memory::loc_t kind, const bool hasId,
+                            const int id) {
+    assert((kind == Memory::Any || !(kind & ~MemoryKindMask)) &&
+           "Memory kind doesn't fit in a Location");
+    return (kind == Memory::Any ? MemoryKindMask : kind) |
+           (bits_t(hasId) << 8) | (bits_t(uint16_t(id)) << 16);
+  }
+  static constexpr bits_t pack_address_space(const AddressSpace::Type type,
+                                             const int device) {
+    return (bits_t(type) << 32) | (bits_t(uint16_t(device + 1)) << 40);
+  }
+
+public:
+  constexpr Location()
+      : bits_(pack_address_space(AddressSpace::Type::Invalid, -1) |
+              (bits_t(PageType::Unknown) << 56)) {}
+  constexpr explicit Location(const bits_t bits) : bits_(bits) {}
+  Location(const AddressSpace &as, const Memory &mem, PageType pt)
+      : bits_(pack_memory(mem.loc_, bool(mem.id_),
+                          mem.id_ ? mem.id_.value() : 0) |
+              pack_address_space(as.type(), as.device()) |
+              (bits_t(pt) << 56)) {}
+  // only the address space is known, e.g. for a lookup
+  explicit Location(const AddressSpace &as)
+      : Location(as, Memory(Memory::Unknown), PageType::Unknown) {}
+
+  constexpr bits_t bits() const { return bits_; }
+  Memory::loc_t memory_kind() const {
+    const bits_t kind = bits_ & MemoryKindMask;
+    return kind == MemoryKindMask ? Memory::Any : kind;
+  }
+  constexpr bool has_memory_id() const { return (bits_ >> 8) & 1; }
+  constexpr int memory_id() const { return int16_t(bits_ >> 16); }
+  constexpr AddressSpace::Type address_space_type() const {
+    return AddressSpace::Type((bits_ >> 32) & 0xF);
+  }
+  // -1 if not known
+  constexpr int device() const { return int((bits_ >> 40) & 0xFFFF) - 1; }
+  constexpr PageType page_type() const { return PageType((bits_ >> 56) & 0xF); }
+
+  // the fields under mask are those of value
+  constexpr bool matches(const bits_t mask, const bits_t value) const {
+    return (bits_ & mask) == value;
+  }
+  // AddressSpace::maybe_equal on the packed fields
+  constexpr bool maybe_same_address_space(const Location &other) const {
+    return (address_space_type() == AddressSpace::Type::Unknown) |
+           (other.address_space_type() == AddressSpace::Type::Unknown) |
+           (matches(AddressSpaceTypeMask, other.bits_ & AddressSpaceTypeMask) &
+            (!(bits_ & DeviceMask) | !(other.bits_ & DeviceMask) |
+             matches(DeviceMask, other.bits_ & DeviceMask)));
+  }
+
+  AddressSpace address_space() const;
+  Memory memory() const;
+};
+
+// "pinned", "pageable" or "unknown"
+std::string to_string(Location::PageType type);
+
+#endif
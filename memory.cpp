@@ -37,6 +37,11 @@ static std::string to_string(const Memory::loc_t &l) {
       ret += "|";
     ret += "cudadevice";
   }
+  if (l & Memory::CudaUnified) {
+    if (!ret.empty())
+      ret += "|";
+    ret += "cudaunified";
+  }
   return ret;
 }
 
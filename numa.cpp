@@ -3,6 +3,8 @@
 #include "numaif.h"
 #include "unistd.h"
 #include <cassert>
+#include <cctype>
+#include <fstream>
 
 static void *get_page(const void *ptr, const int page_size) {
   const auto u = reinterpret_cast<uintptr_t>(ptr);
@@ -23,4 +25,18 @@ int get_numa_node(const void *ptr) {
 
 int get_numa_node(const uintptr_t ptr) {
   return get_numa_node(reinterpret_cast<const void *>(ptr));
-}
\ No newline at end of file
+}
+
+int pci_numa_node(const std::string &sysfsRoot, const std::string &pciBusId) {
+  // sysfs names devices in lower case
+  std::string busId(pciBusId);
+  for (auto &c : busId) {
+    c = std::tolower(c);
+  }
+  std::ifstream f(sysfsRoot + "/bus/pci/devices/" + busId + "/numa_node");
+  int node = -1;
+  if (!(f >> node) || node < 0) {
+    return -1; // missing, or -1 on machines without NUMA
+  }
+  return node;
+}
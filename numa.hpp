@@ -6,8 +6,13 @@ https://stackoverflow.com/questions/7986903/can-i-get-the-numa-node-from-a-point
 */
 
 #include <cstdint>
+#include <string>
 
 int get_numa_node(const void *ptr);
 int get_numa_node(const uintptr_t ptr);
 
+// The NUMA node of the PCI device with pciBusId (e.g. "0000:3B:00.0"), read
+// from <sysfsRoot>/bus/pci/devices/<bus id>/numa_node. -1 if unknown.
+int pci_numa_node(const std::string &sysfsRoot, const std::string &pciBusId);
+
 #endif
\ No newline at end of file
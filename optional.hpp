@@ -15,8 +15,14 @@ public:
   constexpr optional(const optional &other)
       : has_value_(other.has_value_), value_(other.value_) {}
 
+  optional &operator=(const optional &other) {
+    has_value_ = other.has_value_;
+    value_ = other.value_;
+    return *this;
+  }
+
   constexpr explicit operator bool() const noexcept { return has_value_; }
-  constexpr bool has_value() const noexcept { return has_value(); }
+  constexpr bool has_value() const noexcept { return has_value_; }
 
   U &value() { return value_; }
   const U &value() const { return value_; }
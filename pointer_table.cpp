@@ -0,0 +1,73 @@
+#include "pointer_table.hpp"
+
+#include <cassert>
+
+// Fibonacci hashing of the pointer: the top bits of the product depend on all
+// of the key's bits, so page-aligned pointers spread over the whole table
+static size_t home_slot(const PointerTable::key_type key) {
+  static_assert(PointerTable::capacity == size_t(1) << 16,
+                "home_slot takes 16 bits of the product");
+  return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ull) >> (64 - 16));
+}
+
+bool PointerTable::insert(const key_type key, const mapped_type value) {
+  assert(key != empty && key != erased && "Reserved key");
+  assert(value && "Values must be non-zero");
+  static_assert(maxProbes <= UINT8_MAX, "probes_ counts fit in a byte");
+  const size_t home = home_slot(key);
+  for (size_t i = 0; i < maxProbes; ++i) {
+    const size_t slot = (home + i) & (capacity - 1);
+    key_type k = keys_[slot].load(std::memory_order_relaxed);
+    if (k != empty && k != erased) {
+      continue;
+    }
+    // lookups from home probe this far before they could see key
+    uint8_t probes = probes_[home].load(std::memory_order_relaxed);
+    while (probes < i + 1 &&
+           !probes_[home].compare_exchange_weak(probes, uint8_t(i + 1),
+                                                std::memory_order_acq_rel)) {
+    }
+    if (keys_[slot].compare_exchange_strong(k, key,
+                                            std::memory_order_acq_rel)) {
+      // readers of key are ordered after the insert by whoever handed them
+      // the pointer, so they see this store
+      values_[slot].store(value, std::memory_order_release);
+      return true;
+    }
+  }
+  return false;
+}
+
+PointerTable::mapped_type PointerTable::erase(const key_type key) {
+  const size_t home = home_slot(key);
+  const size_t probes = probes_[home].load(std::memory_order_acquire);
+  for (size_t i = 0; i < probes; ++i) {
+    const size_t slot = (home + i) & (capacity - 1);
+    const key_type k = keys_[slot].load(std::memory_order_acquire);
+    if (k == key) {
+      const mapped_type value = values_[slot].load(std::memory_order_acquire);
+      keys_[slot].store(erased, std::memory_order_release);
+      return value;
+    }
+    if (k == empty) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+PointerTable::mapped_type PointerTable::find(const key_type key) const {
+  const size_t home = home_slot(key);
+  const size_t probes = probes_[home].load(std::memory_order_acquire);
+  for (size_t i = 0; i < probes; ++i) {
+    const size_t slot = (home + i) & (capacity - 1);
+    const key_type k = keys_[slot].load(std::memory_order_acquire);
+    if (k == key) {
+      return values_[slot].load(std::memory_order_acquire);
+    }
+    if (k == empty) {
+      return 0;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef POINTER_TABLE_HPP
+#define POINTER_TABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+// A fixed-size, lock-free hash table from pointers to ids, for the host
+// allocator hooks: free() looks up every pointer, and almost none are
+// tracked.
+//
+// Each key is probed in at most maxProbes slots, so inserts fail when its
+// neighbourhood is full instead of the table slowing down. Each home slot
+// also keeps how far from it any key was ever placed, so a lookup only probes
+// that far, however many erased slots have built up around it. A pointer whose
+// home no key was placed from costs one load. A key must not be inserted twice
+// while present. Values must be non-zero.
+//
+// Has a trivial constructor, so a static PointerTable is zero-initialized
+// (empty) before any code runs.
+class PointerTable {
+public:
+  typedef uintptr_t key_type;
+  typedef uintptr_t mapped_type;
+
+  static const size_t capacity = size_t(1) << 16;
+  static const size_t maxProbes = 64;
+
+private:
+  static const key_type empty = 0;
+  static const key_type erased = 1;
+
+  std::atomic<key_type> keys_[capacity];
+  std::atomic<mapped_type> values_[capacity];
+  // slots probed from each home slot, only ever raised
+  std::atomic<uint8_t> probes_[capacity];
+
+public:
+  // false if there was no free slot for key
+  bool insert(key_type key, mapped_type value);
+
+  // remove key and return its value, 0 if absent
+  mapped_type erase(key_type key);
+
+  // the value of key, 0 if absent
+  mapped_type find(key_type key) const;
+};
+
+#endif
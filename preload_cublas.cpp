@@ -4,11 +4,14 @@
 #include <dlfcn.h>
 
 #include <cublas_v2.h>
+#include <cuda_runtime.h>
 
 #include "allocations.hpp"
 #include "apis.hpp"
+#include "blas_extent.hpp"
 #include "callbacks.hpp"
 #include "driver_state.hpp"
+#include "library_call.hpp"
 #include "preload.hpp"
 #include "thread.hpp"
 #include "values.hpp"
@@ -41,415 +44,711 @@ extern "C" cublasStatus_t cublasDestroy(cublasHandle_t handle) {
   return ret;
 }
 
-typedef cublasStatus_t (*cublasDgemmFunc)(
-    cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb,
-    int m, int n, int k, const double *alpha, const double *A, int lda,
-    const double *B, int ldb, const double *beta, double *C, int ldc);
-extern "C" cublasStatus_t
-cublasDgemm(cublasHandle_t handle, cublasOperation_t transa,
-            cublasOperation_t transb, int m, int n, int k, const double *alpha,
-            const double *A, int lda, const double *B, int ldb,
-            const double *beta, double *C, int ldc) {
-  V2_LD_PRELOAD_BOILERPLATE(cublasDgemm);
-
-  // FIXME - also depends on alpha, beta
-  // record data, we know things about how this API works
-  auto &values = Values::instance();
-
-  // Find the argument values
-  // http://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemv
-  Values::id_type aId, bId, cId;
-  Values::value_type aVal, bVal, cVal;
-  std::tie(aId, aVal) = values.find_live_device((uintptr_t)A, 1);
-  std::tie(bId, bVal) = values.find_live_device((uintptr_t)B, 1);
-  std::tie(cId, cVal) = values.find_live_device((uintptr_t)C, 1);
-
-  assert(aId && bId && cId && "Couldn't find Dgemm argument value on device");
-
-  Values::id_type newId;
-  Values::value_type newVal;
-  std::tie(newId, newVal) = values.duplicate_value(cVal);
-  newVal->add_depends_on(aId);
-  newVal->add_depends_on(bId);
-  newVal->add_depends_on(cId);
-
-  DriverState::this_thread().pause_cupti_callbacks();
-  printf("WARN: disabling CUPTI callbacks during cublasDgemm "
-         "call\n");
-
-  auto api = std::make_shared<ApiRecord>(
-      "cublasDgemm", DriverState::device_from_cublas_handle(handle));
-  api->add_output(newId);
-  api->add_input(aId);
-  api->add_input(bId);
-  api->add_input(cId);
-  APIs::record(api);
-
-  const cublasStatus_t ret = real_cublasDgemm(
-      handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
-  DriverState::this_thread().resume_cupti_callbacks();
+// Calls on the handle are ordered on streamId
+typedef cublasStatus_t (*cublasSetStreamFunc)(cublasHandle_t handle,
+                                              cudaStream_t streamId);
+extern "C" cublasStatus_t cublasSetStream(cublasHandle_t handle,
+                                          cudaStream_t streamId) {
+  V2_LD_PRELOAD_BOILERPLATE(cublasSetStream);
 
+  const cublasStatus_t ret = real_cublasSetStream(handle, streamId);
+  if (ret == CUBLAS_STATUS_SUCCESS) {
+    DriverState::track_cublas_stream(handle, streamId);
+  }
   return ret;
 }
 
-typedef cublasStatus_t (*cublasSaxpyFunc)(
-    cublasHandle_t handle, int n,
-    const float *alpha, /* host or device pointer */
-    const float *x, int incx, float *y, int incy);
-extern "C" cublasStatus_t
-cublasSaxpy(cublasHandle_t handle, int n,
-            const float *alpha, /* host or device pointer */
-            const float *x, int incx, float *y, int incy) {
-
-  V2_LD_PRELOAD_BOILERPLATE(cublasSaxpy);
-
-  auto &values = Values::instance();
-
-  // Find input values
-  Values::id_type xId, yId;
-  Values::value_type xVal, yVal;
-  std::tie(xId, xVal) = values.find_live((uintptr_t)x, AddressSpace::Cuda());
-  std::tie(yId, yVal) = values.find_live((uintptr_t)y, AddressSpace::Cuda());
-
-  assert(xId && "Couldn't find cublasSaxpy x value on device");
-
-  // Create output value
-  Values::id_type outId;
-  Values::value_type outVal;
-  std::tie(outId, outVal) = values.duplicate_value(yVal);
-  outVal->add_depends_on(xId);
-  outVal->add_depends_on(yId);
-
-  // track api
-  auto api = std::make_shared<ApiRecord>(
-      "cublasSaxpy", DriverState::device_from_cublas_handle(handle));
-  api->add_output(outId);
-  api->add_input(xId);
-  api->add_input(yId);
-  APIs::record(api);
-
-  // Do the actual call
-  printf("WARN: disabling CUPTI callbacks during cublasSaxpy call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cublasStatus_t ret =
-      real_cublasSaxpy(handle, n, alpha, x, incx, y, incy);
-  DriverState::this_thread().resume_cupti_callbacks();
-
-  return ret;
+// Each call below is generated from its operands. Sizes are the bytes spanned
+// by each operand given the call's dimensions, transposes, leading dimensions
+// and strides.
+// http://docs.nvidia.com/cuda/cublas/index.html
+
+// apiName is passed separately since cublas_v2.h renames most functions to
+// their _v2 versions
+#define CUBLAS_WRAPPER(apiName, name, params, args, ...)                       \
+  CUBLAS_OP_WRAPPER(apiName, name, params, args, OpInfo(), __VA_ARGS__)
+
+// CUBLAS_WRAPPER for calls whose OpInfo we know
+#define CUBLAS_OP_WRAPPER(apiName, name, params, args, opInfo, ...)            \
+  LIBRARY_CALL_WRAPPER(cublasStatus_t, apiName, name, params, args,            \
+                       DriverState::device_from_cublas_handle(handle),         \
+                       DriverState::stream_from_cublas_handle(handle), opInfo, \
+                       __VA_ARGS__)
+
+template <typename T> static size_t vec(int n, int inc) {
+  return blas_vector_bytes(n, inc, sizeof(T));
 }
 
-typedef cublasStatus_t (*cublasSgemmFunc)(
-    cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb,
-    int m, int n, int k, const float *alpha, /* host or device pointer */
-    const float *A, int lda, const float *B, int ldb,
-    const float *beta, /* host or device pointer */
-    float *C, int ldc);
-extern "C" cublasStatus_t
-cublasSgemm(cublasHandle_t handle, cublasOperation_t transa,
-            cublasOperation_t transb, int m, int n, int k,
-            const float *alpha, /* host or device pointer */
-            const float *A, int lda, const float *B, int ldb,
-            const float *beta, /* host or device pointer */
-            float *C, int ldc) {
-  V2_LD_PRELOAD_BOILERPLATE(cublasSgemm);
-
-  // FIXME - also depends on alpha, beta
-  // record data, we know things about how this API works
-  auto &values = Values::instance();
-
-  // Find the argument values
-  Values::id_type aId, bId, cId;
-  Values::value_type aVal, bVal, cVal;
-  std::tie(aId, aVal) = values.find_live_device((uintptr_t)A, 1);
-  std::tie(bId, bVal) = values.find_live_device((uintptr_t)B, 1);
-  std::tie(cId, cVal) = values.find_live_device((uintptr_t)C, 1);
-
-  assert(aId && bId && cId && "Couldn't find Dgemm argument value on device");
-
-  Values::id_type newId;
-  Values::value_type newVal;
-  std::tie(newId, newVal) = values.duplicate_value(cVal);
-  newVal->add_depends_on(aId);
-  newVal->add_depends_on(bId);
-  newVal->add_depends_on(cId);
-
-  DriverState::this_thread().pause_cupti_callbacks();
-  printf("WARN: disabling CUPTI callbacks during cublasSgemm "
-         "call\n");
-  const cublasStatus_t ret = real_cublasSgemm(
-      handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
-  DriverState::this_thread().resume_cupti_callbacks();
-
-  auto api = std::make_shared<ApiRecord>(
-      "cublasSgemm", DriverState::device_from_cublas_handle(handle));
-  api->add_output(newId);
-  api->add_input(aId);
-  api->add_input(bId);
-  api->add_input(cId);
-  APIs::record(api);
-
-  return ret;
+template <typename T> static size_t mat(int rows, int cols, int ld) {
+  return blas_matrix_bytes(rows, cols, ld, sizeof(T));
 }
 
-typedef cublasStatus_t (*cublasDgemvFunc)(cublasHandle_t, cublasOperation_t,
-                                          int, int, const double *,
-                                          const double *, int, const double *,
-                                          int, const double *, double *, int);
-extern "C" cublasStatus_t cublasDgemv(cublasHandle_t handle,
-                                      cublasOperation_t trans, int m, int n,
-                                      const double *alpha, const double *A,
-                                      int lda, const double *x, int incx,
-                                      const double *beta, double *y, int incy) {
-  V2_LD_PRELOAD_BOILERPLATE(cublasDgemv);
-
-  // record data, we know things about how this API works
-  auto &values = Values::instance();
-
-  // Find the argument values
-  // http://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemv
-  Values::id_type aKey, xKey, yKey;
-  Values::value_type aVal, xVal, yVal;
-  std::tie(aKey, aVal) = values.find_live_device((uintptr_t)A, 1);
-  std::tie(xKey, xVal) = values.find_live_device((uintptr_t)x, 1);
-  std::tie(yKey, yVal) = values.find_live_device((uintptr_t)y, 1);
-
-  assert(aKey && xKey && yKey &&
-         "Couldn't find Dgemv argument value on device");
-
-  // FIXME: could use these to do better on dependences
-  printf("WARN: not handling some values (A, alpha, beta)\n");
-
-  Values::id_type newId;
-  Values::value_type newVal;
-  std::tie(newId, newVal) = values.duplicate_value(yVal);
-  newVal->add_depends_on(xKey);
-  newVal->add_depends_on(yKey);
-
-  DriverState::this_thread().pause_cupti_callbacks();
-  printf("WARN: disabling CUPTI callbacks during cublasDgemv "
-         "call\n");
-  const cublasStatus_t ret = real_cublasDgemv(handle, trans, m, n, alpha, A,
-                                              lda, x, incx, beta, y, incy);
-  DriverState::this_thread().resume_cupti_callbacks();
+// A, where op(A) is rows x cols
+static size_t op_mat(cublasOperation_t trans, int rows, int cols, int ld,
+                     size_t elemSize) {
+  return trans == CUBLAS_OP_N ? blas_matrix_bytes(rows, cols, ld, elemSize)
+                              : blas_matrix_bytes(cols, rows, ld, elemSize);
+}
 
-  auto api = std::make_shared<ApiRecord>(
-      "cublasDgemv", DriverState::device_from_cublas_handle(handle));
-  api->add_output(newId);
-  api->add_input(aKey);
-  api->add_input(xKey);
-  api->add_input(yKey);
-  APIs::record(api);
+template <typename T>
+static size_t op_mat(cublasOperation_t trans, int rows, int cols, int ld) {
+  return op_mat(trans, rows, cols, ld, sizeof(T));
+}
 
-  return ret;
+// square A applied from side to an m x n matrix
+template <typename T>
+static size_t side_mat(cublasSideMode_t side, int m, int n, int ld) {
+  const int k = side == CUBLAS_SIDE_LEFT ? m : n;
+  return mat<T>(k, k, ld);
 }
 
-typedef cublasStatus_t (*cublasSgemvFunc)(cublasHandle_t handle,
-                                          cublasOperation_t trans, int m, int n,
-                                          const float *alpha, const float *A,
-                                          int lda, const float *x, int incx,
-                                          const float *beta, float *y,
-                                          int incy);
-extern "C" cublasStatus_t cublasSgemv(cublasHandle_t handle,
-                                      cublasOperation_t trans, int m, int n,
-                                      const float *alpha, const float *A,
-                                      int lda, const float *x, int incx,
-                                      const float *beta, float *y, int incy) {
-  V2_LD_PRELOAD_BOILERPLATE(cublasSgemv);
-
-  // record data, we know things about how this API works
-  auto &values = Values::instance();
-
-  // Find the argument values
-  // http://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemv
-  Values::id_type aKey, xKey, yKey;
-  Values::value_type aVal, xVal, yVal;
-  std::tie(aKey, aVal) = values.find_live_device((uintptr_t)A, 1);
-  std::tie(xKey, xVal) = values.find_live_device((uintptr_t)x, 1);
-  std::tie(yKey, yVal) = values.find_live_device((uintptr_t)y, 1);
-
-  assert(aKey && xKey && yKey &&
-         "Couldn't find cublasSgemv argument value on device");
-
-  // FIXME: could use these to do better on dependences
-  printf("WARN: not handling some values (A, alpha, beta)\n");
-
-  Values::id_type newId;
-  Values::value_type newVal;
-  std::tie(newId, newVal) = values.duplicate_value(yVal);
-  newVal->add_depends_on(xKey);
-  newVal->add_depends_on(yKey);
+// packed triangle of an n x n matrix
+template <typename T> static size_t packed(int n) {
+  return n > 0 ? size_t(n) * size_t(n + 1) / 2 * sizeof(T) : 0;
+}
 
-  DriverState::this_thread().pause_cupti_callbacks();
-  printf("WARN: disabling CUPTI callbacks during cublasSgemv "
-         "call\n");
-  const cublasStatus_t ret = real_cublasSgemv(handle, trans, m, n, alpha, A,
-                                              lda, x, incx, beta, y, incy);
-  DriverState::this_thread().resume_cupti_callbacks();
+// Element type names, and real flops per multiply-add, by pointer type
+static const char *dtype(const float *) { return "f32"; }
+static const char *dtype(const double *) { return "f64"; }
+static const char *dtype(const cuComplex *) { return "c32"; }
+static const char *dtype(const cuDoubleComplex *) { return "c64"; }
+static uint64_t fma_flops(const float *) { return 2; }
+static uint64_t fma_flops(const double *) { return 2; }
+static uint64_t fma_flops(const cuComplex *) { return 8; }
+static uint64_t fma_flops(const cuDoubleComplex *) { return 8; }
+
+// batchCount GEMMs of m x n x k, each m * n * k multiply-adds. shape is
+// {m, n, k, batchCount}.
+static OpInfo gemm_op(const char *dtypeName, uint64_t fmaFlops, int m, int n,
+                      int k, int batchCount) {
+  const uint64_t flops =
+      m > 0 && n > 0 && k > 0 && batchCount > 0
+          ? fmaFlops * uint64_t(m) * uint64_t(n) * uint64_t(k) * batchCount
+          : 0;
+  return OpInfo("gemm", {m, n, k, batchCount}, dtypeName, flops);
+}
 
-  auto api = std::make_shared<ApiRecord>(
-      "cublasSgemv", DriverState::device_from_cublas_handle(handle));
-  api->add_output(newId);
-  api->add_input(aKey);
-  api->add_input(xKey);
-  api->add_input(yKey);
-  APIs::record(api);
+template <typename T>
+static OpInfo gemm_op(int m, int n, int k, int batchCount) {
+  const T *none = nullptr;
+  return gemm_op(dtype(none), fma_flops(none), m, n, k, batchCount);
+}
 
-  return ret;
+// Ex calls name the type of A and multiply-add in computeType
+static OpInfo gemm_op(cudaDataType Atype, cudaDataType computeType, int m,
+                      int n, int k, int batchCount) {
+  return gemm_op(cuda_data_type_name(Atype),
+                 cuda_data_type_is_complex(computeType) ? 8 : 2, m, n, k,
+                 batchCount);
 }
 
-typedef cublasStatus_t (*cublasSasumFunc)(cublasHandle_t, int, const float *,
-                                          int, float *);
-extern "C" cublasStatus_t cublasSasum(cublasHandle_t handle, int n,
-                                      const float *x, int incx, float *result) {
-  V2_LD_PRELOAD_BOILERPLATE(cublasSasum);
-
-  // record data, we know things about how this API works
-  auto &values = Values::instance();
-  auto &allocations = Allocations::instance();
-
-  // Find the argument values
-  // http://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemv
-  Values::id_type xId;
-  std::tie(xId, std::ignore) =
-      values.find_live((uintptr_t)x, AddressSpace::Cuda());
-  assert(xId && "Couldn't find Sasum x argument value on device");
-
-  // see if we can find an allocation for the result
-  Allocations::id_type rAllocId;
-  std::tie(rAllocId, std::ignore) = allocations.find_live(
-      (uintptr_t)result, sizeof(float), AddressSpace::Cuda());
-
-  if (!rAllocId) {
-    // FIXME - can we do a better job with some parameters here
-    Memory AM(Memory::Unknown);
-    std::tie(rAllocId, std::ignore) = allocations.new_allocation(
-        (uintptr_t)result, sizeof(float), AddressSpace::Cuda(), AM,
-        AllocationRecord::PageType::Unknown);
-    printf("WARN: new allocId=%lu for result=%lu\n", rAllocId,
-           (uintptr_t)result);
+// Level 1
+
+// The scalar result of a reduction is only device memory in device pointer
+// mode. In the default host mode it is a host pointer, often to the stack, and
+// not an operand. cuBLAS is looked up like the wrapped functions, since the
+// profiler doesn't link it.
+typedef cublasStatus_t (*cublasGetPointerModeFunc)(cublasHandle_t handle,
+                                                   cublasPointerMode_t *mode);
+static Operand result_op(cublasHandle_t handle, const void *ptr,
+                         size_t bytes) {
+  static const auto getPointerMode =
+      (cublasGetPointerModeFunc)dlsym(RTLD_NEXT, "cublasGetPointerMode_v2");
+  cublasPointerMode_t mode = CUBLAS_POINTER_MODE_HOST;
+  if (!getPointerMode ||
+      getPointerMode(handle, &mode) != CUBLAS_STATUS_SUCCESS ||
+      mode != CUBLAS_POINTER_MODE_DEVICE) {
+    ptr = nullptr;
   }
-  assert(rAllocId && "If there is no allocation, we need to make one");
-
-  // Make a new value
-  Values::id_type rId;
-  Values::value_type rVal;
-  std::tie(rId, rVal) =
-      values.new_value((uintptr_t)result, sizeof(float), rAllocId);
-  rVal->add_depends_on(xId);
-
-  auto api = std::make_shared<ApiRecord>(
-      "cublasSasum", DriverState::device_from_cublas_handle(handle));
-  api->add_output(rId);
-  api->add_input(xId);
-  APIs::record(api);
-
-  DriverState::this_thread().pause_cupti_callbacks();
-  printf("WARN: tid=%d disabling CUPTI callbacks during cublasSasum call\n",
-         get_thread_id());
-  const cublasStatus_t ret = real_cublasSasum(handle, n, x, incx, result);
-  DriverState::this_thread().resume_cupti_callbacks();
-  return ret;
+  return op::out(ptr, bytes);
 }
 
-typedef cublasStatus_t (*cublasSscalFunc)(
-    cublasHandle_t handle, int n,
-    const float *alpha, /* host or device pointer */
-    float *x, int incx);
-extern "C" cublasStatus_t
-cublasSscal(cublasHandle_t handle, int n,
-            const float *alpha, /* host or device pointer */
-            float *x, int incx) {
-  V2_LD_PRELOAD_BOILERPLATE(cublasSscal);
-
-  auto &values = Values::instance();
-
-  // Find input values
-  Values::id_type xId, outId;
-  Values::value_type xVal, outVal;
-  std::tie(xId, xVal) = values.find_live((uintptr_t)x, AddressSpace::Cuda());
-  assert(xId && "Couldn't find cublasSscal x value on device");
-
-  // Create output value
-  std::tie(outId, outVal) = values.duplicate_value(xVal);
-  outVal->add_depends_on(xId);
-
-  // track api
-  auto api = std::make_shared<ApiRecord>(
-      "cublasSscal", DriverState::device_from_cublas_handle(handle));
-  api->add_output(outId);
-  api->add_input(xId);
-  APIs::record(api);
-
-  // Do the actual call
-  printf("WARN: disabling CUPTI callbacks during cublasSscal call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cublasStatus_t ret = real_cublasSscal(handle, n, alpha, x, incx);
-  DriverState::this_thread().resume_cupti_callbacks();
-
-  return ret;
+#define AMAX(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, const T *x, int incx,          \
+                  int *result), (handle, n, x, incx, result),                  \
+                 op::in(x, vec<T>(n, incx)),                                   \
+                 result_op(handle, result, sizeof(int)))
+AMAX(cublasIsamax, float)
+AMAX(cublasIdamax, double)
+AMAX(cublasIcamax, cuComplex)
+AMAX(cublasIzamax, cuDoubleComplex)
+AMAX(cublasIsamin, float)
+AMAX(cublasIdamin, double)
+AMAX(cublasIcamin, cuComplex)
+AMAX(cublasIzamin, cuDoubleComplex)
+
+// result is real (R) for complex x
+#define ASUM(name, T, R)                                                       \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, const T *x, int incx,          \
+                  R *result), (handle, n, x, incx, result),                    \
+                 op::in(x, vec<T>(n, incx)),                                   \
+                 result_op(handle, result, sizeof(R)))
+ASUM(cublasSasum, float, float)
+ASUM(cublasDasum, double, double)
+ASUM(cublasScasum, cuComplex, float)
+ASUM(cublasDzasum, cuDoubleComplex, double)
+ASUM(cublasSnrm2, float, float)
+ASUM(cublasDnrm2, double, double)
+ASUM(cublasScnrm2, cuComplex, float)
+ASUM(cublasDznrm2, cuDoubleComplex, double)
+
+#define AXPY(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, const T *alpha, const T *x,    \
+                  int incx, T *y, int incy),                                   \
+                 (handle, n, alpha, x, incx, y, incy),                         \
+                 op::in(x, vec<T>(n, incx)), op::inout(y, vec<T>(n, incy)))
+AXPY(cublasSaxpy, float)
+AXPY(cublasDaxpy, double)
+AXPY(cublasCaxpy, cuComplex)
+AXPY(cublasZaxpy, cuDoubleComplex)
+
+#define COPY(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, const T *x, int incx, T *y,    \
+                  int incy), (handle, n, x, incx, y, incy),                    \
+                 op::in(x, vec<T>(n, incx)), op::out(y, vec<T>(n, incy)))
+COPY(cublasScopy, float)
+COPY(cublasDcopy, double)
+COPY(cublasCcopy, cuComplex)
+COPY(cublasZcopy, cuDoubleComplex)
+
+#define DOT(name, T)                                                           \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, const T *x, int incx,          \
+                  const T *y, int incy, T *result),                            \
+                 (handle, n, x, incx, y, incy, result),                        \
+                 op::in(x, vec<T>(n, incx)), op::in(y, vec<T>(n, incy)),       \
+                 result_op(handle, result, sizeof(T)))
+DOT(cublasSdot, float)
+DOT(cublasDdot, double)
+DOT(cublasCdotu, cuComplex)
+DOT(cublasCdotc, cuComplex)
+DOT(cublasZdotu, cuDoubleComplex)
+DOT(cublasZdotc, cuDoubleComplex)
+
+// c is real (R) for complex x and y
+#define ROT(name, T, R)                                                        \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, T *x, int incx, T *y,          \
+                  int incy, const R *c, const T *s),                           \
+                 (handle, n, x, incx, y, incy, c, s),                          \
+                 op::inout(x, vec<T>(n, incx)), op::inout(y, vec<T>(n, incy)))
+ROT(cublasSrot, float, float)
+ROT(cublasDrot, double, double)
+ROT(cublasCrot, cuComplex, float)
+ROT(cublasZrot, cuDoubleComplex, double)
+
+// alpha is A
+#define SCAL(name, T, A)                                                       \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, const A *alpha, T *x,          \
+                  int incx), (handle, n, alpha, x, incx),                      \
+                 op::inout(x, vec<T>(n, incx)))
+SCAL(cublasSscal, float, float)
+SCAL(cublasDscal, double, double)
+SCAL(cublasCscal, cuComplex, cuComplex)
+SCAL(cublasZscal, cuDoubleComplex, cuDoubleComplex)
+SCAL(cublasCsscal, cuComplex, float)
+SCAL(cublasZdscal, cuDoubleComplex, double)
+
+#define SWAP(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int n, T *x, int incx, T *y,          \
+                  int incy), (handle, n, x, incx, y, incy),                    \
+                 op::inout(x, vec<T>(n, incx)), op::inout(y, vec<T>(n, incy)))
+SWAP(cublasSswap, float)
+SWAP(cublasDswap, double)
+SWAP(cublasCswap, cuComplex)
+SWAP(cublasZswap, cuDoubleComplex)
+
+// Level 2
+
+// A is m x n, x and y are n and m long (m and n if transposed)
+#define GEMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasOperation_t trans, int m,       \
+                  int n, const T *alpha, const T *A, int lda, const T *x,      \
+                  int incx, const T *beta, T *y, int incy),                    \
+                 (handle, trans, m, n, alpha, A, lda, x, incx, beta, y, incy), \
+                 op::in(A, mat<T>(m, n, lda)),                                 \
+                 op::in(x, vec<T>(trans == CUBLAS_OP_N ? n : m, incx)),        \
+                 op::inout(y, vec<T>(trans == CUBLAS_OP_N ? m : n, incy)))
+GEMV(cublasSgemv, float)
+GEMV(cublasDgemv, double)
+GEMV(cublasCgemv, cuComplex)
+GEMV(cublasZgemv, cuDoubleComplex)
+
+// banded A is stored as kl + ku + 1 rows of n columns
+#define GBMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasOperation_t trans, int m,       \
+                  int n, int kl, int ku, const T *alpha, const T *A, int lda,  \
+                  const T *x, int incx, const T *beta, T *y, int incy),        \
+                 (handle, trans, m, n, kl, ku, alpha, A, lda, x, incx, beta,   \
+                  y, incy), op::in(A, mat<T>(kl + ku + 1, n, lda)),            \
+                 op::in(x, vec<T>(trans == CUBLAS_OP_N ? n : m, incx)),        \
+                 op::inout(y, vec<T>(trans == CUBLAS_OP_N ? m : n, incy)))
+GBMV(cublasSgbmv, float)
+GBMV(cublasDgbmv, double)
+GBMV(cublasCgbmv, cuComplex)
+GBMV(cublasZgbmv, cuDoubleComplex)
+
+#define GER(name, T)                                                           \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, int m, int n, const T *alpha,         \
+                  const T *x, int incx, const T *y, int incy, T *A, int lda),  \
+                 (handle, m, n, alpha, x, incx, y, incy, A, lda),              \
+                 op::in(x, vec<T>(m, incx)), op::in(y, vec<T>(n, incy)),       \
+                 op::inout(A, mat<T>(m, n, lda)))
+GER(cublasSger, float)
+GER(cublasDger, double)
+GER(cublasCgeru, cuComplex)
+GER(cublasCgerc, cuComplex)
+GER(cublasZgeru, cuDoubleComplex)
+GER(cublasZgerc, cuDoubleComplex)
+
+#define SYMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n,         \
+                  const T *alpha, const T *A, int lda, const T *x, int incx,   \
+                  const T *beta, T *y, int incy),                              \
+                 (handle, uplo, n, alpha, A, lda, x, incx, beta, y, incy),     \
+                 op::in(A, mat<T>(n, n, lda)), op::in(x, vec<T>(n, incx)),     \
+                 op::inout(y, vec<T>(n, incy)))
+SYMV(cublasSsymv, float)
+SYMV(cublasDsymv, double)
+SYMV(cublasCsymv, cuComplex)
+SYMV(cublasZsymv, cuDoubleComplex)
+SYMV(cublasChemv, cuComplex)
+SYMV(cublasZhemv, cuDoubleComplex)
+
+// banded A is stored as k + 1 rows of n columns
+#define SBMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n, int k,  \
+                  const T *alpha, const T *A, int lda, const T *x, int incx,   \
+                  const T *beta, T *y, int incy),                              \
+                 (handle, uplo, n, k, alpha, A, lda, x, incx, beta, y, incy),  \
+                 op::in(A, mat<T>(k + 1, n, lda)), op::in(x, vec<T>(n, incx)), \
+                 op::inout(y, vec<T>(n, incy)))
+SBMV(cublasSsbmv, float)
+SBMV(cublasDsbmv, double)
+SBMV(cublasChbmv, cuComplex)
+SBMV(cublasZhbmv, cuDoubleComplex)
+
+#define SPMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n,         \
+                  const T *alpha, const T *AP, const T *x, int incx,           \
+                  const T *beta, T *y, int incy),                              \
+                 (handle, uplo, n, alpha, AP, x, incx, beta, y, incy),         \
+                 op::in(AP, packed<T>(n)), op::in(x, vec<T>(n, incx)),         \
+                 op::inout(y, vec<T>(n, incy)))
+SPMV(cublasSspmv, float)
+SPMV(cublasDspmv, double)
+SPMV(cublasChpmv, cuComplex)
+SPMV(cublasZhpmv, cuDoubleComplex)
+
+// alpha is real (R) for the Hermitian variants
+#define SYR(name, T, R)                                                        \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n,         \
+                  const R *alpha, const T *x, int incx, T *A, int lda),        \
+                 (handle, uplo, n, alpha, x, incx, A, lda),                    \
+                 op::in(x, vec<T>(n, incx)), op::inout(A, mat<T>(n, n, lda)))
+SYR(cublasSsyr, float, float)
+SYR(cublasDsyr, double, double)
+SYR(cublasCsyr, cuComplex, cuComplex)
+SYR(cublasZsyr, cuDoubleComplex, cuDoubleComplex)
+SYR(cublasCher, cuComplex, float)
+SYR(cublasZher, cuDoubleComplex, double)
+
+#define SYR2(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n,         \
+                  const T *alpha, const T *x, int incx, const T *y, int incy,  \
+                  T *A, int lda),                                              \
+                 (handle, uplo, n, alpha, x, incx, y, incy, A, lda),           \
+                 op::in(x, vec<T>(n, incx)), op::in(y, vec<T>(n, incy)),       \
+                 op::inout(A, mat<T>(n, n, lda)))
+SYR2(cublasSsyr2, float)
+SYR2(cublasDsyr2, double)
+SYR2(cublasCsyr2, cuComplex)
+SYR2(cublasZsyr2, cuDoubleComplex)
+SYR2(cublasCher2, cuComplex)
+SYR2(cublasZher2, cuDoubleComplex)
+
+#define SPR(name, T, R)                                                        \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n,         \
+                  const R *alpha, const T *x, int incx, T *AP),                \
+                 (handle, uplo, n, alpha, x, incx, AP),                        \
+                 op::in(x, vec<T>(n, incx)), op::inout(AP, packed<T>(n)))
+SPR(cublasSspr, float, float)
+SPR(cublasDspr, double, double)
+SPR(cublasChpr, cuComplex, float)
+SPR(cublasZhpr, cuDoubleComplex, double)
+
+#define SPR2(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo, int n,         \
+                  const T *alpha, const T *x, int incx, const T *y, int incy,  \
+                  T *AP), (handle, uplo, n, alpha, x, incx, y, incy, AP),      \
+                 op::in(x, vec<T>(n, incx)), op::in(y, vec<T>(n, incy)),       \
+                 op::inout(AP, packed<T>(n)))
+SPR2(cublasSspr2, float)
+SPR2(cublasDspr2, double)
+SPR2(cublasChpr2, cuComplex)
+SPR2(cublasZhpr2, cuDoubleComplex)
+
+// triangular multiply and solve, in place in x
+#define TRMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo,                \
+                  cublasOperation_t trans, cublasDiagType_t diag, int n,       \
+                  const T *A, int lda, T *x, int incx),                        \
+                 (handle, uplo, trans, diag, n, A, lda, x, incx),              \
+                 op::in(A, mat<T>(n, n, lda)), op::inout(x, vec<T>(n, incx)))
+TRMV(cublasStrmv, float)
+TRMV(cublasDtrmv, double)
+TRMV(cublasCtrmv, cuComplex)
+TRMV(cublasZtrmv, cuDoubleComplex)
+TRMV(cublasStrsv, float)
+TRMV(cublasDtrsv, double)
+TRMV(cublasCtrsv, cuComplex)
+TRMV(cublasZtrsv, cuDoubleComplex)
+
+#define TBMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo,                \
+                  cublasOperation_t trans, cublasDiagType_t diag, int n,       \
+                  int k, const T *A, int lda, T *x, int incx),                 \
+                 (handle, uplo, trans, diag, n, k, A, lda, x, incx),           \
+                 op::in(A, mat<T>(k + 1, n, lda)),                             \
+                 op::inout(x, vec<T>(n, incx)))
+TBMV(cublasStbmv, float)
+TBMV(cublasDtbmv, double)
+TBMV(cublasCtbmv, cuComplex)
+TBMV(cublasZtbmv, cuDoubleComplex)
+TBMV(cublasStbsv, float)
+TBMV(cublasDtbsv, double)
+TBMV(cublasCtbsv, cuComplex)
+TBMV(cublasZtbsv, cuDoubleComplex)
+
+#define TPMV(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo,                \
+                  cublasOperation_t trans, cublasDiagType_t diag, int n,       \
+                  const T *AP, T *x, int incx),                                \
+                 (handle, uplo, trans, diag, n, AP, x, incx),                  \
+                 op::in(AP, packed<T>(n)), op::inout(x, vec<T>(n, incx)))
+TPMV(cublasStpmv, float)
+TPMV(cublasDtpmv, double)
+TPMV(cublasCtpmv, cuComplex)
+TPMV(cublasZtpmv, cuDoubleComplex)
+TPMV(cublasStpsv, float)
+TPMV(cublasDtpsv, double)
+TPMV(cublasCtpsv, cuComplex)
+TPMV(cublasZtpsv, cuDoubleComplex)
+
+// Level 3
+
+// op(A) is m x k, op(B) is k x n, C is m x n
+#define GEMM(name, T)                                                          \
+  CUBLAS_OP_WRAPPER(#name, name,                                               \
+                    (cublasHandle_t handle, cublasOperation_t transa,          \
+                     cublasOperation_t transb, int m, int n, int k,            \
+                     const T *alpha, const T *A, int lda, const T *B, int ldb, \
+                     const T *beta, T *C, int ldc),                            \
+                    (handle, transa, transb, m, n, k, alpha, A, lda, B, ldb,   \
+                     beta, C, ldc), gemm_op<T>(m, n, k, 1),                    \
+                    op::in(A, op_mat<T>(transa, m, k, lda)),                   \
+                    op::in(B, op_mat<T>(transb, k, n, ldb)),                   \
+                    op::inout(C, mat<T>(m, n, ldc)))
+GEMM(cublasSgemm, float)
+GEMM(cublasDgemm, double)
+GEMM(cublasCgemm, cuComplex)
+GEMM(cublasZgemm, cuDoubleComplex)
+
+#define SYMM(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasSideMode_t side,                \
+                  cublasFillMode_t uplo, int m, int n, const T *alpha,         \
+                  const T *A, int lda, const T *B, int ldb, const T *beta,     \
+                  T *C, int ldc),                                              \
+                 (handle, side, uplo, m, n, alpha, A, lda, B, ldb, beta, C,    \
+                  ldc), op::in(A, side_mat<T>(side, m, n, lda)),               \
+                 op::in(B, mat<T>(m, n, ldb)),                                 \
+                 op::inout(C, mat<T>(m, n, ldc)))
+SYMM(cublasSsymm, float)
+SYMM(cublasDsymm, double)
+SYMM(cublasCsymm, cuComplex)
+SYMM(cublasZsymm, cuDoubleComplex)
+SYMM(cublasChemm, cuComplex)
+SYMM(cublasZhemm, cuDoubleComplex)
+
+// op(A) is n x k, C is n x n. alpha and beta are real (R) for herk.
+#define SYRK(name, T, R)                                                       \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo,                \
+                  cublasOperation_t trans, int n, int k, const R *alpha,       \
+                  const T *A, int lda, const R *beta, T *C, int ldc),          \
+                 (handle, uplo, trans, n, k, alpha, A, lda, beta, C, ldc),     \
+                 op::in(A, op_mat<T>(trans, n, k, lda)),                       \
+                 op::inout(C, mat<T>(n, n, ldc)))
+SYRK(cublasSsyrk, float, float)
+SYRK(cublasDsyrk, double, double)
+SYRK(cublasCsyrk, cuComplex, cuComplex)
+SYRK(cublasZsyrk, cuDoubleComplex, cuDoubleComplex)
+SYRK(cublasCherk, cuComplex, float)
+SYRK(cublasZherk, cuDoubleComplex, double)
+
+// beta is real (R) for her2k
+#define SYR2K(name, T, R)                                                      \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasFillMode_t uplo,                \
+                  cublasOperation_t trans, int n, int k, const T *alpha,       \
+                  const T *A, int lda, const T *B, int ldb, const R *beta,     \
+                  T *C, int ldc),                                              \
+                 (handle, uplo, trans, n, k, alpha, A, lda, B, ldb, beta, C,   \
+                  ldc), op::in(A, op_mat<T>(trans, n, k, lda)),                \
+                 op::in(B, op_mat<T>(trans, n, k, ldb)),                       \
+                 op::inout(C, mat<T>(n, n, ldc)))
+SYR2K(cublasSsyr2k, float, float)
+SYR2K(cublasDsyr2k, double, double)
+SYR2K(cublasCsyr2k, cuComplex, cuComplex)
+SYR2K(cublasZsyr2k, cuDoubleComplex, cuDoubleComplex)
+SYR2K(cublasCher2k, cuComplex, float)
+SYR2K(cublasZher2k, cuDoubleComplex, double)
+
+// out of place: reads B and writes C
+#define TRMM(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasSideMode_t side,                \
+                  cublasFillMode_t uplo, cublasOperation_t trans,              \
+                  cublasDiagType_t diag, int m, int n, const T *alpha,         \
+                  const T *A, int lda, const T *B, int ldb, T *C, int ldc),    \
+                 (handle, side, uplo, trans, diag, m, n, alpha, A, lda, B,     \
+                  ldb, C, ldc), op::in(A, side_mat<T>(side, m, n, lda)),       \
+                 op::in(B, mat<T>(m, n, ldb)), op::out(C, mat<T>(m, n, ldc)))
+TRMM(cublasStrmm, float)
+TRMM(cublasDtrmm, double)
+TRMM(cublasCtrmm, cuComplex)
+TRMM(cublasZtrmm, cuDoubleComplex)
+
+// in place in B
+#define TRSM(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasSideMode_t side,                \
+                  cublasFillMode_t uplo, cublasOperation_t trans,              \
+                  cublasDiagType_t diag, int m, int n, const T *alpha,         \
+                  const T *A, int lda, T *B, int ldb),                         \
+                 (handle, side, uplo, trans, diag, m, n, alpha, A, lda, B,     \
+                  ldb), op::in(A, side_mat<T>(side, m, n, lda)),               \
+                 op::inout(B, mat<T>(m, n, ldb)))
+TRSM(cublasStrsm, float)
+TRSM(cublasDtrsm, double)
+TRSM(cublasCtrsm, cuComplex)
+TRSM(cublasZtrsm, cuDoubleComplex)
+
+// op(A), op(B), and C are m x n
+#define GEAM(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasOperation_t transa,             \
+                  cublasOperation_t transb, int m, int n, const T *alpha,      \
+                  const T *A, int lda, const T *beta, const T *B, int ldb,     \
+                  T *C, int ldc),                                              \
+                 (handle, transa, transb, m, n, alpha, A, lda, beta, B, ldb,   \
+                  C, ldc), op::in(A, op_mat<T>(transa, m, n, lda)),            \
+                 op::in(B, op_mat<T>(transb, m, n, ldb)),                      \
+                 op::out(C, mat<T>(m, n, ldc)))
+GEAM(cublasSgeam, float)
+GEAM(cublasDgeam, double)
+GEAM(cublasCgeam, cuComplex)
+GEAM(cublasZgeam, cuDoubleComplex)
+
+// x is m long if applied from the left, n from the right
+#define DGMM(name, T)                                                          \
+  CUBLAS_WRAPPER(#name, name,                                                  \
+                 (cublasHandle_t handle, cublasSideMode_t mode, int m, int n,  \
+                  const T *A, int lda, const T *x, int incx, T *C, int ldc),   \
+                 (handle, mode, m, n, A, lda, x, incx, C, ldc),                \
+                 op::in(A, mat<T>(m, n, lda)),                                 \
+                 op::in(x, vec<T>(mode == CUBLAS_SIDE_LEFT ? m : n, incx)),    \
+                 op::out(C, mat<T>(m, n, ldc)))
+DGMM(cublasSdgmm, float)
+DGMM(cublasDdgmm, double)
+DGMM(cublasCdgmm, cuComplex)
+DGMM(cublasZdgmm, cuDoubleComplex)
+
+// Batched GEMM
+
+// Blocks of a strided batch: batchCount blocks stride elements apart, or one
+// block if every batch shares it (stride 0)
+static size_t batches(long long stride, int batchCount) {
+  return stride > 0 && batchCount > 0 ? batchCount : 1;
 }
 
-typedef cublasStatus_t (*cublasSdotFunc)(cublasHandle_t handle, int n,
-                                         const float *x, int incx,
-                                         const float *y, int incy,
-                                         float *result);
-extern "C" cublasStatus_t cublasSdot(cublasHandle_t handle, int n,
-                                     const float *x, int incx, const float *y,
-                                     int incy, float *result) {
-
-  V2_LD_PRELOAD_BOILERPLATE(cublasSdot);
-
-  // record data, we know things about how this API works
-  auto &values = Values::instance();
-  auto &allocations = Allocations::instance();
-
-  // Find the argument values
-  // http://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemv
-  Values::id_type xId, yId;
-  printf("Looking for x=%lu\n", (uintptr_t)x);
-  std::tie(xId, std::ignore) =
-      values.find_live((uintptr_t)x, AddressSpace::Cuda());
-  assert(xId && "Couldn't find cublasSdot x argument value on device");
-  std::tie(yId, std::ignore) =
-      values.find_live((uintptr_t)y, AddressSpace::Cuda());
-  assert(yId && "Couldn't find cublasSdot y argument value on device");
-
-  // see if we can find an allocation for the result
-  printf("Looking for allocation result=%lu\n", (uintptr_t)result);
-  Allocations::id_type rAllocId;
-  std::tie(rAllocId, std::ignore) = allocations.find_live(
-      (uintptr_t)result, sizeof(float), AddressSpace::Cuda());
-
-  if (rAllocId == Allocations::noid) {
-    printf("WARN: creating implicit allocation for cublasSdot result\n");
-    Memory AM = Memory(Memory::Unknown);
-    auto pair = allocations.insert(std::shared_ptr<AllocationRecord>(
-        new AllocationRecord((uintptr_t)result, sizeof(float),
-                             AddressSpace::Cuda(), AM,
-                             AllocationRecord::PageType::Unknown)));
-    assert(pair.second);
-    rAllocId = pair.first->first;
+// The device pointers in each of a batched call's device arrays of batchCount
+// pointers, empty for a null array. They are copied to the host on the call's
+// stream, after any work that fills the arrays, and only that stream is
+// synchronized.
+static std::vector<std::vector<const void *>>
+batch_pointers(const std::vector<const void *const *> &arrays, int batchCount,
+               cudaStream_t stream) {
+  std::vector<std::vector<const void *>> ptrs(arrays.size());
+  if (batchCount <= 0) {
+    return ptrs;
   }
-  printf("result allocId=%lu\n", rAllocId);
-  // Make a new value
-  Values::id_type rId;
-  Values::value_type rVal;
-  std::tie(rId, rVal) =
-      values.new_value((uintptr_t)result, sizeof(float), rAllocId);
-  rVal->add_depends_on(xId);
-  rVal->add_depends_on(yId);
-
-  auto api = std::make_shared<ApiRecord>(
-      "cublasSdot", DriverState::device_from_cublas_handle(handle));
-  api->add_output(rId);
-  api->add_input(xId);
-  api->add_input(yId);
-  APIs::record(api);
 
   DriverState::this_thread().pause_cupti_callbacks();
-  printf("WARN: disabling CUPTI callbacks during cublasSdot call\n");
-  const cublasStatus_t ret =
-      real_cublasSdot(handle, n, x, incx, y, incy, result);
+  cudaError_t err = cudaSuccess;
+  for (size_t i = 0; i < arrays.size() && err == cudaSuccess; ++i) {
+    if (arrays[i]) {
+      ptrs[i].resize(batchCount);
+      err = cudaMemcpyAsync(ptrs[i].data(), arrays[i],
+                            ptrs[i].size() * sizeof(void *),
+                            cudaMemcpyDeviceToHost, stream);
+    }
+  }
+  if (err == cudaSuccess) {
+    err = cudaStreamSynchronize(stream);
+  }
   DriverState::this_thread().resume_cupti_callbacks();
-  return ret;
+
+  if (err != cudaSuccess) {
+    printf("WARN: couldn't read %d batch pointers: %s\n", batchCount,
+           cudaGetErrorString(err));
+    for (auto &p : ptrs) {
+      p.clear();
+    }
+  }
+  return ptrs;
 }
+
+// op(A[i]) is m x k, op(B[i]) is k x n, C[i] is m x n. The matrices of each
+// are a scattered operand, along with the pointer arrays the call reads them
+// through.
+static std::vector<Operand>
+gemm_batched_operands(cublasOperation_t transa, cublasOperation_t transb,
+                      int m, int n, int k, const void *const Aarray[],
+                      size_t aSize, int lda, const void *const Barray[],
+                      size_t bSize, int ldb, const void *const Carray[],
+                      size_t cSize, int ldc, int batchCount,
+                      cudaStream_t stream) {
+  const size_t arrayBytes = size_t(batchCount > 0 ? batchCount : 0) *
+                            sizeof(void *);
+  const auto ptrs =
+      batch_pointers({Aarray, Barray, Carray}, batchCount, stream);
+  return std::vector<Operand>{
+      op::in(Aarray, arrayBytes),
+      op::in(Barray, arrayBytes),
+      op::in(Carray, arrayBytes),
+      op::in(ptrs[0], op_mat(transa, m, k, lda, aSize)),
+      op::in(ptrs[1], op_mat(transb, k, n, ldb, bSize)),
+      op::inout(ptrs[2], blas_matrix_bytes(m, n, ldc, cSize))};
+}
+
+#define GEMM_BATCHED(name, T)                                                  \
+  LIBRARY_CALL_WRAPPER_OPERANDS(                                               \
+      cublasStatus_t, #name, name,                                             \
+      (cublasHandle_t handle, cublasOperation_t transa,                        \
+       cublasOperation_t transb, int m, int n, int k, const T *alpha,          \
+       const T *const Aarray[], int lda, const T *const Barray[], int ldb,     \
+       const T *beta, T *const Carray[], int ldc, int batchCount),             \
+      (handle, transa, transb, m, n, k, alpha, Aarray, lda, Barray, ldb, beta, \
+       Carray, ldc, batchCount),                                               \
+      DriverState::device_from_cublas_handle(handle),                          \
+      DriverState::stream_from_cublas_handle(handle),                          \
+      gemm_op<T>(m, n, k, batchCount),                                         \
+      gemm_batched_operands(transa, transb, m, n, k,                           \
+                            (const void *const *)Aarray, sizeof(T), lda,       \
+                            (const void *const *)Barray, sizeof(T), ldb,       \
+                            (const void *const *)Carray, sizeof(T), ldc,       \
+                            batchCount,                                        \
+                            DriverState::stream_from_cublas_handle(handle)))
+GEMM_BATCHED(cublasSgemmBatched, float)
+GEMM_BATCHED(cublasDgemmBatched, double)
+GEMM_BATCHED(cublasCgemmBatched, cuComplex)
+GEMM_BATCHED(cublasZgemmBatched, cuDoubleComplex)
+
+// Each of A, B and C is a single strided operand
+#define GEMM_STRIDED_BATCHED(name, T)                                          \
+  CUBLAS_OP_WRAPPER(                                                           \
+      #name, name,                                                             \
+      (cublasHandle_t handle, cublasOperation_t transa,                        \
+       cublasOperation_t transb, int m, int n, int k, const T *alpha,          \
+       const T *A, int lda, long long int strideA, const T *B, int ldb,        \
+       long long int strideB, const T *beta, T *C, int ldc,                    \
+       long long int strideC, int batchCount),                                 \
+      (handle, transa, transb, m, n, k, alpha, A, lda, strideA, B, ldb,        \
+       strideB, beta, C, ldc, strideC, batchCount),                            \
+      gemm_op<T>(m, n, k, batchCount),                                         \
+      op::in(A, op_mat<T>(transa, m, k, lda), strideA * sizeof(T),             \
+             batches(strideA, batchCount)),                                    \
+      op::in(B, op_mat<T>(transb, k, n, ldb), strideB * sizeof(T),             \
+             batches(strideB, batchCount)),                                    \
+      op::inout(C, mat<T>(m, n, ldc), strideC * sizeof(T),                     \
+                batches(strideC, batchCount)))
+GEMM_STRIDED_BATCHED(cublasSgemmStridedBatched, float)
+GEMM_STRIDED_BATCHED(cublasDgemmStridedBatched, double)
+GEMM_STRIDED_BATCHED(cublasCgemmStridedBatched, cuComplex)
+GEMM_STRIDED_BATCHED(cublasZgemmStridedBatched, cuDoubleComplex)
+
+// Mixed precision GEMM: element sizes come from each matrix's data type
+
+CUBLAS_OP_WRAPPER(
+    "cublasGemmEx", cublasGemmEx,
+    (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb,
+     int m, int n, int k, const void *alpha, const void *A, cudaDataType Atype,
+     int lda, const void *B, cudaDataType Btype, int ldb, const void *beta,
+     void *C, cudaDataType Ctype, int ldc, cudaDataType computeType,
+     cublasGemmAlgo_t algo),
+    (handle, transa, transb, m, n, k, alpha, A, Atype, lda, B, Btype, ldb,
+     beta, C, Ctype, ldc, computeType, algo),
+    gemm_op(Atype, computeType, m, n, k, 1),
+    op::in(A, op_mat(transa, m, k, lda, cuda_data_type_size(Atype))),
+    op::in(B, op_mat(transb, k, n, ldb, cuda_data_type_size(Btype))),
+    op::inout(C, blas_matrix_bytes(m, n, ldc, cuda_data_type_size(Ctype))))
+
+LIBRARY_CALL_WRAPPER_OPERANDS(
+    cublasStatus_t, "cublasGemmBatchedEx", cublasGemmBatchedEx,
+    (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb,
+     int m, int n, int k, const void *alpha, const void *const Aarray[],
+     cudaDataType Atype, int lda, const void *const Barray[],
+     cudaDataType Btype, int ldb, const void *beta, void *const Carray[],
+     cudaDataType Ctype, int ldc, int batchCount, cudaDataType computeType,
+     cublasGemmAlgo_t algo),
+    (handle, transa, transb, m, n, k, alpha, Aarray, Atype, lda, Barray, Btype,
+     ldb, beta, Carray, Ctype, ldc, batchCount, computeType, algo),
+    DriverState::device_from_cublas_handle(handle),
+    DriverState::stream_from_cublas_handle(handle),
+    gemm_op(Atype, computeType, m, n, k, batchCount),
+    gemm_batched_operands(transa, transb, m, n, k, Aarray,
+                          cuda_data_type_size(Atype), lda, Barray,
+                          cuda_data_type_size(Btype), ldb, Carray,
+                          cuda_data_type_size(Ctype), ldc, batchCount,
+                          DriverState::stream_from_cublas_handle(handle)))
+
+CUBLAS_OP_WRAPPER(
+    "cublasGemmStridedBatchedEx", cublasGemmStridedBatchedEx,
+    (cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb,
+     int m, int n, int k, const void *alpha, const void *A, cudaDataType Atype,
+     int lda, long long int strideA, const void *B, cudaDataType Btype,
+     int ldb, long long int strideB, const void *beta, void *C,
+     cudaDataType Ctype, int ldc, long long int strideC, int batchCount,
+     cudaDataType computeType, cublasGemmAlgo_t algo),
+    (handle, transa, transb, m, n, k, alpha, A, Atype, lda, strideA, B, Btype,
+     ldb, strideB, beta, C, Ctype, ldc, strideC, batchCount, computeType,
+     algo),
+    gemm_op(Atype, computeType, m, n, k, batchCount),
+    op::in(A, op_mat(transa, m, k, lda, cuda_data_type_size(Atype)),
+           strideA * cuda_data_type_size(Atype), batches(strideA, batchCount)),
+    op::in(B, op_mat(transb, k, n, ldb, cuda_data_type_size(Btype)),
+           strideB * cuda_data_type_size(Btype), batches(strideB, batchCount)),
+    op::inout(C, blas_matrix_bytes(m, n, ldc, cuda_data_type_size(Ctype)),
+              strideC * cuda_data_type_size(Ctype),
+              batches(strideC, batchCount)))
@@ -10,7 +10,9 @@
 #include "apis.hpp"
 #include "callbacks.hpp"
 #include "driver_state.hpp"
+#include "library_call.hpp"
 #include "preload.hpp"
+#include "tensor_layout.hpp"
 #include "thread.hpp"
 #include "values.hpp"
 
@@ -40,444 +42,477 @@ extern "C" cudnnStatus_t cudnnDestroy(cudnnHandle_t handle) {
   return ret;
 }
 
-typedef cudnnStatus_t (*cudnnActivationForwardFunc)(
-    cudnnHandle_t handle, cudnnActivationDescriptor_t activationDesc,
-    const void *alpha, const cudnnTensorDescriptor_t xDesc, const void *x,
-    const void *beta, const cudnnTensorDescriptor_t yDesc, void *y);
-
-extern "C" cudnnStatus_t cudnnActivationForward(
-    cudnnHandle_t handle, cudnnActivationDescriptor_t activationDesc,
-    const void *alpha, const cudnnTensorDescriptor_t xDesc, const void *x,
-    const void *beta, const cudnnTensorDescriptor_t yDesc, void *y) {
-
-  // FIXME - also depends on alpha, beta
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnActivationForward);
-
-  Values::id_type xId, yId;
-  Values::value_type xVal, yVal;
-
-  auto &values = Values::instance();
-  auto &allocations = Allocations::instance();
-
-  // Get src value
-  std::tie(xId, xVal) = values.find_live((uintptr_t)x, 1, AddressSpace::Cuda());
-  assert(xId && "x should be on device");
-
-  // Get dst allocation
-  Allocations::id_type yAllocId;
-  std::tie(yAllocId, std::ignore) =
-      allocations.find_live((uintptr_t)y, AddressSpace::Cuda());
-  assert(yAllocId && "y alloc should be on device");
-
-  std::tie(yId, yVal) = values.new_value((uintptr_t)y, 0, yAllocId, true);
-  yVal->add_depends_on(xId);
+// Calls on the handle are ordered on streamId
+typedef cudnnStatus_t (*cudnnSetStreamFunc)(cudnnHandle_t handle,
+                                            cudaStream_t streamId);
+extern "C" cudnnStatus_t cudnnSetStream(cudnnHandle_t handle,
+                                        cudaStream_t streamId) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnSetStream);
+
+  const cudnnStatus_t ret = real_cudnnSetStream(handle, streamId);
+  if (ret == CUDNN_STATUS_SUCCESS) {
+    DriverState::track_cudnn_stream(handle, streamId);
+  }
+  return ret;
+}
 
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnActivationForward", DriverState::device_from_cudnn_handle(handle));
-  api->add_output(yId);
-  api->add_input(xId);
-  APIs::record(api);
+typedef cudnnStatus_t (*cudnnSetTensor4dDescriptorFunc)(
+    cudnnTensorDescriptor_t tensorDesc, cudnnTensorFormat_t format,
+    cudnnDataType_t dataType, int n, int c, int h, int w);
+extern "C" cudnnStatus_t
+cudnnSetTensor4dDescriptor(cudnnTensorDescriptor_t tensorDesc,
+                           cudnnTensorFormat_t format, cudnnDataType_t dataType,
+                           int n, int c, int h, int w) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnSetTensor4dDescriptor);
 
-  printf(
-      "WARN: disabling CUPTI callbacks during cudnnActivationForward call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret = real_cudnnActivationForward(
-      handle, activationDesc, alpha, xDesc, x, beta, yDesc, y);
-  DriverState::this_thread().resume_cupti_callbacks();
+  // descriptor calls don't touch the device, so leave callbacks alone
+  const cudnnStatus_t ret =
+      real_cudnnSetTensor4dDescriptor(tensorDesc, format, dataType, n, c, h, w);
+  if (ret == CUDNN_STATUS_SUCCESS) {
+    const int dims[] = {n, c, h, w};
+    if (format == CUDNN_TENSOR_NHWC) {
+      const int strides[] = {h * w * c, 1, w * c, c};
+      TensorLayouts::instance().set(tensorDesc,
+                                    TensorLayout(dataType, 4, dims, strides));
+    } else {
+      TensorLayouts::instance().set(tensorDesc,
+                                    TensorLayout::packed(dataType, 4, dims));
+    }
+  }
+  return ret;
+}
 
+typedef cudnnStatus_t (*cudnnSetTensor4dDescriptorExFunc)(
+    cudnnTensorDescriptor_t tensorDesc, cudnnDataType_t dataType, int n, int c,
+    int h, int w, int nStride, int cStride, int hStride, int wStride);
+extern "C" cudnnStatus_t cudnnSetTensor4dDescriptorEx(
+    cudnnTensorDescriptor_t tensorDesc, cudnnDataType_t dataType, int n, int c,
+    int h, int w, int nStride, int cStride, int hStride, int wStride) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnSetTensor4dDescriptorEx);
+
+  const cudnnStatus_t ret = real_cudnnSetTensor4dDescriptorEx(
+      tensorDesc, dataType, n, c, h, w, nStride, cStride, hStride, wStride);
+  if (ret == CUDNN_STATUS_SUCCESS) {
+    const int dims[] = {n, c, h, w};
+    const int strides[] = {nStride, cStride, hStride, wStride};
+    TensorLayouts::instance().set(tensorDesc,
+                                  TensorLayout(dataType, 4, dims, strides));
+  }
   return ret;
 }
 
-typedef cudnnStatus_t (*cudnnAddTensorFunc)(cudnnHandle_t handle,
-                                            const void *alpha,
-                                            const cudnnTensorDescriptor_t aDesc,
-                                            const void *A, const void *beta,
-                                            const cudnnTensorDescriptor_t cDesc,
-                                            void *C);
-extern "C" cudnnStatus_t cudnnAddTensor(cudnnHandle_t handle, const void *alpha,
-                                        const cudnnTensorDescriptor_t aDesc,
-                                        const void *A, const void *beta,
-                                        const cudnnTensorDescriptor_t cDesc,
-                                        void *C) {
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnAddTensor);
-
-  // FIXME - alpha and beta
-
-  Values::id_type aId, cId;
-  Values::value_type aVal, cVal;
-
-  auto &values = Values::instance();
-
-  // Get src value
-  std::tie(aId, aVal) = values.find_live((uintptr_t)A, 1, AddressSpace::Cuda());
-  assert(aId && "A should be on device");
-  std::tie(cId, cVal) = values.find_live((uintptr_t)C, 1, AddressSpace::Cuda());
-  assert(cId && "C should be on device");
-
-  Values::id_type dstId;
-  Values::value_type dstVal;
-  std::tie(dstId, dstVal) = values.duplicate_value(cVal);
-  dstVal->add_depends_on(aId);
-  dstVal->add_depends_on(cId);
-
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnAddTensor", DriverState::device_from_cudnn_handle(handle));
-  api->add_output(dstId);
-  api->add_input(aId);
-  api->add_input(cId);
-  APIs::record(api);
-
-  printf("WARN: disabling CUPTI callbacks during cudnnAddTensor call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret =
-      real_cudnnAddTensor(handle, alpha, aDesc, A, beta, cDesc, C);
-  DriverState::this_thread().resume_cupti_callbacks();
+typedef cudnnStatus_t (*cudnnSetTensorNdDescriptorFunc)(
+    cudnnTensorDescriptor_t tensorDesc, cudnnDataType_t dataType, int nbDims,
+    const int dimA[], const int strideA[]);
+extern "C" cudnnStatus_t
+cudnnSetTensorNdDescriptor(cudnnTensorDescriptor_t tensorDesc,
+                           cudnnDataType_t dataType, int nbDims,
+                           const int dimA[], const int strideA[]) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnSetTensorNdDescriptor);
+
+  const cudnnStatus_t ret = real_cudnnSetTensorNdDescriptor(
+      tensorDesc, dataType, nbDims, dimA, strideA);
+  if (ret == CUDNN_STATUS_SUCCESS) {
+    TensorLayouts::instance().set(
+        tensorDesc, TensorLayout(dataType, nbDims, dimA, strideA));
+  }
   return ret;
 }
 
-typedef cudnnStatus_t (*cudnnActivationBackwardFunc)(
-    cudnnHandle_t handle, cudnnActivationDescriptor_t activationDesc,
-    const void *alpha, const cudnnTensorDescriptor_t yDesc, const void *y,
-    const cudnnTensorDescriptor_t dyDesc, const void *dy,
-    const cudnnTensorDescriptor_t xDesc, const void *x, const void *beta,
-    const cudnnTensorDescriptor_t dxDesc, void *dx);
-extern "C" cudnnStatus_t cudnnActivationBackward(
-    cudnnHandle_t handle, cudnnActivationDescriptor_t activationDesc,
-    const void *alpha, const cudnnTensorDescriptor_t yDesc, const void *y,
-    const cudnnTensorDescriptor_t dyDesc, const void *dy,
-    const cudnnTensorDescriptor_t xDesc, const void *x, const void *beta,
-    const cudnnTensorDescriptor_t dxDesc, void *dx) {
-
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnActivationBackward);
-
-  Values::id_type yId, dyId, xId, dxId;
-  Values::value_type yVal, dyVal, xVal, dxVal;
-
-  auto &values = Values::instance();
-  auto &allocations = Allocations::instance();
-
-  // Get src value
-  std::tie(yId, yVal) = values.find_live((uintptr_t)y, 1, AddressSpace::Cuda());
-  assert(yId && "y should be on device");
-  std::tie(dyId, dyVal) =
-      values.find_live((uintptr_t)dy, 1, AddressSpace::Cuda());
-  assert(dyId && "dy should be on device");
-  std::tie(xId, xVal) = values.find_live((uintptr_t)x, 1, AddressSpace::Cuda());
-  assert(xId && "x should be on device");
-
-  // Get dst allocation
-  Allocations::id_type dxAllocId;
-  std::tie(dxAllocId, std::ignore) =
-      allocations.find_live((uintptr_t)dx, AddressSpace::Cuda());
-  assert(dxAllocId && "dx alloc should be on device");
-
-  // FIXME - this size is wrong
-  std::tie(dxId, dxVal) = values.new_value((uintptr_t)dx, 0, dxAllocId, true);
-  dxVal->add_depends_on(xId);
-  dxVal->add_depends_on(yId);
-  dxVal->add_depends_on(dyId);
-
-  // FIXME: also depends on alpha, beta
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnActivationBackward", DriverState::device_from_cudnn_handle(handle));
-  api->add_output(dxId);
-  api->add_input(xId);
-  api->add_input(yId);
-  api->add_input(dyId);
-  APIs::record(api);
-
-  printf(
-      "WARN: disabling CUPTI callbacks during cudnnActivationBackward call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret =
-      real_cudnnActivationBackward(handle, activationDesc, alpha, yDesc, y,
-                                   dyDesc, dy, xDesc, x, beta, dxDesc, dx);
-  DriverState::this_thread().resume_cupti_callbacks();
+typedef cudnnStatus_t (*cudnnDestroyTensorDescriptorFunc)(
+    cudnnTensorDescriptor_t tensorDesc);
+extern "C" cudnnStatus_t
+cudnnDestroyTensorDescriptor(cudnnTensorDescriptor_t tensorDesc) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnDestroyTensorDescriptor);
 
-  return ret;
+  // the handle may be reused by the next create
+  TensorLayouts::instance().erase(tensorDesc);
+  return real_cudnnDestroyTensorDescriptor(tensorDesc);
 }
 
-typedef cudnnStatus_t (*cudnnConvolutionBackwardDataFunc)(
-    cudnnHandle_t, const void *, const cudnnFilterDescriptor_t, const void *,
-    const cudnnTensorDescriptor_t, const void *,
-    const cudnnConvolutionDescriptor_t, cudnnConvolutionBwdDataAlgo_t, void *,
-    size_t, const void *, const cudnnTensorDescriptor_t, void *);
-extern "C" cudnnStatus_t cudnnConvolutionBackwardData(
-    cudnnHandle_t handle, const void *alpha,
-    const cudnnFilterDescriptor_t wDesc, const void *w,
-    const cudnnTensorDescriptor_t dyDesc, const void *dy,
-    const cudnnConvolutionDescriptor_t convDesc,
-    cudnnConvolutionBwdDataAlgo_t algo, void *workSpace,
-    size_t workSpaceSizeInBytes, const void *beta,
-    const cudnnTensorDescriptor_t dxDesc, void *dx) {
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnConvolutionBackwardData);
-  auto &values = Values::instance();
-
-  // Find input values
-  Values::id_type wId, dyId, workSpaceId, dxId;
-  Values::value_type wVal, dyVal, workSpaceVal, dxVal;
-  std::tie(dyId, dyVal) = values.find_live((uintptr_t)dy, AddressSpace::Cuda());
-  std::tie(wId, wVal) = values.find_live((uintptr_t)w, AddressSpace::Cuda());
-  std::tie(workSpaceId, workSpaceVal) =
-      values.find_live((uintptr_t)workSpace, AddressSpace::Cuda());
-  std::tie(dxId, dxVal) = values.find_live((uintptr_t)dx, AddressSpace::Cuda());
-
-  assert(dyId &&
-         "Couldn't find cudnnConvolutionBackwardData dy value on device");
-
-  // Create output value
-  Values::id_type outId;
-  Values::value_type outVal;
-  std::tie(outId, outVal) = values.duplicate_value(dxVal);
-  outVal->add_depends_on(wId);
-  outVal->add_depends_on(dyId);
-  outVal->add_depends_on(workSpaceId);
-  outVal->add_depends_on(dxId);
-  // track api
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnConvolutionBackwardData",
-      DriverState::device_from_cudnn_handle(handle));
-  api->add_output(outId);
-  api->add_input(wId);
-  api->add_input(dyId);
-  api->add_input(workSpaceId);
-  api->add_input(dxId);
-  APIs::record(api);
-
-  // Do the actual call
-  printf("WARN: disabling CUPTI callbacks during cudnnConvolutionBackwardData "
-         "call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret = real_cudnnConvolutionBackwardData(
-      handle, alpha, wDesc, w, dyDesc, dy, convDesc, algo, workSpace,
-      workSpaceSizeInBytes, beta, dxDesc, dx);
-  DriverState::this_thread().resume_cupti_callbacks();
+typedef cudnnStatus_t (*cudnnSetFilter4dDescriptorFunc)(
+    cudnnFilterDescriptor_t filterDesc, cudnnDataType_t dataType,
+    cudnnTensorFormat_t format, int k, int c, int h, int w);
+extern "C" cudnnStatus_t
+cudnnSetFilter4dDescriptor(cudnnFilterDescriptor_t filterDesc,
+                           cudnnDataType_t dataType, cudnnTensorFormat_t format,
+                           int k, int c, int h, int w) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnSetFilter4dDescriptor);
 
+  const cudnnStatus_t ret =
+      real_cudnnSetFilter4dDescriptor(filterDesc, dataType, format, k, c, h, w);
+  if (ret == CUDNN_STATUS_SUCCESS) {
+    // filters are always packed, the format only permutes the dimensions
+    const int dims[] = {k, c, h, w};
+    TensorLayouts::instance().set(filterDesc,
+                                  TensorLayout::packed(dataType, 4, dims));
+  }
   return ret;
 }
 
-typedef cudnnStatus_t (*cudnnConvolutionBackwardBiasFunc)(
-    cudnnHandle_t handle, const void *alpha,
-    const cudnnTensorDescriptor_t dyDesc, const void *dy, const void *beta,
-    const cudnnTensorDescriptor_t dbDesc, void *db);
+typedef cudnnStatus_t (*cudnnSetFilterNdDescriptorFunc)(
+    cudnnFilterDescriptor_t filterDesc, cudnnDataType_t dataType,
+    cudnnTensorFormat_t format, int nbDims, const int filterDimA[]);
 extern "C" cudnnStatus_t
-cudnnConvolutionBackwardBias(cudnnHandle_t handle, const void *alpha,
-                             const cudnnTensorDescriptor_t dyDesc,
-                             const void *dy, const void *beta,
-                             const cudnnTensorDescriptor_t dbDesc, void *db) {
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnConvolutionBackwardBias);
-  auto &values = Values::instance();
-  auto &allocations = Allocations::instance();
-
-  // Find input values
-  Values::id_type dyId, dbId;
-  Values::value_type dyVal, dbVal;
-  std::tie(dyId, dyVal) = values.find_live((uintptr_t)dy, AddressSpace::Cuda());
-
-  assert(dyId &&
-         "Couldn't find cudnnConvolutionBackwardBias dy value on device");
-
-  // Create output value
-  Allocations::id_type dbAllocId;
-  std::tie(dbAllocId, std::ignore) =
-      allocations.find_live((uintptr_t)db, 1, AddressSpace::Cuda());
-  assert(dbAllocId && "y allocation should be on device");
-  std::tie(dbId, dbVal) = values.new_value((uintptr_t)db, 0, dbAllocId);
-  dbVal->add_depends_on(dyId);
-
-  // track api
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnConvolutionBackwardBias",
-      DriverState::device_from_cudnn_handle(handle));
-  api->add_output(dbId);
-  api->add_input(dyId);
-  APIs::record(api);
-
-  // Do the actual call
-  printf("WARN: disabling CUPTI callbacks during cudnnConvolutionBackwardBias "
-         "call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret = real_cudnnConvolutionBackwardBias(
-      handle, alpha, dyDesc, dy, beta, dbDesc, db);
-  DriverState::this_thread().resume_cupti_callbacks();
-
+cudnnSetFilterNdDescriptor(cudnnFilterDescriptor_t filterDesc,
+                           cudnnDataType_t dataType, cudnnTensorFormat_t format,
+                           int nbDims, const int filterDimA[]) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnSetFilterNdDescriptor);
+
+  const cudnnStatus_t ret = real_cudnnSetFilterNdDescriptor(
+      filterDesc, dataType, format, nbDims, filterDimA);
+  if (ret == CUDNN_STATUS_SUCCESS) {
+    TensorLayouts::instance().set(
+        filterDesc, TensorLayout::packed(dataType, nbDims, filterDimA));
+  }
   return ret;
 }
 
-typedef cudnnStatus_t (*cudnnConvolutionBackwardFilterFunc)(
-    cudnnHandle_t handle, const void *alpha,
-    const cudnnTensorDescriptor_t xDesc, const void *x,
-    const cudnnTensorDescriptor_t dyDesc, const void *dy,
-    const cudnnConvolutionDescriptor_t convDesc,
-    cudnnConvolutionBwdFilterAlgo_t algo, void *workSpace,
-    size_t workSpaceSizeInBytes, const void *beta,
-    const cudnnFilterDescriptor_t dwDesc, void *dw);
-extern "C" cudnnStatus_t cudnnConvolutionBackwardFilter(
-    cudnnHandle_t handle, const void *alpha,
-    const cudnnTensorDescriptor_t xDesc, const void *x,
-    const cudnnTensorDescriptor_t dyDesc, const void *dy,
-    const cudnnConvolutionDescriptor_t convDesc,
-    cudnnConvolutionBwdFilterAlgo_t algo, void *workSpace,
-    size_t workSpaceSizeInBytes, const void *beta,
-    const cudnnFilterDescriptor_t dwDesc, void *dw) {
-
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnConvolutionBackwardFilter);
-  auto &values = Values::instance();
-
-  // Find input values
-  Values::id_type xId, dyId, workSpaceId, dwId;
-  Values::value_type dwVal;
-  std::tie(xId, std::ignore) =
-      values.find_live((uintptr_t)x, AddressSpace::Cuda());
-  std::tie(dyId, std::ignore) =
-      values.find_live((uintptr_t)dy, AddressSpace::Cuda());
-  std::tie(workSpaceId, std::ignore) =
-      values.find_live((uintptr_t)workSpace, AddressSpace::Cuda());
-  std::tie(dwId, dwVal) = values.find_live((uintptr_t)dw, AddressSpace::Cuda());
-  assert(
-      xId && dyId && workSpaceId && dwId &&
-      "Couldn't find cudnnConvolutionBackwardFilter argument value on device");
-
-  // See if there is an existing output value to take info from
-  Values::id_type outId;
-  Values::value_type outVal;
-  std::tie(outId, outVal) = values.duplicate_value(dwVal);
-  outVal->add_depends_on(xId);
-  outVal->add_depends_on(dyId);
-  outVal->add_depends_on(workSpaceId);
-  outVal->add_depends_on(dwId);
-  printf("[cudnnConvolutionBackwardFilter] %lu deps on %lu %lu %lu %lu\n",
-         outId, xId, dyId, workSpaceId, dwId);
-
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnConvolutionForward", DriverState::device_from_cudnn_handle(handle));
-  api->add_output(outId);
-  api->add_input(xId);
-  api->add_input(dyId);
-  api->add_input(workSpaceId);
-  api->add_input(dwId);
-  APIs::record(api);
-
-  printf("WARN: disabling CUPTI callbacks during "
-         "cudnnConvolutionBackwardFilter call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret = real_cudnnConvolutionBackwardFilter(
-      handle, alpha, xDesc, x, dyDesc, dy, convDesc, algo, workSpace,
-      workSpaceSizeInBytes, beta, dwDesc, dw);
-  DriverState::this_thread().resume_cupti_callbacks();
+typedef cudnnStatus_t (*cudnnDestroyFilterDescriptorFunc)(
+    cudnnFilterDescriptor_t filterDesc);
+extern "C" cudnnStatus_t
+cudnnDestroyFilterDescriptor(cudnnFilterDescriptor_t filterDesc) {
+  SAME_LD_PRELOAD_BOILERPLATE(cudnnDestroyFilterDescriptor);
 
-  return ret;
+  TensorLayouts::instance().erase(filterDesc);
+  return real_cudnnDestroyFilterDescriptor(filterDesc);
 }
 
-typedef cudnnStatus_t (*cudnnConvolutionForwardFunc)(
-    cudnnHandle_t handle, const void *alpha,
-    const cudnnTensorDescriptor_t xDesc, const void *x,
-    const cudnnFilterDescriptor_t wDesc, const void *w,
-    const cudnnConvolutionDescriptor_t convDesc, cudnnConvolutionFwdAlgo_t algo,
-    void *workSpace, size_t workSpaceSizeInBytes, const void *beta,
-    const cudnnTensorDescriptor_t yDesc, void *y);
+// Each call below is generated from its operands. Tensors are sized from
+// their descriptors, workspaces and reserve spaces from their size arguments.
 
-extern "C" cudnnStatus_t
-cudnnConvolutionForward(cudnnHandle_t handle, const void *alpha,
-                        const cudnnTensorDescriptor_t xDesc, const void *x,
-                        const cudnnFilterDescriptor_t wDesc, const void *w,
-                        const cudnnConvolutionDescriptor_t convDesc,
-                        cudnnConvolutionFwdAlgo_t algo, void *workSpace,
-                        size_t workSpaceSizeInBytes, const void *beta,
-                        const cudnnTensorDescriptor_t yDesc, void *y) {
-
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnConvolutionForward);
-
-  auto &values = Values::instance();
-
-  // Find input values
-  printf("Looking for x=%lu, w=%lu, workSpace=%lu\n", (uintptr_t)x,
-         (uintptr_t)w, (uintptr_t)workSpace);
-  Values::id_type xId, wId, workSpaceId, yId;
-  Values::value_type yVal;
-  std::tie(xId, std::ignore) =
-      values.find_live((uintptr_t)x, AddressSpace::Cuda());
-  std::tie(wId, std::ignore) =
-      values.find_live((uintptr_t)w, AddressSpace::Cuda());
-  std::tie(workSpaceId, std::ignore) =
-      values.find_live((uintptr_t)workSpace, AddressSpace::Cuda());
-  std::tie(yId, yVal) = values.find_live((uintptr_t)y, AddressSpace::Cuda());
-  assert(xId && wId && workSpaceId && yId &&
-         "Couldn't find cudnnConvolutionForward argument value on device");
-
-  // See if there is an existing output value to take info from
-  Values::id_type outId;
-  Values::value_type outVal;
-  std::tie(outId, outVal) = values.duplicate_value(yVal);
-  outVal->add_depends_on(xId);
-  outVal->add_depends_on(wId);
-  outVal->add_depends_on(workSpaceId);
-  outVal->add_depends_on(yId);
-  printf("[cudnnConvolutionForward] %lu deps on %lu %lu %lu %lu\n", outId, yId,
-         xId, wId, workSpaceId);
-
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnConvolutionForward", DriverState::device_from_cudnn_handle(handle));
-  api->add_output(outId);
-  api->add_input(xId);
-  api->add_input(wId);
-  api->add_input(workSpaceId);
-  api->add_input(yId);
-  APIs::record(api);
-
-  printf(
-      "WARN: disabling CUPTI callbacks during cudnnConvolutionForward call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret = real_cudnnConvolutionForward(
-      handle, alpha, xDesc, x, wDesc, w, convDesc, algo, workSpace,
-      workSpaceSizeInBytes, beta, yDesc, y);
-  DriverState::this_thread().resume_cupti_callbacks();
+#define CUDNN_WRAPPER(name, params, args, ...)                                 \
+  CUDNN_OP_WRAPPER(name, params, args, OpInfo(), __VA_ARGS__)
 
-  return ret;
+// CUDNN_WRAPPER for calls whose OpInfo we know
+#define CUDNN_OP_WRAPPER(name, params, args, opInfo, ...)                      \
+  LIBRARY_CALL_WRAPPER(cudnnStatus_t, #name, name, params, args,               \
+                       DriverState::device_from_cudnn_handle(handle),          \
+                       DriverState::stream_from_cudnn_handle(handle), opInfo,  \
+                       __VA_ARGS__)
+
+// bytes of the tensor or filter described by desc, 0 if unknown
+static size_t bytes(const void *desc) {
+  return TensorLayouts::instance().bytes(desc);
 }
 
-typedef cudnnStatus_t (*cudnnSoftmaxForwardFunc)(
-    cudnnHandle_t handle, cudnnSoftmaxAlgorithm_t algo, cudnnSoftmaxMode_t mode,
-    const void *alpha, const cudnnTensorDescriptor_t xDesc, const void *x,
-    const void *beta, const cudnnTensorDescriptor_t yDesc, void *y);
-extern "C" cudnnStatus_t cudnnSoftmaxForward(
-    cudnnHandle_t handle, cudnnSoftmaxAlgorithm_t algo, cudnnSoftmaxMode_t mode,
-    const void *alpha, const cudnnTensorDescriptor_t xDesc, const void *x,
-    const void *beta, const cudnnTensorDescriptor_t yDesc, void *y) {
-
-  SAME_LD_PRELOAD_BOILERPLATE(cudnnSoftmaxForward);
-
-  auto &values = Values::instance();
-  auto &allocations = Allocations::instance();
-
-  // Find input values
-  Values::id_type xId, yId;
-  Values::value_type xVal, yVal;
-  std::tie(xId, xVal) = values.find_live((uintptr_t)x, AddressSpace::Cuda());
-
-  assert(xId && "Couldn't find cudnnSoftmaxForward x value on device");
-
-  // Create output value
-  Allocations::id_type yAllocId;
-  std::tie(yAllocId, std::ignore) =
-      allocations.find_live((uintptr_t)y, 1, AddressSpace::Cuda());
-  assert(yAllocId && "y allocation should be on device");
-  std::tie(yId, yVal) = values.new_value((uintptr_t)y, 0, yAllocId);
-  yVal->add_depends_on(xId);
-
-  // track api
-  auto api = std::make_shared<ApiRecord>(
-      "cudnnSoftmaxForward", DriverState::device_from_cudnn_handle(handle));
-  api->add_output(yId);
-  api->add_input(xId);
-  APIs::record(api);
-
-  // Do the actual call
-  printf("WARN: disabling CUPTI callbacks during cudnnSoftmaxForward call\n");
-  DriverState::this_thread().pause_cupti_callbacks();
-  const cudnnStatus_t ret = real_cudnnSoftmaxForward(handle, algo, mode, alpha,
-                                                     xDesc, x, beta, yDesc, y);
-  DriverState::this_thread().resume_cupti_callbacks();
+// A convolution producing y (or, for the backward passes, consuming dy)
+// with filter w. Each element of y is a dot product over every filter dim
+// after the first (C / groups x R x S). shape is y's dims followed by w's.
+static OpInfo conv_op(const char *kind, const void *yDesc, const void *wDesc) {
+  const auto y = TensorLayouts::instance().layout(yDesc);
+  const auto w = TensorLayouts::instance().layout(wDesc);
+  if (y.dims.empty() || w.dims.empty()) {
+    return OpInfo();
+  }
+
+  uint64_t outputs = 1;
+  std::vector<int64_t> shape;
+  for (const auto d : y.dims) {
+    outputs *= d;
+    shape.push_back(d);
+  }
+  uint64_t perOutput = 1;
+  for (size_t i = 0; i < w.dims.size(); ++i) {
+    if (i > 0) {
+      perOutput *= w.dims[i];
+    }
+    shape.push_back(w.dims[i]);
+  }
+  return OpInfo(kind, shape, cudnn_data_type_name(w.dataType),
+                2 * outputs * perOutput);
+}
 
-  return ret;
-}
\ No newline at end of file
+// conv_op, plus adding the bias and applying the activation to each output
+static OpInfo conv_bias_act_op(const void *yDesc, const void *wDesc) {
+  OpInfo op = conv_op("conv_bias_act", yDesc, wDesc);
+  if (op.is_known()) {
+    const auto y = TensorLayouts::instance().layout(yDesc);
+    uint64_t outputs = 1;
+    for (const auto d : y.dims) {
+      outputs *= d;
+    }
+    op.flops += 2 * outputs;
+  }
+  return op;
+}
+
+// FIXME - outputs also depend on alpha and beta, and are only read when beta
+// is non-zero
+
+CUDNN_WRAPPER(cudnnActivationForward,
+              (cudnnHandle_t handle, cudnnActivationDescriptor_t activationDesc,
+               const void *alpha, const cudnnTensorDescriptor_t xDesc,
+               const void *x, const void *beta,
+               const cudnnTensorDescriptor_t yDesc, void *y),
+              (handle, activationDesc, alpha, xDesc, x, beta, yDesc, y),
+              op::in(x, bytes(xDesc)), op::out(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnActivationBackward,
+              (cudnnHandle_t handle, cudnnActivationDescriptor_t activationDesc,
+               const void *alpha, const cudnnTensorDescriptor_t yDesc,
+               const void *y, const cudnnTensorDescriptor_t dyDesc,
+               const void *dy, const cudnnTensorDescriptor_t xDesc,
+               const void *x, const void *beta,
+               const cudnnTensorDescriptor_t dxDesc, void *dx),
+              (handle, activationDesc, alpha, yDesc, y, dyDesc, dy, xDesc, x,
+               beta, dxDesc, dx),
+              op::in(y, bytes(yDesc)), op::in(dy, bytes(dyDesc)),
+              op::in(x, bytes(xDesc)), op::out(dx, bytes(dxDesc)))
+
+CUDNN_WRAPPER(cudnnAddTensor,
+              (cudnnHandle_t handle, const void *alpha,
+               const cudnnTensorDescriptor_t aDesc, const void *A,
+               const void *beta, const cudnnTensorDescriptor_t cDesc, void *C),
+              (handle, alpha, aDesc, A, beta, cDesc, C),
+              op::in(A, bytes(aDesc)), op::inout(C, bytes(cDesc)))
+
+CUDNN_WRAPPER(cudnnOpTensor,
+              (cudnnHandle_t handle,
+               const cudnnOpTensorDescriptor_t opTensorDesc,
+               const void *alpha1, const cudnnTensorDescriptor_t aDesc,
+               const void *A, const void *alpha2,
+               const cudnnTensorDescriptor_t bDesc, const void *B,
+               const void *beta, const cudnnTensorDescriptor_t cDesc, void *C),
+              (handle, opTensorDesc, alpha1, aDesc, A, alpha2, bDesc, B, beta,
+               cDesc, C),
+              op::in(A, bytes(aDesc)), op::in(B, bytes(bDesc)),
+              op::inout(C, bytes(cDesc)))
+
+CUDNN_WRAPPER(cudnnScaleTensor,
+              (cudnnHandle_t handle, const cudnnTensorDescriptor_t yDesc,
+               void *y, const void *alpha),
+              (handle, yDesc, y, alpha), op::inout(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnSetTensor,
+              (cudnnHandle_t handle, const cudnnTensorDescriptor_t yDesc,
+               void *y, const void *valuePtr),
+              (handle, yDesc, y, valuePtr), op::out(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnTransformTensor,
+              (cudnnHandle_t handle, const void *alpha,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const void *beta, const cudnnTensorDescriptor_t yDesc, void *y),
+              (handle, alpha, xDesc, x, beta, yDesc, y),
+              op::in(x, bytes(xDesc)), op::out(y, bytes(yDesc)))
+
+CUDNN_OP_WRAPPER(cudnnConvolutionForward,
+                 (cudnnHandle_t handle, const void *alpha,
+                  const cudnnTensorDescriptor_t xDesc, const void *x,
+                  const cudnnFilterDescriptor_t wDesc, const void *w,
+                  const cudnnConvolutionDescriptor_t convDesc,
+                  cudnnConvolutionFwdAlgo_t algo, void *workSpace,
+                  size_t workSpaceSizeInBytes, const void *beta,
+                  const cudnnTensorDescriptor_t yDesc, void *y),
+                 (handle, alpha, xDesc, x, wDesc, w, convDesc, algo, workSpace,
+                  workSpaceSizeInBytes, beta, yDesc, y),
+                 conv_op("conv_fwd", yDesc, wDesc),
+                 op::in(x, bytes(xDesc)), op::in(w, bytes(wDesc)),
+                 op::in(workSpace, workSpaceSizeInBytes),
+                 op::inout(y, bytes(yDesc)))
+
+CUDNN_OP_WRAPPER(cudnnConvolutionBiasActivationForward,
+                 (cudnnHandle_t handle, const void *alpha1,
+                  const cudnnTensorDescriptor_t xDesc, const void *x,
+                  const cudnnFilterDescriptor_t wDesc, const void *w,
+                  const cudnnConvolutionDescriptor_t convDesc,
+                  cudnnConvolutionFwdAlgo_t algo, void *workSpace,
+                  size_t workSpaceSizeInBytes, const void *alpha2,
+                  const cudnnTensorDescriptor_t zDesc, const void *z,
+                  const cudnnTensorDescriptor_t biasDesc, const void *bias,
+                  const cudnnActivationDescriptor_t activationDesc,
+                  const cudnnTensorDescriptor_t yDesc, void *y),
+                 (handle, alpha1, xDesc, x, wDesc, w, convDesc, algo, workSpace,
+                  workSpaceSizeInBytes, alpha2, zDesc, z, biasDesc, bias,
+                  activationDesc, yDesc, y),
+                 conv_bias_act_op(yDesc, wDesc),
+                 op::in(x, bytes(xDesc)), op::in(w, bytes(wDesc)),
+                 op::in(workSpace, workSpaceSizeInBytes),
+                 op::in(z, bytes(zDesc)), op::in(bias, bytes(biasDesc)),
+                 op::out(y, bytes(yDesc)))
+
+CUDNN_OP_WRAPPER(cudnnConvolutionBackwardData,
+                 (cudnnHandle_t handle, const void *alpha,
+                  const cudnnFilterDescriptor_t wDesc, const void *w,
+                  const cudnnTensorDescriptor_t dyDesc, const void *dy,
+                  const cudnnConvolutionDescriptor_t convDesc,
+                  cudnnConvolutionBwdDataAlgo_t algo, void *workSpace,
+                  size_t workSpaceSizeInBytes, const void *beta,
+                  const cudnnTensorDescriptor_t dxDesc, void *dx),
+                 (handle, alpha, wDesc, w, dyDesc, dy, convDesc, algo,
+                  workSpace, workSpaceSizeInBytes, beta, dxDesc, dx),
+                 conv_op("conv_bwd_data", dyDesc, wDesc),
+                 op::in(w, bytes(wDesc)), op::in(dy, bytes(dyDesc)),
+                 op::in(workSpace, workSpaceSizeInBytes),
+                 op::inout(dx, bytes(dxDesc)))
+
+CUDNN_OP_WRAPPER(cudnnConvolutionBackwardFilter,
+                 (cudnnHandle_t handle, const void *alpha,
+                  const cudnnTensorDescriptor_t xDesc, const void *x,
+                  const cudnnTensorDescriptor_t dyDesc, const void *dy,
+                  const cudnnConvolutionDescriptor_t convDesc,
+                  cudnnConvolutionBwdFilterAlgo_t algo, void *workSpace,
+                  size_t workSpaceSizeInBytes, const void *beta,
+                  const cudnnFilterDescriptor_t dwDesc, void *dw),
+                 (handle, alpha, xDesc, x, dyDesc, dy, convDesc, algo,
+                  workSpace, workSpaceSizeInBytes, beta, dwDesc, dw),
+                 conv_op("conv_bwd_filter", dyDesc, dwDesc),
+                 op::in(x, bytes(xDesc)), op::in(dy, bytes(dyDesc)),
+                 op::in(workSpace, workSpaceSizeInBytes),
+                 op::inout(dw, bytes(dwDesc)))
+
+CUDNN_WRAPPER(cudnnConvolutionBackwardBias,
+              (cudnnHandle_t handle, const void *alpha,
+               const cudnnTensorDescriptor_t dyDesc, const void *dy,
+               const void *beta, const cudnnTensorDescriptor_t dbDesc,
+               void *db),
+              (handle, alpha, dyDesc, dy, beta, dbDesc, db),
+              op::in(dy, bytes(dyDesc)), op::out(db, bytes(dbDesc)))
+
+CUDNN_WRAPPER(cudnnSoftmaxForward,
+              (cudnnHandle_t handle, cudnnSoftmaxAlgorithm_t algo,
+               cudnnSoftmaxMode_t mode, const void *alpha,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const void *beta, const cudnnTensorDescriptor_t yDesc, void *y),
+              (handle, algo, mode, alpha, xDesc, x, beta, yDesc, y),
+              op::in(x, bytes(xDesc)), op::out(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnSoftmaxBackward,
+              (cudnnHandle_t handle, cudnnSoftmaxAlgorithm_t algo,
+               cudnnSoftmaxMode_t mode, const void *alpha,
+               const cudnnTensorDescriptor_t yDesc, const void *y,
+               const cudnnTensorDescriptor_t dyDesc, const void *dy,
+               const void *beta, const cudnnTensorDescriptor_t dxDesc,
+               void *dx),
+              (handle, algo, mode, alpha, yDesc, y, dyDesc, dy, beta, dxDesc,
+               dx),
+              op::in(y, bytes(yDesc)), op::in(dy, bytes(dyDesc)),
+              op::out(dx, bytes(dxDesc)))
+
+CUDNN_WRAPPER(cudnnPoolingForward,
+              (cudnnHandle_t handle, const cudnnPoolingDescriptor_t poolingDesc,
+               const void *alpha, const cudnnTensorDescriptor_t xDesc,
+               const void *x, const void *beta,
+               const cudnnTensorDescriptor_t yDesc, void *y),
+              (handle, poolingDesc, alpha, xDesc, x, beta, yDesc, y),
+              op::in(x, bytes(xDesc)), op::out(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnPoolingBackward,
+              (cudnnHandle_t handle, const cudnnPoolingDescriptor_t poolingDesc,
+               const void *alpha, const cudnnTensorDescriptor_t yDesc,
+               const void *y, const cudnnTensorDescriptor_t dyDesc,
+               const void *dy, const cudnnTensorDescriptor_t xDesc,
+               const void *x, const void *beta,
+               const cudnnTensorDescriptor_t dxDesc, void *dx),
+              (handle, poolingDesc, alpha, yDesc, y, dyDesc, dy, xDesc, x,
+               beta, dxDesc, dx),
+              op::in(y, bytes(yDesc)), op::in(dy, bytes(dyDesc)),
+              op::in(x, bytes(xDesc)), op::out(dx, bytes(dxDesc)))
+
+CUDNN_WRAPPER(cudnnLRNCrossChannelForward,
+              (cudnnHandle_t handle, cudnnLRNDescriptor_t normDesc,
+               cudnnLRNMode_t lrnMode, const void *alpha,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const void *beta, const cudnnTensorDescriptor_t yDesc, void *y),
+              (handle, normDesc, lrnMode, alpha, xDesc, x, beta, yDesc, y),
+              op::in(x, bytes(xDesc)), op::out(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnLRNCrossChannelBackward,
+              (cudnnHandle_t handle, cudnnLRNDescriptor_t normDesc,
+               cudnnLRNMode_t lrnMode, const void *alpha,
+               const cudnnTensorDescriptor_t yDesc, const void *y,
+               const cudnnTensorDescriptor_t dyDesc, const void *dy,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const void *beta, const cudnnTensorDescriptor_t dxDesc,
+               void *dx),
+              (handle, normDesc, lrnMode, alpha, yDesc, y, dyDesc, dy, xDesc,
+               x, beta, dxDesc, dx),
+              op::in(y, bytes(yDesc)), op::in(dy, bytes(dyDesc)),
+              op::in(x, bytes(xDesc)), op::out(dx, bytes(dxDesc)))
+
+CUDNN_WRAPPER(cudnnBatchNormalizationForwardInference,
+              (cudnnHandle_t handle, cudnnBatchNormMode_t mode,
+               const void *alpha, const void *beta,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const cudnnTensorDescriptor_t yDesc, void *y,
+               const cudnnTensorDescriptor_t bnScaleBiasMeanVarDesc,
+               const void *bnScale, const void *bnBias,
+               const void *estimatedMean, const void *estimatedVariance,
+               double epsilon),
+              (handle, mode, alpha, beta, xDesc, x, yDesc, y,
+               bnScaleBiasMeanVarDesc, bnScale, bnBias, estimatedMean,
+               estimatedVariance, epsilon),
+              op::in(x, bytes(xDesc)),
+              op::in(bnScale, bytes(bnScaleBiasMeanVarDesc)),
+              op::in(bnBias, bytes(bnScaleBiasMeanVarDesc)),
+              op::in(estimatedMean, bytes(bnScaleBiasMeanVarDesc)),
+              op::in(estimatedVariance, bytes(bnScaleBiasMeanVarDesc)),
+              op::out(y, bytes(yDesc)))
+
+CUDNN_WRAPPER(cudnnBatchNormalizationForwardTraining,
+              (cudnnHandle_t handle, cudnnBatchNormMode_t mode,
+               const void *alpha, const void *beta,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const cudnnTensorDescriptor_t yDesc, void *y,
+               const cudnnTensorDescriptor_t bnScaleBiasMeanVarDesc,
+               const void *bnScale, const void *bnBias,
+               double exponentialAverageFactor, void *resultRunningMean,
+               void *resultRunningVariance, double epsilon,
+               void *resultSaveMean, void *resultSaveInvVariance),
+              (handle, mode, alpha, beta, xDesc, x, yDesc, y,
+               bnScaleBiasMeanVarDesc, bnScale, bnBias,
+               exponentialAverageFactor, resultRunningMean,
+               resultRunningVariance, epsilon, resultSaveMean,
+               resultSaveInvVariance),
+              op::in(x, bytes(xDesc)),
+              op::in(bnScale, bytes(bnScaleBiasMeanVarDesc)),
+              op::in(bnBias, bytes(bnScaleBiasMeanVarDesc)),
+              op::out(y, bytes(yDesc)),
+              op::inout(resultRunningMean, bytes(bnScaleBiasMeanVarDesc)),
+              op::inout(resultRunningVariance, bytes(bnScaleBiasMeanVarDesc)),
+              op::out(resultSaveMean, bytes(bnScaleBiasMeanVarDesc)),
+              op::out(resultSaveInvVariance, bytes(bnScaleBiasMeanVarDesc)))
+
+CUDNN_WRAPPER(cudnnBatchNormalizationBackward,
+              (cudnnHandle_t handle, cudnnBatchNormMode_t mode,
+               const void *alphaDataDiff, const void *betaDataDiff,
+               const void *alphaParamDiff, const void *betaParamDiff,
+               const cudnnTensorDescriptor_t xDesc, const void *x,
+               const cudnnTensorDescriptor_t dyDesc, const void *dy,
+               const cudnnTensorDescriptor_t dxDesc, void *dx,
+               const cudnnTensorDescriptor_t dBnScaleBiasDesc,
+               const void *bnScale, void *dBnScaleResult, void *dBnBiasResult,
+               double epsilon, const void *savedMean,
+               const void *savedInvVariance),
+              (handle, mode, alphaDataDiff, betaDataDiff, alphaParamDiff,
+               betaParamDiff, xDesc, x, dyDesc, dy, dxDesc, dx,
+               dBnScaleBiasDesc, bnScale, dBnScaleResult, dBnBiasResult,
+               epsilon, savedMean, savedInvVariance),
+              op::in(x, bytes(xDesc)), op::in(dy, bytes(dyDesc)),
+              op::in(bnScale, bytes(dBnScaleBiasDesc)),
+              op::in(savedMean, bytes(dBnScaleBiasDesc)),
+              op::in(savedInvVariance, bytes(dBnScaleBiasDesc)),
+              op::out(dx, bytes(dxDesc)),
+              op::out(dBnScaleResult, bytes(dBnScaleBiasDesc)),
+              op::out(dBnBiasResult, bytes(dBnScaleBiasDesc)))
+
+CUDNN_WRAPPER(cudnnDropoutForward,
+              (cudnnHandle_t handle, const cudnnDropoutDescriptor_t dropoutDesc,
+               const cudnnTensorDescriptor_t xdesc, const void *x,
+               const cudnnTensorDescriptor_t ydesc, void *y,
+               void *reserveSpace, size_t reserveSpaceSizeInBytes),
+              (handle, dropoutDesc, xdesc, x, ydesc, y, reserveSpace,
+               reserveSpaceSizeInBytes),
+              op::in(x, bytes(xdesc)), op::out(y, bytes(ydesc)),
+              op::out(reserveSpace, reserveSpaceSizeInBytes))
+
+CUDNN_WRAPPER(cudnnDropoutBackward,
+              (cudnnHandle_t handle, const cudnnDropoutDescriptor_t dropoutDesc,
+               const cudnnTensorDescriptor_t dydesc, const void *dy,
+               const cudnnTensorDescriptor_t dxdesc, void *dx,
+               void *reserveSpace, size_t reserveSpaceSizeInBytes),
+              (handle, dropoutDesc, dydesc, dy, dxdesc, dx, reserveSpace,
+               reserveSpaceSizeInBytes),
+              op::in(dy, bytes(dydesc)),
+              op::in(reserveSpace, reserveSpaceSizeInBytes),
+              op::out(dx, bytes(dxdesc)))
@@ -0,0 +1,375 @@
+// Interpose the host allocator so that large pageable host buffers are
+// recorded with their true extents before they are copied to or from the
+// device. Without this, record_memcpy makes up an implicit host allocation
+// the size of each copy.
+//
+// malloc, calloc, realloc, posix_memalign, aligned_alloc, memalign, valloc,
+// pvalloc and writable anonymous mmaps are tracked. Only allocations of at
+// least CPROF_HOST_ALLOC_MIN_BYTES, made while tracing is on, are. It is 0,
+// tracking nothing, by default.
+//
+// These run on every allocation in the process, so unlike the other
+// wrappers they don't print, and they resolve the real functions themselves.
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <tuple>
+#include <unistd.h>
+
+#include "allocations.hpp"
+#include "control.hpp"
+#include "env.hpp"
+#include "pointer_table.hpp"
+
+typedef void *(*mallocFunc)(size_t size);
+typedef void *(*callocFunc)(size_t nmemb, size_t size);
+typedef void *(*reallocFunc)(void *ptr, size_t size);
+typedef void (*freeFunc)(void *ptr);
+typedef int (*posix_memalignFunc)(void **memptr, size_t alignment,
+                                  size_t size);
+typedef void *(*aligned_allocFunc)(size_t alignment, size_t size);
+typedef void *(*memalignFunc)(size_t alignment, size_t size);
+typedef void *(*vallocFunc)(size_t size);
+typedef void *(*mmapFunc)(void *addr, size_t length, int prot, int flags,
+                          int fd, off_t offset);
+typedef int (*munmapFunc)(void *addr, size_t length);
+
+static mallocFunc real_malloc = nullptr;
+static callocFunc real_calloc = nullptr;
+static reallocFunc real_realloc = nullptr;
+static freeFunc real_free = nullptr;
+static posix_memalignFunc real_posix_memalign = nullptr;
+static aligned_allocFunc real_aligned_alloc = nullptr; // null in older glibcs
+static memalignFunc real_memalign = nullptr;
+static vallocFunc real_valloc = nullptr;
+static vallocFunc real_pvalloc = nullptr; // null in libcs without it
+static mmapFunc real_mmap = nullptr;
+static munmapFunc real_munmap = nullptr;
+
+// initial-exec TLS, unlike thread_local in a shared object, doesn't allocate
+// on first access
+#define HOOK_TLS static __thread __attribute__((tls_model("initial-exec")))
+
+// Set while this thread is recording an allocation, so the allocations the
+// profiler itself makes go straight to the real allocator
+HOOK_TLS bool inHook;
+
+class ReentrancyGuard {
+public:
+  ReentrancyGuard() { inHook = true; }
+  ~ReentrancyGuard() { inHook = false; }
+};
+
+// dlsym may allocate while we look up the real allocator. Those allocations
+// come from here, and are never freed.
+HOOK_TLS bool resolving;
+static char bootstrapHeap[16 * 1024] __attribute__((aligned(16)));
+static std::atomic<size_t> bootstrapUsed(0);
+
+static void *bootstrap_alloc(const size_t size) {
+  const size_t rounded = (size + 15) & ~size_t(15);
+  const size_t offset = bootstrapUsed.fetch_add(rounded);
+  assert(offset + rounded <= sizeof(bootstrapHeap) &&
+         "Out of bootstrap heap while resolving the allocator");
+  return bootstrapHeap + offset;
+}
+
+static bool is_bootstrap(const void *ptr) {
+  return ptr >= bootstrapHeap && ptr < bootstrapHeap + sizeof(bootstrapHeap);
+}
+
+static void resolve() {
+  resolving = true;
+  real_malloc = (mallocFunc)dlsym(RTLD_NEXT, "malloc");
+  real_calloc = (callocFunc)dlsym(RTLD_NEXT, "calloc");
+  real_realloc = (reallocFunc)dlsym(RTLD_NEXT, "realloc");
+  real_free = (freeFunc)dlsym(RTLD_NEXT, "free");
+  real_posix_memalign =
+      (posix_memalignFunc)dlsym(RTLD_NEXT, "posix_memalign");
+  real_aligned_alloc = (aligned_allocFunc)dlsym(RTLD_NEXT, "aligned_alloc");
+  real_memalign = (memalignFunc)dlsym(RTLD_NEXT, "memalign");
+  real_valloc = (vallocFunc)dlsym(RTLD_NEXT, "valloc");
+  real_pvalloc = (vallocFunc)dlsym(RTLD_NEXT, "pvalloc");
+  real_mmap = (mmapFunc)dlsym(RTLD_NEXT, "mmap");
+  real_munmap = (munmapFunc)dlsym(RTLD_NEXT, "munmap");
+  resolving = false;
+  assert(real_malloc && real_calloc && real_realloc && real_free &&
+         real_posix_memalign && real_memalign && real_valloc && real_mmap &&
+         real_munmap &&
+         "Will the real allocator please stand up?");
+}
+
+// tracked pointer -> its allocation id
+static PointerTable tracked;
+
+// Allocations is destroyed at exit, but the process keeps freeing memory
+static std::atomic<bool> stopped(false);
+static void stop_tracking() { stopped = true; }
+
+static size_t min_bytes() {
+  static const size_t minBytes = env::host_alloc_min_bytes();
+  return minBytes;
+}
+
+static bool should_track(const void *ptr, const size_t size) {
+  return Control::tracing() && ptr && min_bytes() && size >= min_bytes() &&
+         !inHook && !stopped;
+}
+
+// Record a host allocation. The caller holds a ReentrancyGuard.
+static Allocations::id_type new_host_allocation(const uintptr_t pos,
+                                                const size_t size) {
+  // registered after Allocations is constructed, so it runs before
+  // Allocations is destroyed
+  static const bool registered =
+      (Allocations::instance(), std::atexit(stop_tracking) == 0);
+  (void)registered;
+
+  Allocations::id_type allocId;
+  std::tie(allocId, std::ignore) = Allocations::instance().new_allocation(
+      pos, size, AddressSpace::Host(), Memory(Memory::Host),
+      AllocationRecord::PageType::Pageable);
+  return allocId;
+}
+
+static void track(const void *ptr, const size_t size) {
+  if (!should_track(ptr, size)) {
+    return;
+  }
+  ReentrancyGuard guard;
+
+  const Allocations::id_type allocId =
+      new_host_allocation((uintptr_t)ptr, size);
+  if (!tracked.insert((uintptr_t)ptr, allocId)) {
+    // we wouldn't see it freed, and a stale record would shadow whatever is
+    // allocated there next
+    Allocations::instance().free(allocId);
+    static std::atomic<bool> warned(false);
+    if (!warned.exchange(true)) {
+      printf("WARN: host allocation table full, not tracking some "
+             "allocations (first %lu)\n",
+             (uintptr_t)ptr);
+    }
+  }
+}
+
+// Called before the memory is released, so that the pointer can't be handed
+// out and tracked again until it is untracked. Allocations tracked while
+// tracing was on are untracked even once it is off, so none is left behind.
+// Returns the size of the untracked allocation, 0 if ptr wasn't tracked.
+static size_t untrack(const void *ptr) {
+  if (!ptr || !min_bytes() || inHook || stopped) {
+    return 0;
+  }
+  // the common case: not a tracked allocation
+  const Allocations::id_type allocId = tracked.erase((uintptr_t)ptr);
+  if (!allocId) {
+    return 0;
+  }
+  ReentrancyGuard guard;
+  const size_t size = Allocations::instance().at(allocId)->size();
+  Allocations::instance().free(allocId);
+  return size;
+}
+
+// Tracked anonymous mappings, first byte -> bytes and allocation id. Unlike
+// free(), munmap can release part of a mapping, so they are kept by range.
+// Mappings are made and released by system calls, so a lock costs little.
+typedef std::map<uintptr_t, std::pair<size_t, Allocations::id_type>>
+    MappingMap;
+static std::mutex mappingsMutex;
+
+// allocated on first use, since mmap may be called before constructors run
+static MappingMap &mappings() {
+  static MappingMap *m = new MappingMap;
+  return *m;
+}
+
+static void track_mapping(const void *ptr, const size_t length) {
+  if (!should_track(ptr, length)) {
+    return;
+  }
+  ReentrancyGuard guard;
+  std::lock_guard<std::mutex> lock(mappingsMutex);
+  mappings()[(uintptr_t)ptr] =
+      std::make_pair(length, new_host_allocation((uintptr_t)ptr, length));
+}
+
+// Untrack the bytes [addr, addr + length) of any tracked mappings. What is
+// left of each is tracked as a new allocation, or, while tracing is off, not
+// at all.
+static void untrack_mapping(const void *addr, const size_t length) {
+  if (!min_bytes() || inHook || stopped) {
+    return;
+  }
+  ReentrancyGuard guard;
+  std::lock_guard<std::mutex> lock(mappingsMutex);
+  MappingMap &m = mappings();
+  const uintptr_t pos = (uintptr_t)addr;
+  const uintptr_t end = pos + length;
+  // the first mapping that ends after pos
+  auto it = m.upper_bound(pos);
+  if (it != m.begin()) {
+    const auto prev = std::prev(it);
+    if (prev->first + prev->second.first > pos) {
+      it = prev;
+    }
+  }
+  while (it != m.end() && it->first < end) {
+    const uintptr_t mapPos = it->first;
+    const uintptr_t mapEnd = mapPos + it->second.first;
+    Allocations::instance().free(it->second.second);
+    it = m.erase(it);
+    if (!Control::tracing()) {
+      continue;
+    }
+    if (mapPos < pos) {
+      m[mapPos] = std::make_pair(pos - mapPos,
+                                 new_host_allocation(mapPos, pos - mapPos));
+    }
+    if (end < mapEnd) {
+      // mappings don't overlap, so this was the last one
+      m[end] =
+          std::make_pair(mapEnd - end, new_host_allocation(end, mapEnd - end));
+      break;
+    }
+  }
+}
+
+extern "C" void *malloc(size_t size) {
+  if (!real_malloc) {
+    if (resolving) {
+      return bootstrap_alloc(size);
+    }
+    resolve();
+  }
+  void *ptr = real_malloc(size);
+  track(ptr, size);
+  return ptr;
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size) {
+  if (!real_calloc) {
+    if (resolving) {
+      return bootstrap_alloc(nmemb * size); // zero until handed out
+    }
+    resolve();
+  }
+  void *ptr = real_calloc(nmemb, size);
+  track(ptr, nmemb * size);
+  return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  if (!real_realloc) {
+    resolve();
+  }
+  assert(!is_bootstrap(ptr) && "realloc of bootstrap allocation");
+  const size_t oldSize = untrack(ptr);
+  void *newPtr = real_realloc(ptr, size);
+  if (!newPtr && size) {
+    // failed, and ptr is still allocated
+    track(ptr, oldSize);
+  } else {
+    track(newPtr, size);
+  }
+  return newPtr;
+}
+
+extern "C" void free(void *ptr) {
+  if (is_bootstrap(ptr)) {
+    return;
+  }
+  if (!real_free) {
+    resolve();
+  }
+  untrack(ptr);
+  real_free(ptr);
+}
+
+extern "C" int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (!real_posix_memalign) {
+    resolve();
+  }
+  const int ret = real_posix_memalign(memptr, alignment, size);
+  if (ret == 0) {
+    track(*memptr, size);
+  }
+  return ret;
+}
+
+// older glibcs don't have aligned_alloc, and memalign takes the same
+// arguments
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+  if (!real_memalign) {
+    resolve();
+  }
+  void *ptr = real_aligned_alloc ? real_aligned_alloc(alignment, size)
+                                 : real_memalign(alignment, size);
+  track(ptr, size);
+  return ptr;
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+  if (!real_memalign) {
+    resolve();
+  }
+  void *ptr = real_memalign(alignment, size);
+  track(ptr, size);
+  return ptr;
+}
+
+extern "C" void *valloc(size_t size) {
+  if (!real_valloc) {
+    resolve();
+  }
+  void *ptr = real_valloc(size);
+  track(ptr, size);
+  return ptr;
+}
+
+// size rounded up to whole pages
+extern "C" void *pvalloc(size_t size) {
+  if (!real_valloc) {
+    resolve();
+  }
+  const size_t page = sysconf(_SC_PAGESIZE);
+  const size_t rounded = (size + page - 1) & ~(page - 1);
+  void *ptr = real_pvalloc ? real_pvalloc(size) : real_memalign(page, rounded);
+  track(ptr, rounded);
+  return ptr;
+}
+
+extern "C" void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+                      off_t offset) {
+  if (!real_mmap) {
+    resolve();
+  }
+  if (flags & MAP_FIXED) {
+    // replaces whatever was mapped there
+    untrack_mapping(addr, length);
+  }
+  void *ptr = real_mmap(addr, length, prot, flags, fd, offset);
+  // Only writable anonymous memory: the CUDA driver maps device files and
+  // reserves PROT_NONE ranges that unified addressing hands out as device
+  // pointers
+  if (ptr != MAP_FAILED && (flags & MAP_ANONYMOUS) && (prot & PROT_WRITE)) {
+    track_mapping(ptr, length);
+  }
+  return ptr;
+}
+
+extern "C" int munmap(void *addr, size_t length) {
+  if (!real_munmap) {
+    resolve();
+  }
+  untrack_mapping(addr, length);
+  return real_munmap(addr, length);
+}
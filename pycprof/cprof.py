@@ -38,6 +38,18 @@ def run_handlers(handler_list, path=None):
                 obj = Allocation(j["allocation"])
             elif "api" in j:
                 obj = API(j["api"])
+            elif "dep" in j:
+                obj = Dep(j["dep"])
+            elif "device" in j:
+                obj = Device(j["device"])
+            elif "transfer" in j:
+                obj = Transfer(j["transfer"])
+            elif "transfer_buffer" in j:
+                obj = TransferBuffer(j["transfer_buffer"])
+            elif "peer_transfer" in j:
+                obj = PeerTransfer(j["peer_transfer"])
+            elif "unified_memory" in j:
+                obj = UnifiedMemory(j["unified_memory"])
             else:
                 continue
 
@@ -58,6 +70,20 @@ class Value(object):
         self.pos = int(j["pos"])
         self.allocation_id = int(j["allocation_id"])
         self.initialized = j["initialized"]
+        self.digest = j.get("digest", None)
+        # strided values are count blocks, stride bytes apart, spanning size
+        self.stride = int(j.get("stride", 0))
+        self.count = int(j.get("count", 1))
+        # scattered values are a sorted list of (pos, size) ranges
+        self.ranges = [(int(r["pos"]), int(r["size"]))
+                       for r in j.get("ranges", [])]
+
+    def blocks(self):
+        """ (pos, size) of each range of bytes the value covers """
+        if self.ranges:
+            return self.ranges
+        block = self.size - (self.count - 1) * self.stride
+        return [(self.pos + i * self.stride, block) for i in range(self.count)]
 
 class Allocation(object):
     def __init__(self, j):
@@ -67,6 +93,10 @@ class Allocation(object):
         self.type = j["type"]
         self.address_space = json.loads(j["addrsp"])
         self.mem = Memory(json.loads(j["mem"]))
+        # the packed location (see location.hpp), 0 in older traces
+        self.loc = int(j.get("loc", 0))
+        # cudaMallocManaged flags, 0 for other allocations
+        self.flags = int(j.get("flags", 0))
 
 class API(object):
     def __init__(self, j):
@@ -74,6 +104,15 @@ class API(object):
         self.functionName = j["name"]
         self.symbol = j["symbolname"]
         self.device = j["device"]
+        self.start = int(j["start"])
+        self.end = int(j["end"])
+        self.callsite = j.get("callsite", "")
+        self.op = Op(j["op"]) if "op" in j else None
+        # stream-ordered calls have a stream. happens_after are the ids of
+        # calls that finish before this one starts.
+        self.stream = int(j["stream"]) if "stream" in j else None
+        after = j.get("happens_after", "")
+        self.happens_after = [] if after == "" else [int(x) for x in after]
 
         inputs = j["inputs"]
         outputs = j["outputs"]
@@ -86,6 +125,85 @@ class API(object):
         else:
             self.outputs = [int(x) for x in outputs]
 
+class Op(object):
+    """ What a known library call computes """
+    def __init__(self, j):
+        self.kind = j["kind"]
+        shape = j["shape"]
+        self.shape = [] if shape == "" else [int(x) for x in shape]
+        self.dtype = j["dtype"]
+        self.flops = int(j["flops"])
+        self.bytes_read = int(j["bytes_read"])
+        self.bytes_written = int(j["bytes_written"])
+
+class Dep(object):
+    def __init__(self, j):
+        self.src_id = int(j["src_id"])
+        self.dst_id = int(j["dst_id"])
+
+class Transfer(object):
+    """ Bandwidth of host<->device memcpys of one direction, host page type,
+    host NUMA node, and device """
+    def __init__(self, j):
+        self.direction = j["direction"]
+        self.page_type = j["page_type"]
+        self.numa_node = int(j["numa_node"])
+        self.device = int(j["device"])
+        self.device_numa_node = int(j.get("device_numa_node", -1))
+        self.count = int(j["count"])
+        self.bytes = int(j["bytes"])
+        # of the copies whose ns cover them, see transfer_stats.hpp
+        self.timed_bytes = int(j.get("timed_bytes", self.bytes))
+        self.ns = int(j["ns"])
+        self.gbps = float(j["gbps"])
+
+class TransferBuffer(Transfer):
+    """ Transfer totals of one host allocation. slow is None if there was
+    no pinned baseline. """
+    def __init__(self, j):
+        super(TransferBuffer, self).__init__(j)
+        self.allocation_id = int(j["allocation_id"])
+        self.pinned_gbps = float(j.get("pinned_gbps", 0))
+        self.slow = j["slow"] == "true" if "slow" in j else None
+
+class PeerTransfer(object):
+    """ Totals of memcpys from one device's memory to another's, or within
+    one device's if src_device == dst_device """
+    def __init__(self, j):
+        self.src_device = int(j["src_device"])
+        self.dst_device = int(j["dst_device"])
+        self.count = int(j["count"])
+        self.bytes = int(j["bytes"])
+        self.timed_bytes = int(j.get("timed_bytes", self.bytes))
+        self.ns = int(j["ns"])
+        self.gbps = float(j["gbps"])
+
+class UnifiedMemory(object):
+    """ Unified memory activity of one managed allocation, allocation_id 0
+    for activity outside them. Each of htod, dtoh, dtod, cpu_page_faults,
+    gpu_page_faults, thrashing, throttling, remote_map and prefetch is a dict
+    with "count" and "bytes" or "faults", empty if there was none. """
+    KINDS = ("htod", "dtoh", "dtod", "cpu_page_faults", "gpu_page_faults",
+             "thrashing", "throttling", "remote_map", "prefetch")
+
+    def __init__(self, j):
+        self.allocation_id = int(j["allocation_id"])
+        self.migrations = int(j["migrations"])
+        self.migrated_bytes = int(j["migrated_bytes"])
+        self.migration_ns = int(j["migration_ns"])
+        for kind in self.KINDS:
+            setattr(self, kind,
+                    dict((k, int(v)) for k, v in j.get(kind, {}).iteritems()))
+        # an empty list is written as ""
+        self.advice = j["advice"] if isinstance(j["advice"], list) else []
+
+class Device(object):
+    """ Where a CUDA device is attached. numa_node is -1 if unknown. """
+    def __init__(self, j):
+        self.id_ = int(j["id"])
+        self.pci_bus_id = j["pci_bus_id"]
+        self.numa_node = int(j["numa_node"])
+
 class Memory(object):
     def __init__(self, j):
         self.location = j["loc"]
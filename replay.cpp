@@ -0,0 +1,467 @@
+/*
+Replay CUPTI callbacks through the profiler without a GPU, to measure the
+overhead of the profiler itself.
+
+  ./replay [-t threads] [-a allocations] [-k kernel-args] [-m memcpy-rate]
+           [-n events-per-thread] [-s seed] [-r recorded.cprof] [-v]
+
+Each thread generates a synthetic workload (cudaMalloc, then a mix of
+host-to-device cudaMemcpys and kernel launches, then cudaFree), or replays
+the allocations, memcpys, and launches from a recorded trace, and feeds the
+matching CUpti_CallbackData into callback().
+
+Profiler output goes to CPROF_OUT, /dev/null unless set. Profiler stdout is
+discarded unless -v.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "callbacks.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::read_json;
+
+typedef std::chrono::steady_clock Clock;
+
+// CPU-only stand-ins for the CUDA and CUPTI entry points the profiler calls
+
+extern "C" CUptiResult cuptiDeviceGetTimestamp(CUcontext context,
+                                               uint64_t *timestamp) {
+  (void)context;
+  *timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   Clock::now().time_since_epoch())
+                   .count();
+  return CUPTI_SUCCESS;
+}
+
+extern "C" CUptiResult cuptiGetTimestamp(uint64_t *timestamp) {
+  return cuptiDeviceGetTimestamp(nullptr, timestamp);
+}
+
+extern "C" CUptiResult cuptiGetResultString(CUptiResult result,
+                                            const char **str) {
+  (void)result;
+  *str = "replay";
+  return CUPTI_SUCCESS;
+}
+
+extern "C" const char *cudaGetErrorString(cudaError_t error) {
+  (void)error;
+  return "replay";
+}
+
+// device pointers are fake, leave the host buffer alone
+extern "C" cudaError_t cudaMemcpy(void *dst, const void *src, size_t count,
+                                  cudaMemcpyKind kind) {
+  (void)dst;
+  (void)src;
+  (void)count;
+  (void)kind;
+  return cudaSuccess;
+}
+
+extern "C" cudaError_t cudaDeviceSynchronize() { return cudaSuccess; }
+
+// not a real PCI device, so its NUMA node is unknown
+extern "C" cudaError_t cudaDeviceGetPCIBusId(char *pciBusId, int len,
+                                             int device) {
+  snprintf(pciBusId, len, "ffff:ff:%02x.0", device);
+  return cudaSuccess;
+}
+
+struct Workload {
+  size_t threads = 1;
+  size_t allocations = 64;
+  size_t kernelArgs = 4;
+  size_t events = 10000;
+  double memcpyRate = 0.25;
+  size_t maxMemcpy = 1 << 20;
+  unsigned seed = 1;
+  std::string recorded;
+  bool verbose = false;
+};
+
+struct Event {
+  enum class Type { Malloc, Free, Memcpy, Launch };
+  Type type;
+  uintptr_t dst;
+  uintptr_t src;
+  size_t size;
+  cudaMemcpyKind kind;
+  std::string symbol;
+  std::vector<uintptr_t> args;
+};
+
+class Replayer {
+private:
+  std::vector<uint64_t> latencies_;
+  std::vector<char> hostBuf_; // stands in for every host pointer
+
+  void api(const CUpti_CallbackDomain domain, const CUpti_CallbackId cbid,
+           const char *name, const void *params, const char *symbol) {
+    cudaError_t ret = cudaSuccess;
+    uint64_t correlation = 0;
+    CUpti_CallbackData cbInfo;
+    std::memset(&cbInfo, 0, sizeof(cbInfo));
+    cbInfo.functionName = name;
+    cbInfo.functionParams = params;
+    cbInfo.functionReturnValue = &ret;
+    cbInfo.symbolName = symbol;
+    cbInfo.correlationData = &correlation;
+
+    const auto start = Clock::now();
+    cbInfo.callbackSite = CUPTI_API_ENTER;
+    callback(nullptr, domain, cbid, &cbInfo);
+    cbInfo.callbackSite = CUPTI_API_EXIT;
+    callback(nullptr, domain, cbid, &cbInfo);
+    latencies_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             Clock::now() - start)
+                             .count());
+  }
+
+  void runtime(const CUpti_CallbackId cbid, const char *name,
+               const void *params, const char *symbol = nullptr) {
+    api(CUPTI_CB_DOMAIN_RUNTIME_API, cbid, name, params, symbol);
+  }
+
+public:
+  explicit Replayer(const size_t hostBytes) : hostBuf_(hostBytes, 1) {}
+
+  uintptr_t host() const { return uintptr_t(hostBuf_.data()); }
+  const std::vector<uint64_t> &latencies() const { return latencies_; }
+
+  void set_device(const int device) {
+    cudaSetDevice_v3020_params params;
+    params.device = device;
+    runtime(CUPTI_RUNTIME_TRACE_CBID_cudaSetDevice_v3020, "cudaSetDevice",
+            &params);
+  }
+
+  void replay(const Event &e) {
+    switch (e.type) {
+    case Event::Type::Malloc: {
+      void *devPtr = reinterpret_cast<void *>(e.dst);
+      cudaMalloc_v3020_params params;
+      params.devPtr = &devPtr;
+      params.size = e.size;
+      runtime(CUPTI_RUNTIME_TRACE_CBID_cudaMalloc_v3020, "cudaMalloc",
+              &params);
+    } break;
+    case Event::Type::Free: {
+      cudaFree_v3020_params params;
+      params.devPtr = reinterpret_cast<void *>(e.dst);
+      runtime(CUPTI_RUNTIME_TRACE_CBID_cudaFree_v3020, "cudaFree", &params);
+    } break;
+    case Event::Type::Memcpy: {
+      cudaMemcpy_v3020_params params;
+      params.dst = reinterpret_cast<void *>(e.dst ? e.dst : host());
+      params.src = reinterpret_cast<const void *>(e.src ? e.src : host());
+      params.count = std::min(e.size, hostBuf_.size());
+      params.kind = e.kind;
+      runtime(CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, "cudaMemcpy",
+              &params);
+    } break;
+    case Event::Type::Launch: {
+      cudaConfigureCall_v3020_params configure;
+      configure.gridDim = dim3(1);
+      configure.blockDim = dim3(1);
+      configure.sharedMem = 0;
+      configure.stream = nullptr;
+      runtime(CUPTI_RUNTIME_TRACE_CBID_cudaConfigureCall_v3020,
+              "cudaConfigureCall", &configure);
+      for (size_t i = 0; i < e.args.size(); ++i) {
+        cudaSetupArgument_v3020_params setup;
+        setup.arg = &e.args[i];
+        setup.size = sizeof(e.args[i]);
+        setup.offset = i * sizeof(e.args[i]);
+        runtime(CUPTI_RUNTIME_TRACE_CBID_cudaSetupArgument_v3020,
+                "cudaSetupArgument", &setup);
+      }
+      cudaLaunch_v3020_params launch;
+      launch.entry = e.symbol.c_str();
+      runtime(CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020, "cudaLaunch", &launch,
+              e.symbol.c_str());
+    } break;
+    }
+  }
+};
+
+// Mostly small allocations, some medium, a few huge ones, with gaps between
+// them like a fragmented pool.
+static std::vector<Event> synthetic(const Workload &w, const size_t tid) {
+  std::mt19937_64 rng(w.seed + tid);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  auto log_uniform = [&](const double lo, const double hi) {
+    return size_t(std::exp(std::log(lo) + uniform(rng) * std::log(hi / lo)));
+  };
+
+  std::vector<Event> events;
+  std::vector<Event> allocs;
+  uintptr_t next = uintptr_t(tid + 1) << 40;
+  for (size_t i = 0; i < w.allocations; ++i) {
+    const double r = uniform(rng);
+    size_t size;
+    if (r < 0.9) {
+      size = log_uniform(4096, 1 << 20);
+    } else if (r < 0.98) {
+      size = log_uniform(1 << 20, 64 << 20);
+    } else {
+      size = log_uniform(256 << 20, size_t(2) << 30);
+    }
+    Event e;
+    e.type = Event::Type::Malloc;
+    e.dst = next;
+    e.size = size;
+    allocs.push_back(e);
+    next += (size + 0xFFF) & ~uintptr_t(0xFFF);
+    next += 4096 * log_uniform(1, 256); // gap
+  }
+  events = allocs;
+
+  std::uniform_int_distribution<size_t> pick(0, allocs.size() - 1);
+  for (size_t i = 0; i < w.events; ++i) {
+    Event e;
+    if (uniform(rng) < w.memcpyRate) {
+      const auto &a = allocs[pick(rng)];
+      e.type = Event::Type::Memcpy;
+      e.dst = a.dst;
+      e.src = 0; // host buffer
+      e.size = std::min(a.size, log_uniform(256, w.maxMemcpy));
+      e.kind = cudaMemcpyHostToDevice;
+    } else {
+      e.type = Event::Type::Launch;
+      e.symbol = "kernel" + std::to_string(i % 16);
+      for (size_t k = 0; k < w.kernelArgs; ++k) {
+        const auto &a = allocs[pick(rng)];
+        e.args.push_back(a.dst + std::min(a.size - 1, size_t(64) * k));
+      }
+    }
+    events.push_back(e);
+  }
+
+  for (const auto &a : allocs) {
+    Event e;
+    e.type = Event::Type::Free;
+    e.dst = a.dst;
+    events.push_back(e);
+  }
+  return events;
+}
+
+// Device allocations, memcpys, and launches from a profiler trace. Host
+// pointers are replaced by the replayer's host buffer.
+static std::vector<Event> recorded(const std::string &path) {
+  std::map<std::string, bool> allocIsCuda;
+  std::map<std::string, std::pair<uintptr_t, size_t>> vals;
+  std::map<std::string, std::string> valAlloc;
+  std::vector<Event> events;
+
+  std::ifstream f(path);
+  std::string line;
+  while (std::getline(f, line)) {
+    std::istringstream is(line);
+    ptree pt;
+    read_json(is, pt);
+
+    if (pt.count("allocation")) {
+      const auto &a = pt.get_child("allocation");
+      ptree as;
+      std::istringstream asBuf(a.get<std::string>("addrsp"));
+      read_json(asBuf, as);
+      const bool isCuda = as.get<std::string>("type") == "cuda" &&
+                          a.get<std::string>("type") != "pinned";
+      allocIsCuda[a.get<std::string>("id")] = isCuda;
+      if (isCuda) {
+        Event e;
+        e.type = Event::Type::Malloc;
+        e.dst = a.get<uintptr_t>("pos");
+        e.size = a.get<size_t>("size");
+        events.push_back(e);
+      }
+    } else if (pt.count("val")) {
+      const auto &v = pt.get_child("val");
+      const auto id = v.get<std::string>("id");
+      vals[id] = std::make_pair(v.get<uintptr_t>("pos"), v.get<size_t>("size"));
+      valAlloc[id] = v.get<std::string>("allocation_id");
+    } else if (pt.count("api")) {
+      const auto &a = pt.get_child("api");
+      const auto name = a.get<std::string>("name");
+      std::vector<std::string> inputs, outputs;
+      for (const auto &i : a.get_child("inputs")) {
+        inputs.push_back(i.second.data());
+      }
+      for (const auto &o : a.get_child("outputs")) {
+        outputs.push_back(o.second.data());
+      }
+
+      if (name == "cudaLaunch") {
+        Event e;
+        e.type = Event::Type::Launch;
+        e.symbol = a.get<std::string>("symbolname");
+        for (const auto &i : inputs) {
+          e.args.push_back(vals[i].first);
+        }
+        events.push_back(e);
+      } else if (name.find("cudaMemcpy") == 0 && inputs.size() == 1 &&
+                 outputs.size() == 1) {
+        const bool srcCuda = allocIsCuda[valAlloc[inputs[0]]];
+        const bool dstCuda = allocIsCuda[valAlloc[outputs[0]]];
+        Event e;
+        e.type = Event::Type::Memcpy;
+        e.src = srcCuda ? vals[inputs[0]].first : 0;
+        e.dst = dstCuda ? vals[outputs[0]].first : 0;
+        e.size = vals[outputs[0]].second;
+        if (srcCuda && dstCuda) {
+          e.kind = cudaMemcpyDeviceToDevice;
+        } else if (srcCuda) {
+          e.kind = cudaMemcpyDeviceToHost;
+        } else if (dstCuda) {
+          e.kind = cudaMemcpyHostToDevice;
+        } else {
+          continue;
+        }
+        events.push_back(e);
+      }
+    }
+  }
+  return events;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-t threads] [-a allocations] [-k kernel-args] "
+          "[-m memcpy-rate] [-n events-per-thread] [-s seed] "
+          "[-r recorded.cprof] [-v]\n",
+          argv0);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  Workload w;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:a:k:m:n:s:r:v")) != -1) {
+    switch (opt) {
+    case 't':
+      w.threads = std::stoul(optarg);
+      break;
+    case 'a':
+      w.allocations = std::stoul(optarg);
+      break;
+    case 'k':
+      w.kernelArgs = std::stoul(optarg);
+      break;
+    case 'm':
+      w.memcpyRate = std::stod(optarg);
+      break;
+    case 'n':
+      w.events = std::stoul(optarg);
+      break;
+    case 's':
+      w.seed = std::stoul(optarg);
+      break;
+    case 'r':
+      w.recorded = optarg;
+      break;
+    case 'v':
+      w.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (w.threads == 0 || w.allocations == 0) {
+    usage(argv[0]);
+  }
+  setenv("CPROF_OUT", "/dev/null", 0 /*don't overwrite*/);
+
+  // Generate everything up front so only the profiler is timed
+  std::vector<std::vector<Event>> workloads(w.threads);
+  if (!w.recorded.empty()) {
+    workloads[0] = recorded(w.recorded);
+    for (size_t t = 1; t < w.threads; ++t) {
+      workloads[t] = workloads[0];
+      for (auto &e : workloads[t]) { // keep each thread's device memory apart
+        const uintptr_t offset = uintptr_t(t) << 44;
+        e.dst = e.dst ? e.dst + offset : 0;
+        e.src = (e.src && e.type == Event::Type::Memcpy) ? e.src + offset : 0;
+        for (auto &a : e.args) {
+          a += offset;
+        }
+      }
+    }
+  } else {
+    for (size_t t = 0; t < w.threads; ++t) {
+      workloads[t] = synthetic(w, t);
+    }
+  }
+
+  std::vector<Replayer> replayers(w.threads, Replayer(w.maxMemcpy));
+
+  int savedStdout = -1;
+  if (!w.verbose) {
+    fflush(stdout);
+    savedStdout = dup(STDOUT_FILENO);
+    const int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+  }
+
+  const auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < w.threads; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      replayers[t].set_device(0);
+      for (const auto &e : workloads[t]) {
+        replayers[t].replay(e);
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  if (!w.verbose) {
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+  }
+
+  std::vector<uint64_t> latencies;
+  for (const auto &r : replayers) {
+    latencies.insert(latencies.end(), r.latencies().begin(),
+                     r.latencies().end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  assert(!latencies.empty());
+  auto percentile = [&](const double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              size_t(p / 100 * latencies.size()))];
+  };
+
+  printf("{\"replay\": {\"threads\": %lu, \"events\": %lu, \"seconds\": %f, "
+         "\"events_per_second\": %f, \"latency_ns\": {\"p50\": %lu, \"p90\": "
+         "%lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}}}\n",
+         w.threads, latencies.size(), seconds, latencies.size() / seconds,
+         percentile(50), percentile(90), percentile(99), percentile(99.9),
+         latencies.back());
+  return 0;
+}
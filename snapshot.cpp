@@ -0,0 +1,356 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "env.hpp"
+#include "trace_output.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+// The file is a header, then the allocations, the values and the ranges of
+// range list values, each an array of fixed-size records.
+const uint32_t Snapshots::version = 1;
+
+static const char magic[8] = {'c', 'p', 'r', 'o', 'f', 's', 'n', 'p'};
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t generation;
+  uint64_t numAllocations;
+  uint64_t numValues;
+  uint64_t numRanges;
+  uint64_t bytes; // of the whole file
+};
+
+struct SnapshotAllocation {
+  uint64_t id;
+  uint64_t pos;
+  uint64_t size;
+  uint64_t loc; // Location::bits
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct SnapshotValue {
+  uint64_t id;
+  uint64_t allocationId;
+  uint64_t pos;
+  uint64_t size;
+  uint64_t stride;
+  uint64_t count;
+  uint64_t firstRange; // of a range list, in the ranges
+  uint64_t numRanges;  // 0 if not a range list
+  uint64_t digest;
+  uint8_t hasDigest;
+  uint8_t initialized;
+  uint8_t reserved[6];
+};
+
+struct SnapshotRange {
+  uint64_t pos;
+  uint64_t size;
+};
+
+static_assert(sizeof(SnapshotHeader) == 56, "snapshot header layout");
+static_assert(sizeof(SnapshotAllocation) == 40, "snapshot allocation layout");
+static_assert(sizeof(SnapshotValue) == 80, "snapshot value layout");
+
+static uint64_t snapshot_bytes(const SnapshotHeader &h) {
+  return sizeof(SnapshotHeader) +
+         h.numAllocations * sizeof(SnapshotAllocation) +
+         h.numValues * sizeof(SnapshotValue) +
+         h.numRanges * sizeof(SnapshotRange);
+}
+
+bool Snapshots::write(const std::string &path, const uint64_t generation,
+                      const std::vector<Allocations::value_type> &allocations,
+                      const std::vector<Values::value_type> &values) {
+  SnapshotHeader h;
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.reserved = 0;
+  h.generation = generation;
+  h.numAllocations = allocations.size();
+  h.numValues = values.size();
+  h.numRanges = 0;
+  for (const auto &v : values) {
+    if (v->is_range_list()) {
+      h.numRanges += v->blocks().size();
+    }
+  }
+  h.bytes = snapshot_bytes(h);
+
+  // unique per process, so processes sharing a path don't write over each
+  // other's temporary file while it is mapped
+  const std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+  const int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("WARN: couldn't open snapshot %s: %s\n", tmpPath.c_str(),
+           strerror(errno));
+    return false;
+  }
+  if (ftruncate(fd, h.bytes)) {
+    printf("WARN: couldn't size snapshot %s: %s\n", tmpPath.c_str(),
+           strerror(errno));
+    close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, h.bytes, PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("WARN: couldn't map snapshot %s: %s\n", tmpPath.c_str(),
+           strerror(errno));
+    return false;
+  }
+
+  char *const base = static_cast<char *>(map);
+  std::memcpy(base, &h, sizeof(h));
+  auto *allocs = reinterpret_cast<SnapshotAllocation *>(base + sizeof(h));
+  for (const auto &a : allocations) {
+    SnapshotAllocation &r = *allocs++;
+    r.id = a->Id();
+    r.pos = a->pos();
+    r.size = a->size();
+    r.loc = a->location().bits();
+    r.flags = a->flags();
+    r.reserved = 0;
+  }
+  auto *vals = reinterpret_cast<SnapshotValue *>(allocs);
+  auto *ranges = reinterpret_cast<SnapshotRange *>(vals + values.size());
+  uint64_t numRanges = 0;
+  for (const auto &v : values) {
+    SnapshotValue &r = *vals++;
+    std::memset(&r, 0, sizeof(r));
+    r.id = v->Id();
+    r.allocationId = v->allocation_id();
+    r.pos = v->pos();
+    r.size = v->size();
+    r.stride = v->stride();
+    r.count = v->count();
+    r.hasDigest = bool(v->digest());
+    r.digest = r.hasDigest ? v->digest().value() : 0;
+    r.initialized = v->is_initialized();
+    if (v->is_range_list()) {
+      r.firstRange = numRanges;
+      for (const auto &b : v->blocks()) {
+        ranges[numRanges].pos = b.pos();
+        ranges[numRanges].size = b.size();
+        ++numRanges;
+      }
+      r.numRanges = numRanges - r.firstRange;
+    }
+  }
+
+  munmap(map, h.bytes);
+  if (rename(tmpPath.c_str(), path.c_str())) {
+    printf("WARN: couldn't rename snapshot to %s: %s\n", path.c_str(),
+           strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static void write_restored(const uintptr_t id, const uint64_t from,
+                           const uint64_t generation) {
+  ptree pt;
+  pt.put("restored.id", id);
+  pt.put("restored.from", from);
+  pt.put("restored.generation", generation);
+  std::ostringstream buf;
+  write_json(buf, pt, false);
+  TraceOutput::instance().write_event(buf.str());
+}
+
+uint64_t Snapshots::restore(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || size_t(st.st_size) < sizeof(SnapshotHeader)) {
+    close(fd);
+    printf("WARN: ignoring truncated snapshot %s\n", path.c_str());
+    return 0;
+  }
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("WARN: couldn't map snapshot %s: %s\n", path.c_str(),
+           strerror(errno));
+    return 0;
+  }
+
+  const char *const base = static_cast<const char *>(map);
+  SnapshotHeader h;
+  std::memcpy(&h, base, sizeof(h));
+  const uint64_t bytes = st.st_size;
+  if (std::memcmp(h.magic, magic, sizeof(magic)) || h.version != version ||
+      h.bytes != bytes || h.numAllocations > bytes || h.numValues > bytes ||
+      h.numRanges > bytes || snapshot_bytes(h) != bytes) {
+    printf("WARN: ignoring snapshot %s, not a version %u snapshot\n",
+           path.c_str(), version);
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  auto &allocations = Allocations::instance();
+  auto &values = Values::instance();
+  const auto *allocs =
+      reinterpret_cast<const SnapshotAllocation *>(base + sizeof(h));
+  const auto *vals =
+      reinterpret_cast<const SnapshotValue *>(allocs + h.numAllocations);
+  const auto *ranges =
+      reinterpret_cast<const SnapshotRange *>(vals + h.numValues);
+
+  // id in the snapshot -> restored id
+  std::map<uint64_t, Allocations::id_type> allocIds;
+  for (uint64_t i = 0; i < h.numAllocations; ++i) {
+    const SnapshotAllocation &r = allocs[i];
+    const Location loc(r.loc);
+    const AddressSpace as = loc.address_space();
+    if (!as.is_valid() || !r.pos) {
+      continue;
+    }
+    Allocations::id_type id;
+    std::tie(id, std::ignore) =
+        allocations.new_allocation(r.pos, r.size, as, loc.memory(),
+                                   loc.page_type(), r.flags);
+    allocations.mark_restored(id);
+    allocIds[r.id] = id;
+    write_restored(id, r.id, h.generation);
+  }
+
+  size_t numValues = 0;
+  for (uint64_t i = 0; i < h.numValues; ++i) {
+    const SnapshotValue &r = vals[i];
+    const auto alloc = allocIds.find(r.allocationId);
+    if (alloc == allocIds.end() || r.firstRange + r.numRanges > h.numRanges) {
+      continue;
+    }
+    Value *v;
+    if (r.numRanges) {
+      std::vector<Extent> extents;
+      for (uint64_t j = r.firstRange; j < r.firstRange + r.numRanges; ++j) {
+        extents.emplace_back(ranges[j].pos, ranges[j].size);
+      }
+      v = new Value(extents, alloc->second, r.initialized);
+    } else if (r.count > 1) {
+      const size_t block = r.size - (r.count - 1) * r.stride;
+      v = new Value(r.pos, block, r.stride, r.count, alloc->second,
+                    r.initialized);
+    } else {
+      v = new Value(r.pos, r.size, alloc->second, r.initialized);
+    }
+    if (r.hasDigest) {
+      v->set_digest(r.digest);
+    }
+    const auto id = values.insert(Values::value_type(v)).first->first;
+    write_restored(id, r.id, h.generation);
+    ++numValues;
+  }
+
+  munmap(map, st.st_size);
+  printf("restored %lu allocations and %lu values from snapshot %lu\n",
+         allocIds.size(), numValues, h.generation);
+  return h.generation;
+}
+
+void Snapshots::snapshot() {
+  if (path_.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(snapshotMutex_);
+  const auto allocations = Allocations::instance().live();
+  const auto newest = Values::instance().newest(env::snapshot_max_values());
+
+  // the newest value of each extent of a live allocation, written oldest
+  // first so they are restored in order
+  std::set<Allocations::id_type> live;
+  for (const auto &a : allocations) {
+    live.insert(a->Id());
+  }
+  std::set<std::tuple<Allocations::id_type, uintptr_t, size_t>> seen;
+  std::vector<Values::value_type> values;
+  for (const auto &v : newest) {
+    if (live.count(v->allocation_id()) &&
+        seen.insert(std::make_tuple(v->allocation_id(), v->pos(), v->size()))
+            .second) {
+      values.push_back(v);
+    }
+  }
+  std::reverse(values.begin(), values.end());
+
+  if (write(path_, generation_ + 1, allocations, values)) {
+    ++generation_;
+  }
+}
+
+void Snapshots::run(const size_t intervalSeconds) {
+  std::unique_lock<std::mutex> lock(stopMutex_);
+  while (!stopCv_.wait_for(lock, std::chrono::seconds(intervalSeconds),
+                           [this] { return stop_; })) {
+    lock.unlock();
+    snapshot();
+    lock.lock();
+  }
+}
+
+Snapshots::Snapshots()
+    : path_(TraceOutput::expand(env::snapshot_path(), getpid(),
+                                get_thread_id())),
+      generation_(0), pid_(getpid()), stop_(false) {
+  // constructed first, so they outlive the snapshot at exit
+  Allocations::instance();
+  Values::instance();
+  if (path_.empty()) {
+    return;
+  }
+  generation_ = restore(path_);
+  const size_t interval = env::snapshot_interval_s();
+  if (interval) {
+    thread_ = std::thread(&Snapshots::run, this, interval);
+  }
+}
+
+Snapshots &Snapshots::instance() {
+  static Snapshots s;
+  return s;
+}
+
+Snapshots::~Snapshots() {
+  if (getpid() != pid_) {
+    // the thread wasn't forked with the process, and the parent's snapshot
+    // isn't this process's to write
+    if (thread_.joinable()) {
+      thread_.detach();
+    }
+    return;
+  }
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(stopMutex_);
+      stop_ = true;
+    }
+    stopCv_.notify_one();
+    thread_.join();
+  }
+  snapshot();
+}
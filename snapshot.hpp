@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "allocations.hpp"
+#include "values.hpp"
+
+// Snapshots of the live allocations and the newest value of each of their
+// extents, so a profiler that restarts, like one in a job resumed from a
+// checkpoint, doesn't start empty and make implicit allocations for memory
+// the last run knew about.
+//
+// With CPROF_SNAPSHOT set, a background thread writes a snapshot there every
+// CPROF_SNAPSHOT_INTERVAL_S seconds, and one more is written at exit. The path
+// takes the placeholders of CPROF_OUT (see trace_output.hpp), so ranks sharing
+// a node each keep their own snapshot. Use %r or %h rather than %p, which
+// changes when the job restarts.
+//
+// Locks are only held to copy the live allocations and the newest
+// CPROF_SNAPSHOT_MAX_VALUES values, so application threads wait for at most
+// that copy. The file is filled through mmap next to the last snapshot, under
+// a name unique to the process, and renamed over it, so a snapshot is always
+// complete.
+//
+// At start, a snapshot with this version is restored. Restored allocations and
+// values get new ids, and a "restored" record gives the id each had in the
+// trace of the run that wrote the snapshot. A restored allocation is dropped
+// when the application allocates over it.
+class Snapshots {
+public:
+  static const uint32_t version;
+
+  // write allocations and values to path, false on error
+  static bool write(const std::string &path, uint64_t generation,
+                    const std::vector<Allocations::value_type> &allocations,
+                    const std::vector<Values::value_type> &values);
+  // restore the snapshot at path into Allocations and Values, returning its
+  // generation, 0 if there is no valid one
+  static uint64_t restore(const std::string &path);
+
+  // write a snapshot now, if CPROF_SNAPSHOT is set
+  void snapshot();
+
+  static Snapshots &instance();
+  ~Snapshots();
+
+private:
+  std::string path_; // empty for none
+  uint64_t generation_;
+  pid_t pid_; // that runs thread_, a forked child writes no snapshots
+  std::thread thread_;
+  std::mutex snapshotMutex_; // one snapshot at a time
+  std::mutex stopMutex_;
+  std::condition_variable stopCv_;
+  bool stop_;
+
+  Snapshots();
+  void run(size_t intervalSeconds);
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "streams.hpp"
+
+#include <cassert>
+
+// api waits for op, if op is some other api
+static void happens_after(ApiRecord &api, const ApiRecord::id_type op) {
+  if (op != ApiRecord::noid && op != api.Id()) {
+    api.add_happens_after(op);
+  }
+}
+
+static Streams::id_type stream_id(cudaStream_t s) {
+  return s == cudaStreamLegacy ? 0 : (Streams::id_type)s;
+}
+
+// streams created before we were loaded are blocking, like most
+Streams::Stream &Streams::stream(cudaStream_t s) {
+  return streams_[stream_id(s)];
+}
+
+Streams::Op Streams::enqueue_locked(ApiRecord &api, cudaStream_t s) {
+  const id_type id = stream_id(s);
+  Stream &current = streams_[id];
+  api.set_stream(id);
+  happens_after(api, current.last.api);
+
+  if (id == 0) {
+    for (const auto &kv : streams_) {
+      const Stream &other = kv.second;
+      if (kv.first != 0 && other.blocking &&
+          other.last.seq > current.last.seq) {
+        happens_after(api, other.last.api);
+      }
+    }
+  } else if (current.blocking) {
+    const Stream &legacy = streams_[0];
+    if (legacy.last.seq > current.last.seq) {
+      happens_after(api, legacy.last.api);
+    }
+  }
+
+  const Op &hostSync = hostSyncs_[get_thread_id()];
+  if (hostSync.seq > current.last.seq) {
+    happens_after(api, hostSync.api);
+  }
+
+  current.last = Op(api.Id(), ++seq_);
+  return current.last;
+}
+
+void Streams::synchronized_locked(ApiRecord &api) {
+  hostSyncs_[get_thread_id()] = Op(api.Id(), ++seq_);
+}
+
+void Streams::enqueue(ApiRecord &api, cudaStream_t stream) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  enqueue_locked(api, stream);
+}
+
+void Streams::record_event(ApiRecord &api, cudaEvent_t event,
+                           cudaStream_t stream) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  events_[(uintptr_t)event] = enqueue_locked(api, stream);
+}
+
+void Streams::wait_event(ApiRecord &api, cudaStream_t stream,
+                         cudaEvent_t event) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  // an event that was never recorded is complete
+  const auto &recorded = events_.find((uintptr_t)event);
+  if (recorded != events_.end()) {
+    happens_after(api, recorded->second.api);
+  }
+  enqueue_locked(api, stream);
+}
+
+void Streams::synchronize_stream(ApiRecord &api, cudaStream_t stream) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  happens_after(api, this->stream(stream).last.api);
+  synchronized_locked(api);
+}
+
+void Streams::synchronize_event(ApiRecord &api, cudaEvent_t event) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const auto &recorded = events_.find((uintptr_t)event);
+  if (recorded != events_.end()) {
+    happens_after(api, recorded->second.api);
+  }
+  synchronized_locked(api);
+}
+
+void Streams::synchronize_device(ApiRecord &api) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const Op &hostSync = hostSyncs_[get_thread_id()];
+  for (const auto &kv : streams_) {
+    if (kv.second.last.seq > hostSync.seq) {
+      happens_after(api, kv.second.last.api);
+    }
+  }
+  synchronized_locked(api);
+}
+
+void Streams::create(cudaStream_t stream, const unsigned int flags) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  assert(stream && "Created the default stream?");
+  Stream &created = this->stream(stream);
+  created = Stream();
+  created.blocking = !(flags & cudaStreamNonBlocking);
+}
+
+void Streams::destroy(cudaStream_t stream) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (stream_id(stream)) {
+    streams_.erase(stream_id(stream));
+  }
+}
+
+void Streams::destroy_event(cudaEvent_t event) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  events_.erase((uintptr_t)event);
+}
+
+Streams &Streams::instance() {
+  static Streams s;
+  return s;
+}
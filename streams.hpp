@@ -0,0 +1,89 @@
+#ifndef STREAMS_HPP
+#define STREAMS_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include <cuda_runtime.h>
+
+#include "api_record.hpp"
+#include "thread.hpp"
+
+// A model of the order the device runs work in. Each stream-ordered API record
+// is given its stream and the records that must finish before it can start
+// (its happens-after edges). Two records ordered by neither edges nor a path
+// of edges may overlap.
+//
+// * Work on a stream runs in issue order.
+// * The legacy default stream (0) waits for work on every blocking stream,
+//   and every blocking stream waits for work on the default stream.
+// * cudaEventRecord is work on its stream. cudaStreamWaitEvent is work on its
+//   stream that waits for the matching cudaEventRecord.
+// * A host synchronization waits for the work it synchronizes with, and the
+//   work its thread issues afterwards waits for it.
+//
+// An edge is only added when it isn't implied by the previous work on the
+// stream.
+//
+// FIXME: streams of all devices are modeled as one device, and the
+// per-thread default stream as one stream
+class Streams {
+public:
+  typedef uintptr_t id_type; // the cudaStream_t, 0 for the default stream
+
+private:
+  // Work issued to a stream, or a host synchronization, in issue order
+  struct Op {
+    ApiRecord::id_type api;
+    uint64_t seq;
+
+    Op() : api(ApiRecord::noid), seq(0) {}
+    Op(const ApiRecord::id_type a, const uint64_t s) : api(a), seq(s) {}
+  };
+
+  struct Stream {
+    bool blocking; // synchronizes with the default stream
+    Op last;
+
+    Stream() : blocking(true) {}
+  };
+
+  std::map<id_type, Stream> streams_;
+  std::map<uintptr_t, Op> events_;  // event -> its last cudaEventRecord
+  std::map<tid_t, Op> hostSyncs_;   // thread -> its last synchronization
+  uint64_t seq_;
+  std::mutex mutex_;
+
+  Stream &stream(cudaStream_t s);
+  Op enqueue_locked(ApiRecord &api, cudaStream_t s);
+  void synchronized_locked(ApiRecord &api);
+
+public:
+  // api is work issued to stream
+  void enqueue(ApiRecord &api, cudaStream_t stream);
+
+  // api is cudaEventRecord(event, stream) or cudaStreamWaitEvent(stream,
+  // event)
+  void record_event(ApiRecord &api, cudaEvent_t event, cudaStream_t stream);
+  void wait_event(ApiRecord &api, cudaStream_t stream, cudaEvent_t event);
+
+  // api blocks the calling thread until the work on stream, the work before
+  // event was recorded, or all work, is done. api may also be work on the
+  // stream, like a cudaMemcpy.
+  void synchronize_stream(ApiRecord &api, cudaStream_t stream);
+  void synchronize_event(ApiRecord &api, cudaEvent_t event);
+  void synchronize_device(ApiRecord &api);
+
+  // flags as passed to cudaStreamCreateWithFlags
+  void create(cudaStream_t stream, unsigned int flags);
+  void destroy(cudaStream_t stream);
+  void destroy_event(cudaEvent_t event);
+
+  static Streams &instance();
+
+private:
+  Streams() : seq_(0) {}
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "tensor_layout.hpp"
+
+#include <cassert>
+
+size_t cudnn_data_type_size(cudnnDataType_t dataType) {
+  switch (dataType) {
+  case CUDNN_DATA_FLOAT:
+    return 4;
+  case CUDNN_DATA_DOUBLE:
+    return 8;
+  case CUDNN_DATA_HALF:
+    return 2;
+  case CUDNN_DATA_INT8:
+    return 1;
+  case CUDNN_DATA_INT32:
+    return 4;
+  case CUDNN_DATA_INT8x4: // dims count int8 channels, not vectors of 4
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+const char *cudnn_data_type_name(cudnnDataType_t dataType) {
+  switch (dataType) {
+  case CUDNN_DATA_FLOAT:
+    return "f32";
+  case CUDNN_DATA_DOUBLE:
+    return "f64";
+  case CUDNN_DATA_HALF:
+    return "f16";
+  case CUDNN_DATA_INT8:
+    return "i8";
+  case CUDNN_DATA_INT32:
+    return "i32";
+  case CUDNN_DATA_INT8x4:
+    return "i8x4";
+  default:
+    return "unknown";
+  }
+}
+
+size_t strided_extent_bytes(size_t elemSize, int nbDims, const int dims[],
+                            const int strides[]) {
+  if (nbDims <= 0) {
+    return 0;
+  }
+  size_t lastElem = 0;
+  for (int i = 0; i < nbDims; ++i) {
+    if (dims[i] <= 0) {
+      return 0;
+    }
+    assert(strides[i] >= 0 && "Negative tensor stride");
+    lastElem += size_t(dims[i] - 1) * size_t(strides[i]);
+  }
+  return (lastElem + 1) * elemSize;
+}
+
+TensorLayout::TensorLayout(cudnnDataType_t dt, int nbDims, const int dimA[],
+                           const int strideA[])
+    : dataType(dt), dims(dimA, dimA + nbDims),
+      strides(strideA, strideA + nbDims),
+      bytes(strided_extent_bytes(cudnn_data_type_size(dt), nbDims, dimA,
+                                 strideA)) {}
+
+TensorLayout TensorLayout::packed(cudnnDataType_t dt, int nbDims,
+                                  const int dimA[]) {
+  std::vector<int> strideA(nbDims > 0 ? nbDims : 0);
+  int stride = 1;
+  for (int i = nbDims - 1; i >= 0; --i) {
+    strideA[i] = stride;
+    stride *= dimA[i];
+  }
+  return TensorLayout(dt, nbDims, dimA, strideA.data());
+}
+
+TensorLayouts &TensorLayouts::instance() {
+  static TensorLayouts t;
+  return t;
+}
+
+void TensorLayouts::set(key_type desc, const TensorLayout &layout) {
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  auto p = layouts_.insert(std::make_pair(desc, layout));
+  if (!p.second) {
+    p.first->second = layout;
+  }
+}
+
+void TensorLayouts::erase(key_type desc) {
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  layouts_.erase(desc);
+}
+
+size_t TensorLayouts::bytes(key_type desc) {
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  const auto i = layouts_.find(desc);
+  if (i == layouts_.end()) {
+    return 0;
+  }
+  return i->second.bytes;
+}
+
+TensorLayout TensorLayouts::layout(key_type desc) {
+  std::lock_guard<std::mutex> guard(access_mutex_);
+  const auto i = layouts_.find(desc);
+  if (i == layouts_.end()) {
+    return TensorLayout(CUDNN_DATA_FLOAT, 0, nullptr, nullptr);
+  }
+  return i->second;
+}
@@ -0,0 +1,63 @@
+#ifndef TENSOR_LAYOUT_HPP
+#define TENSOR_LAYOUT_HPP
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <cudnn.h>
+
+// Bytes per element of a cuDNN data type, 0 if unknown
+size_t cudnn_data_type_size(cudnnDataType_t dataType);
+
+// Short name of a cuDNN data type, e.g. "f32", "f16"
+const char *cudnn_data_type_name(cudnnDataType_t dataType);
+
+// Bytes spanned by a strided tensor: from the first element through the
+// element at (dims[i] - 1) * strides[i] in every dimension
+size_t strided_extent_bytes(size_t elemSize, int nbDims, const int dims[],
+                            const int strides[]);
+
+// The layout of a tensor or filter as set on its cuDNN descriptor
+class TensorLayout {
+public:
+  cudnnDataType_t dataType;
+  std::vector<int> dims;
+  std::vector<int> strides; // in elements
+  size_t bytes;             // 0 if unknown
+
+  TensorLayout(cudnnDataType_t dt, int nbDims, const int dimA[],
+               const int strideA[]);
+
+  // fully-packed, row-major (e.g. NCHW or KCRS) in the order of dimA
+  static TensorLayout packed(cudnnDataType_t dt, int nbDims, const int dimA[]);
+};
+
+// Layouts of live descriptors, keyed by handle. Filled when a descriptor is
+// set so that library calls can look up tensor sizes without querying cuDNN.
+class TensorLayouts {
+public:
+  typedef const void *key_type;
+
+private:
+  std::map<key_type, TensorLayout> layouts_;
+  std::mutex access_mutex_;
+
+public:
+  void set(key_type desc, const TensorLayout &layout);
+  void erase(key_type desc);
+
+  // bytes spanned by the tensor described by desc, 0 if unknown
+  size_t bytes(key_type desc);
+
+  // the layout described by desc. If unknown, it has no dims.
+  TensorLayout layout(key_type desc);
+
+  static TensorLayouts &instance();
+
+private:
+  TensorLayouts() {}
+};
+
+#endif
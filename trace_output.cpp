@@ -0,0 +1,198 @@
+#include "trace_output.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "env.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+static std::string hostname() {
+  char buf[256];
+  if (gethostname(buf, sizeof(buf)) != 0) {
+    return "unknown";
+  }
+  buf[sizeof(buf) - 1] = '\0';
+  return buf;
+}
+
+static std::string mpi_rank() {
+  static const char *vars[] = {"OMPI_COMM_WORLD_RANK", "PMI_RANK", "PMIX_RANK",
+                               "MV2_COMM_WORLD_RANK", "SLURM_PROCID"};
+  for (const char *var : vars) {
+    const char *rank = std::getenv(var);
+    if (rank && *rank) {
+      return rank;
+    }
+  }
+  return "0";
+}
+
+std::string TraceOutput::expand(const std::string &pattern, const pid_t pid,
+                                const tid_t tid) {
+  std::string path;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    if (pattern[i] != '%' || i + 1 == pattern.size()) {
+      path += pattern[i];
+      continue;
+    }
+    switch (pattern[++i]) {
+    case 'p':
+      path += std::to_string(pid);
+      break;
+    case 'h':
+      path += hostname();
+      break;
+    case 'r':
+      path += mpi_rank();
+      break;
+    case 't':
+      path += std::to_string(tid);
+      break;
+    case '%':
+      path += '%';
+      break;
+    default:
+      path += '%';
+      path += pattern[i];
+    }
+  }
+  return path;
+}
+
+static std::string absolute(const std::string &path) {
+  char cwd[4096];
+  if (path.empty() || path[0] == '/' || !getcwd(cwd, sizeof(cwd))) {
+    return path;
+  }
+  return std::string(cwd) + "/" + path;
+}
+
+static void write_all(const int fd, const std::string &s) {
+  const char *p = s.data();
+  size_t left = s.size();
+  while (left) {
+    const ssize_t n = ::write(fd, p, left);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    p += n;
+    left -= n;
+  }
+}
+
+TraceOutput::TraceOutput()
+    : pattern_(env::output_path()), manifest_(env::manifest_path()),
+      sharded_(false), perThread_(false), fd_(-1), pid_(0), rotation_(0),
+      rotations_(0), summary_(env::mode() == "summary") {
+  for (size_t i = 0; i + 1 < pattern_.size(); ++i) {
+    if (pattern_[i] == '%') {
+      const char c = pattern_[++i];
+      sharded_ |= c == 'p' || c == 'h' || c == 'r' || c == 't';
+      perThread_ |= c == 't';
+    }
+  }
+}
+
+TraceOutput &TraceOutput::instance() {
+  // never destroyed, so singletons that write from their destructors at exit
+  // still reach the trace
+  static TraceOutput *t = new TraceOutput();
+  return *t;
+}
+
+std::string TraceOutput::path(const pid_t pid, const tid_t tid,
+                              const unsigned rotation) const {
+  const std::string path = expand(pattern_, pid, tid);
+  return rotation ? path + "." + std::to_string(rotation) : path;
+}
+
+std::string TraceOutput::path() const {
+  return path(getpid(), get_thread_id(), rotations_.load());
+}
+
+void TraceOutput::write(const std::string &records) {
+  const pid_t pid = getpid();
+  const unsigned rotation = rotations_.load(std::memory_order_relaxed);
+  if (perThread_) {
+    static thread_local int fd = -1;
+    static thread_local pid_t fdPid = 0;
+    static thread_local unsigned fdRotation = 0;
+    if (fdPid != pid || fdRotation != rotation) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      fd = open_shard(pid, get_thread_id(), rotation);
+      fdPid = pid;
+      fdRotation = rotation;
+    }
+    write_all(fd, records);
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (pid_ != pid || rotation_ != rotation) {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = open_shard(pid, get_thread_id(), rotation);
+    pid_ = pid;
+    rotation_ = rotation;
+  }
+  write_all(fd_, records);
+}
+
+int TraceOutput::open_shard(const pid_t pid, const tid_t tid,
+                            const unsigned rotation) {
+  const std::string path = this->path(pid, tid, rotation);
+  const int fd =
+      open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    printf("WARN: couldn't open trace %s: %s\n", path.c_str(),
+           strerror(errno));
+  } else if (sharded_) {
+    add_to_manifest(absolute(path), pid, tid);
+  }
+  return fd;
+}
+
+void TraceOutput::add_to_manifest(const std::string &path, const pid_t pid,
+                                  const tid_t tid) {
+  std::string manifest = manifest_;
+  if (manifest.empty()) {
+    const size_t slash = path.rfind('/');
+    manifest = path.substr(0, slash + 1) + "cprof.manifest";
+  }
+
+  ptree pt;
+  pt.put("shard.path", path);
+  pt.put("shard.host", hostname());
+  pt.put("shard.rank", mpi_rank());
+  pt.put("shard.pid", pid);
+  if (perThread_) {
+    pt.put("shard.tid", tid);
+  }
+  std::ostringstream buf;
+  write_json(buf, pt, false);
+
+  const int fd =
+      open(manifest.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    printf("WARN: couldn't open trace manifest %s: %s\n", manifest.c_str(),
+           strerror(errno));
+    return;
+  }
+  write_all(fd, buf.str());
+  close(fd);
+}
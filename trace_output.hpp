@@ -0,0 +1,89 @@
+#ifndef TRACE_OUTPUT_HPP
+#define TRACE_OUTPUT_HPP
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include <sys/types.h>
+
+#include "thread.hpp"
+
+// Where trace records are written. CPROF_OUT is a pattern for the shard files,
+// with placeholders
+//   %p  process id
+//   %h  host name
+//   %r  MPI rank, from OMPI_COMM_WORLD_RANK, PMI_RANK, PMIX_RANK,
+//       MV2_COMM_WORLD_RANK or SLURM_PROCID, 0 if none is set
+//   %t  thread id, for one shard per thread instead of per process
+//   %%  a literal %
+//
+// Each shard is opened once, in append mode, and each record is appended with
+// a single write, so ranks sharing a node no longer contend on one file. A
+// forked child reopens its shards. Shards of threads that exit stay open.
+//
+// If the pattern has placeholders, opening a shard appends a line describing
+// it to the manifest (CPROF_MANIFEST, by default cprof.manifest in the
+// directory of the shard), which cprof_merge.py reads to merge the shards
+// into one trace.
+//
+// Rotating closes the shards and opens new ones with ".<n>" appended to their
+// paths, the n-th rotation. In summary mode, records of single events (calls,
+// allocations, values and their dependencies) are dropped, and only totals
+// and clock samples are written.
+class TraceOutput {
+private:
+  std::string pattern_;
+  std::string manifest_;
+  bool sharded_;   // the pattern has placeholders
+  bool perThread_; // the pattern has %t
+
+  // the process shard, when not per thread
+  int fd_;
+  pid_t pid_;         // that opened fd_
+  unsigned rotation_; // that fd_ was opened in
+  std::mutex mutex_;
+
+  std::atomic<unsigned> rotations_;
+  std::atomic<bool> summary_;
+
+public:
+  // append complete JSON lines
+  void write(const std::string &records);
+  // write, unless in summary mode
+  void write_event(const std::string &records) {
+    if (!summary_.load(std::memory_order_relaxed)) {
+      write(records);
+    }
+  }
+  // append the JSON line operator<< writes for the event r
+  template <typename T> void write_record(const T &r) {
+    if (summary_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    std::ostringstream buf;
+    buf << r;
+    write(buf.str());
+  }
+
+  // the shard records from this thread go to
+  std::string path() const;
+  // pattern with the placeholders above filled in
+  static std::string expand(const std::string &pattern, pid_t pid, tid_t tid);
+
+  // later records go to new shards
+  void rotate() { rotations_.fetch_add(1); }
+  void set_summary(bool summary) { summary_.store(summary); }
+  bool is_summary() const { return summary_.load(); }
+
+  static TraceOutput &instance();
+
+private:
+  TraceOutput();
+  std::string path(pid_t pid, tid_t tid, unsigned rotation) const;
+  int open_shard(pid_t pid, tid_t tid, unsigned rotation);
+  void add_to_manifest(const std::string &path, pid_t pid, tid_t tid);
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "transfer_stats.hpp"
+
+#include <cstdio>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "env.hpp"
+#include "trace_output.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+void TransferStats::record(const Key &key,
+                           const AllocationRecord::id_type hostAlloc,
+                           const uint64_t bytes, const uint64_t ns,
+                           const bool timed) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  totals_[key].add(bytes, ns, timed);
+  buffers_[buffer_key(hostAlloc, key)].add(bytes, ns, timed);
+}
+
+void TransferStats::record_peer(const int srcDevice, const int dstDevice,
+                                const uint64_t bytes, const uint64_t ns,
+                                const bool timed) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  peers_[std::make_pair(srcDevice, dstDevice)].add(bytes, ns, timed);
+}
+
+static void put(ptree &pt, const std::string &prefix,
+                const TransferStats::Key &key,
+                const TransferStats::Totals &totals) {
+  pt.put(prefix + ".direction", key.direction);
+  pt.put(prefix + ".page_type", key.pageType);
+  pt.put(prefix + ".numa_node", key.numaNode);
+  pt.put(prefix + ".device", key.device);
+  pt.put(prefix + ".device_numa_node", key.deviceNumaNode);
+  pt.put(prefix + ".count", totals.count);
+  pt.put(prefix + ".bytes", totals.bytes);
+  pt.put(prefix + ".timed_bytes", totals.timedBytes);
+  pt.put(prefix + ".ns", totals.ns);
+  pt.put(prefix + ".gbps", totals.bandwidth());
+}
+
+std::string TransferStats::json() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::ostringstream buf;
+
+  // pinned bandwidth by (direction, device), over all NUMA nodes
+  std::map<std::pair<std::string, int>, Totals> pinned;
+  for (const auto &kv : totals_) {
+    const Key &key = kv.first;
+    ptree pt;
+    put(pt, "transfer", key, kv.second);
+    write_json(buf, pt, false);
+
+    if (key.pageType == "pinned") {
+      Totals &p = pinned[std::make_pair(key.direction, key.device)];
+      p.count += kv.second.count;
+      p.bytes += kv.second.bytes;
+      p.timedBytes += kv.second.timedBytes;
+      p.ns += kv.second.ns;
+    }
+  }
+
+  static const double slowFraction = env::slow_transfer_pct() / 100.0;
+  for (const auto &kv : buffers_) {
+    const Key &key = kv.first.second;
+    const Totals &totals = kv.second;
+    ptree pt;
+    pt.put("transfer_buffer.allocation_id", kv.first.first);
+    put(pt, "transfer_buffer", key, totals);
+
+    const auto &baseline =
+        pinned.find(std::make_pair(key.direction, key.device));
+    if (baseline != pinned.end() && baseline->second.bandwidth() > 0 &&
+        totals.ns) {
+      const double pinnedBw = baseline->second.bandwidth();
+      const bool slow = totals.bandwidth() < slowFraction * pinnedBw;
+      pt.put("transfer_buffer.pinned_gbps", pinnedBw);
+      pt.put("transfer_buffer.slow", slow);
+      if (slow) {
+        printf("WARN: %s copies of allocation %lu ran at %.2f GB/s, pinned "
+               "is %.2f GB/s\n",
+               key.direction.c_str(), kv.first.first, totals.bandwidth(),
+               pinnedBw);
+      }
+    }
+    write_json(buf, pt, false);
+  }
+
+  for (const auto &kv : peers_) {
+    ptree pt;
+    pt.put("peer_transfer.src_device", kv.first.first);
+    pt.put("peer_transfer.dst_device", kv.first.second);
+    pt.put("peer_transfer.count", kv.second.count);
+    pt.put("peer_transfer.bytes", kv.second.bytes);
+    pt.put("peer_transfer.timed_bytes", kv.second.timedBytes);
+    pt.put("peer_transfer.ns", kv.second.ns);
+    pt.put("peer_transfer.gbps", kv.second.bandwidth());
+    write_json(buf, pt, false);
+  }
+  return buf.str();
+}
+
+TransferStats &TransferStats::instance() {
+  static TransferStats s;
+  return s;
+}
+
+TransferStats::~TransferStats() {
+  if (totals_.empty() && peers_.empty()) {
+    return;
+  }
+  TraceOutput::instance().write(json());
+}
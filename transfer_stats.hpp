@@ -0,0 +1,99 @@
+#ifndef TRANSFER_STATS_HPP
+#define TRANSFER_STATS_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "allocation_record.hpp"
+
+// Effective bandwidth of memcpys between host and device, from the start and
+// end times of each call. Totals are kept by direction, page type and NUMA
+// node of the host memory, and device, and by host allocation. Copies whose
+// host memory is on another node than the device's cross the socket
+// interconnect.
+//
+// Asynchronous copies (cudaMemcpyAsync, the 2D, 3D and peer forms, and their
+// driver counterparts) can return before the copy is done, so unless
+// CPROF_SYNC_TIMING is set their times only cover issuing it. Their bytes are
+// counted, but they are left out of the timed bytes that bandwidths are
+// computed from.
+//
+// At exit, the totals are written to the trace, with each host allocation
+// marked slow if its timed copies ran below CPROF_SLOW_TRANSFER_PCT percent of
+// the pinned bandwidth in the same direction to the same device. Those are the
+// staging buffers worth pinning. Allocations without timed copies get no
+// verdict.
+//
+// Copies between device memory are totalled by source and destination device,
+// a device-to-device traffic matrix, also written at exit.
+class TransferStats {
+public:
+  class Key {
+  public:
+    std::string direction; // "h2d" or "d2h"
+    std::string pageType;  // of the host memory
+    int numaNode;          // of the host memory, -1 if unknown
+    int device;
+    // the node the device is attached to, -1 if unknown
+    int deviceNumaNode;
+
+    bool operator<(const Key &rhs) const {
+      return std::tie(direction, pageType, numaNode, device) <
+             std::tie(rhs.direction, rhs.pageType, rhs.numaNode, rhs.device);
+    }
+  };
+
+  class Totals {
+  public:
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t timedBytes; // of copies whose times cover the copy
+    uint64_t ns;         // of those copies
+
+    Totals() : count(0), bytes(0), timedBytes(0), ns(0) {}
+    // a copy of b bytes that took t ns, if timed
+    void add(uint64_t b, uint64_t t, bool timed) {
+      ++count;
+      bytes += b;
+      if (timed) {
+        timedBytes += b;
+        ns += t;
+      }
+    }
+    // GB/s of the timed copies, 0 if there were none
+    double bandwidth() const { return ns ? double(timedBytes) / ns : 0; }
+  };
+
+private:
+  typedef std::pair<AllocationRecord::id_type, Key> buffer_key;
+
+  std::map<Key, Totals> totals_;
+  std::map<buffer_key, Totals> buffers_;
+  std::map<std::pair<int, int>, Totals> peers_; // by (src, dst) device
+  std::mutex mutex_;
+
+public:
+  // a memcpy of bytes to or from hostAlloc that took ns, if timed
+  void record(const Key &key, AllocationRecord::id_type hostAlloc,
+              uint64_t bytes, uint64_t ns, bool timed);
+
+  // a memcpy of bytes from srcDevice to dstDevice, which may be the same,
+  // that took ns, if timed
+  void record_peer(int srcDevice, int dstDevice, uint64_t bytes, uint64_t ns,
+                   bool timed);
+
+  // one JSON line per key, then one per host allocation, then one per pair
+  // of devices
+  std::string json();
+
+  static TransferStats &instance();
+  ~TransferStats();
+
+private:
+  TransferStats() {}
+};
+
+#endif
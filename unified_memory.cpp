@@ -0,0 +1,219 @@
+#include "unified_memory.hpp"
+
+#include <iterator>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "trace_output.hpp"
+
+using boost::property_tree::ptree;
+using boost::property_tree::write_json;
+
+typedef UnifiedMemoryStats::Kind Kind;
+
+static const size_t numKinds = size_t(Kind::Count);
+
+// JSON name of each kind, and of what its values count ("" for nothing)
+static const char *kindNames[numKinds] = {
+    "htod",
+    "dtoh",
+    "dtod",
+    "cpu_page_faults",
+    "gpu_page_faults",
+    "thrashing",
+    "throttling",
+    "remote_map",
+    "prefetch",
+};
+static const char *valueNames[numKinds] = {
+    "bytes", "bytes", "bytes", "faults", "faults",
+    "bytes", "",      "bytes", "bytes",
+};
+
+static bool is_migration(const Kind k) {
+  return k == Kind::HtoD || k == Kind::DtoH || k == Kind::DtoD;
+}
+
+UnifiedMemoryStats::Totals::Totals() : migrationNs(0) {
+  for (size_t i = 0; i < numKinds; ++i) {
+    count[i] = 0;
+    value[i] = 0;
+  }
+}
+
+void UnifiedMemoryStats::Totals::add(const Event &e) {
+  ++count[size_t(e.kind)];
+  value[size_t(e.kind)] += e.value;
+  if (is_migration(e.kind) && e.end > e.start) {
+    migrationNs += e.end - e.start;
+  }
+}
+
+uint64_t UnifiedMemoryStats::Totals::migrations() const {
+  return count[size_t(Kind::HtoD)] + count[size_t(Kind::DtoH)] +
+         count[size_t(Kind::DtoD)];
+}
+
+uint64_t UnifiedMemoryStats::Totals::migrated_bytes() const {
+  return value[size_t(Kind::HtoD)] + value[size_t(Kind::DtoH)] +
+         value[size_t(Kind::DtoD)];
+}
+
+void UnifiedMemoryStats::Table::add_allocation(
+    const AllocationRecord::id_type id, const uintptr_t pos,
+    const size_t size) {
+  // drop the ranges of freed allocations this one reuses
+  auto it = ranges_.lower_bound(pos);
+  if (it != ranges_.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.first > pos) {
+      it = prev;
+    }
+  }
+  while (it != ranges_.end() && it->first < pos + size) {
+    it = ranges_.erase(it);
+  }
+  ranges_[pos] = std::make_pair(size, id);
+}
+
+AllocationRecord::id_type
+UnifiedMemoryStats::Table::find(const uintptr_t address) const {
+  auto it = ranges_.upper_bound(address);
+  if (it == ranges_.begin()) {
+    return AllocationRecord::noid;
+  }
+  --it;
+  if (address - it->first < it->second.first) {
+    return it->second.second;
+  }
+  return AllocationRecord::noid;
+}
+
+void UnifiedMemoryStats::Table::record(const Event &e) {
+  totals_[find(e.address)].add(e);
+}
+
+void UnifiedMemoryStats::Table::advise(const uintptr_t address,
+                                       const std::string &advice,
+                                       const bool set) {
+  std::set<std::string> &current = totals_[find(address)].advice;
+  // a preferred location replaces the last one
+  const std::string kind = advice.substr(0, advice.find(':'));
+  if (kind == "preferred_location") {
+    for (auto it = current.begin(); it != current.end();) {
+      if (it->compare(0, kind.size(), kind) == 0) {
+        it = current.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  } else if (!set) {
+    current.erase(advice);
+  }
+  if (set) {
+    current.insert(advice);
+  }
+}
+
+std::string UnifiedMemoryStats::Table::json() const {
+  std::ostringstream buf;
+  for (const auto &kv : totals_) {
+    const Totals &t = kv.second;
+    ptree pt;
+    pt.put("unified_memory.allocation_id", kv.first);
+    pt.put("unified_memory.migrations", t.migrations());
+    pt.put("unified_memory.migrated_bytes", t.migrated_bytes());
+    pt.put("unified_memory.migration_ns", t.migrationNs);
+    for (size_t i = 0; i < numKinds; ++i) {
+      if (!t.count[i]) {
+        continue;
+      }
+      const std::string prefix = std::string("unified_memory.") + kindNames[i];
+      pt.put(prefix + ".count", t.count[i]);
+      if (*valueNames[i]) {
+        pt.put(prefix + "." + valueNames[i], t.value[i]);
+      }
+    }
+    ptree advice;
+    for (const auto &a : t.advice) {
+      ptree child;
+      child.put("", a);
+      advice.push_back(std::make_pair("", child));
+    }
+    pt.add_child("unified_memory.advice", advice);
+    write_json(buf, pt, false);
+  }
+  return buf.str();
+}
+
+void UnifiedMemoryStats::add_allocation(const AllocationRecord::id_type id,
+                                        const uintptr_t pos,
+                                        const size_t size) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  table_.add_allocation(id, pos, size);
+}
+
+void UnifiedMemoryStats::record(const Event &e) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  table_.record(e);
+}
+
+void UnifiedMemoryStats::advise(const uintptr_t address,
+                                const std::string &advice, const bool set) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  table_.advise(address, advice, set);
+}
+
+optional<UnifiedMemoryStats::Event>
+UnifiedMemoryStats::to_event(const CUpti_ActivityUnifiedMemoryCounter2 &r) {
+  Kind kind;
+  uint64_t value = r.value;
+  switch (r.counterKind) {
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD:
+    kind = Kind::HtoD;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH:
+    kind = Kind::DtoH;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD:
+    kind = Kind::DtoD;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_CPU_PAGE_FAULT_COUNT:
+    kind = Kind::CpuPageFault;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT:
+    kind = Kind::GpuPageFault;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THRASHING:
+    kind = Kind::Thrashing;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THROTTLING:
+    kind = Kind::Throttling;
+    break;
+  case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_REMOTE_MAP:
+    kind = Kind::RemoteMap;
+    break;
+  default:
+    return optional<Event>();
+  }
+  // a fault record is at least one fault
+  if ((kind == Kind::CpuPageFault || kind == Kind::GpuPageFault) && !value) {
+    value = 1;
+  }
+  Event e(kind, r.address, value, r.start, r.end);
+  return optional<Event>(e);
+}
+
+UnifiedMemoryStats &UnifiedMemoryStats::instance() {
+  static UnifiedMemoryStats s;
+  return s;
+}
+
+UnifiedMemoryStats::~UnifiedMemoryStats() {
+  if (table_.totals().empty()) {
+    return;
+  }
+  TraceOutput::instance().write(table_.json());
+}
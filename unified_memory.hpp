@@ -0,0 +1,113 @@
+#ifndef UNIFIED_MEMORY_HPP
+#define UNIFIED_MEMORY_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <cupti.h>
+
+#include "allocation_record.hpp"
+#include "optional.hpp"
+
+// Unified memory activity by managed allocation: page migrations and faults
+// from CUPTI's unified memory counters, where the device and driver support
+// them, and cudaMemPrefetchAsync / cudaMemAdvise calls.
+//
+// Counter records arrive in activity buffers, possibly after the allocation
+// they touched was freed, so the managed ranges are kept here and an address
+// is charged to the latest allocation that covered it. At exit, one line is
+// written per allocation with activity, plus one with allocation_id 0 for
+// activity outside every managed allocation.
+class UnifiedMemoryStats {
+public:
+  enum class Kind {
+    HtoD,
+    DtoH,
+    DtoD,
+    CpuPageFault,
+    GpuPageFault,
+    Thrashing,
+    Throttling,
+    RemoteMap,
+    Prefetch,
+    Count // the number of kinds
+  };
+
+  class Event {
+  public:
+    Kind kind;
+    uintptr_t address;
+    uint64_t value; // bytes, or faults for the page fault kinds
+    uint64_t start;
+    uint64_t end;
+
+    Event() : kind(Kind::Count), address(0), value(0), start(0), end(0) {}
+    Event(Kind k, uintptr_t a, uint64_t v, uint64_t s = 0, uint64_t e = 0)
+        : kind(k), address(a), value(v), start(s), end(e) {}
+  };
+
+  class Totals {
+  public:
+    uint64_t count[size_t(Kind::Count)]; // events
+    uint64_t value[size_t(Kind::Count)]; // sum of their values
+    uint64_t migrationNs;                // time spent migrating pages
+    std::set<std::string> advice;        // in effect
+
+    Totals();
+    void add(const Event &e);
+    // page migrations in any direction, and their bytes
+    uint64_t migrations() const;
+    uint64_t migrated_bytes() const;
+  };
+
+  // The aggregation, without locking or output, so it can be fed synthetic
+  // events
+  class Table {
+  private:
+    // start -> (size, allocation), non-overlapping
+    std::map<uintptr_t, std::pair<size_t, AllocationRecord::id_type>> ranges_;
+    std::map<AllocationRecord::id_type, Totals> totals_;
+
+  public:
+    // a managed allocation, replacing any it overlaps
+    void add_allocation(AllocationRecord::id_type id, uintptr_t pos,
+                        size_t size);
+    // the allocation covering address, noid if none
+    AllocationRecord::id_type find(uintptr_t address) const;
+
+    void record(const Event &e);
+    // advice set (or unset) on the allocation at address, e.g. "read_mostly"
+    // or "preferred_location:1"
+    void advise(uintptr_t address, const std::string &advice, bool set);
+
+    const std::map<AllocationRecord::id_type, Totals> &totals() const {
+      return totals_;
+    }
+    // one JSON line per allocation
+    std::string json() const;
+  };
+
+private:
+  Table table_;
+  std::mutex mutex_;
+
+public:
+  void add_allocation(AllocationRecord::id_type id, uintptr_t pos,
+                      size_t size);
+  void record(const Event &e);
+  void advise(uintptr_t address, const std::string &advice, bool set);
+
+  // the event r counts, none for counters this doesn't track
+  static optional<Event> to_event(const CUpti_ActivityUnifiedMemoryCounter2 &r);
+
+  static UnifiedMemoryStats &instance();
+  ~UnifiedMemoryStats();
+
+private:
+  UnifiedMemoryStats() {}
+};
+
+#endif
@@ -0,0 +1,187 @@
+/*
+Unit tests for the parts of the profiler that run without a GPU or CUDA
+libraries.
+
+  make test
+
+Each failed check prints its file, line and expression. The exit status is
+the number of failed checks.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "dirty.hpp"
+#include "numa.hpp"
+#include "unified_memory.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);          \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static bool same_extent(const Extent &e, const uintptr_t pos,
+                        const size_t size) {
+  return e.pos() == pos && e.size() == size;
+}
+
+static void test_dirty() {
+  const size_t chunk = 16;
+  const uintptr_t pos = 0x1000;
+  std::vector<char> buf(100, 0); // 6 full chunks and a 4-byte one
+  const auto before = chunk_digests(buf.data(), buf.size(), chunk);
+  CHECK(before.size() == 7);
+
+  // unchanged
+  CHECK(dirty_extents(pos, buf.size(), chunk, before, before).empty());
+
+  // the short last chunk is dirty up to the end of the buffer, not a whole
+  // chunk
+  buf[99] = 1;
+  auto after = chunk_digests(buf.data(), buf.size(), chunk);
+  auto dirty = dirty_extents(pos, buf.size(), chunk, before, after);
+  CHECK(dirty.size() == 1);
+  CHECK(!dirty.empty() && same_extent(dirty[0], pos + 96, 4));
+
+  // adjacent dirty chunks are one extent, separate runs stay separate
+  buf[99] = 0;
+  buf[17] = buf[40] = 1; // chunks 1 and 2
+  buf[80] = 1;           // chunk 5
+  after = chunk_digests(buf.data(), buf.size(), chunk);
+  dirty = dirty_extents(pos, buf.size(), chunk, before, after);
+  CHECK(dirty.size() == 2);
+  if (dirty.size() == 2) {
+    CHECK(same_extent(dirty[0], pos + 16, 32));
+    CHECK(same_extent(dirty[1], pos + 80, 16));
+  }
+
+  // a run through the short last chunk
+  buf[99] = 1;
+  after = chunk_digests(buf.data(), buf.size(), chunk);
+  dirty = dirty_extents(pos, buf.size(), chunk, before, after);
+  CHECK(dirty.size() == 2);
+  CHECK(dirty.size() == 2 && same_extent(dirty[1], pos + 80, 20));
+}
+
+// a fake <root>/bus/pci/devices/<busId>/numa_node holding contents
+static void write_numa_node(const std::string &root, const std::string &busId,
+                            const std::string &contents) {
+  std::string dir = root;
+  for (const char *d : {"/bus", "/pci", "/devices"}) {
+    dir += d;
+    mkdir(dir.c_str(), 0755);
+  }
+  dir += "/" + busId;
+  mkdir(dir.c_str(), 0755);
+  std::ofstream(dir + "/numa_node") << contents;
+}
+
+static void test_pci_numa_node() {
+  char tmpl[] = "/tmp/cprof_sysfs_XXXXXX";
+  if (!mkdtemp(tmpl)) {
+    CHECK(!"couldn't make a fake sysfs tree");
+    return;
+  }
+  const std::string root(tmpl);
+  write_numa_node(root, "0000:3b:00.0", "1\n");
+  write_numa_node(root, "0000:af:00.0", "-1\n");
+
+  // CUDA gives bus ids in upper case, sysfs names them in lower case
+  CHECK(pci_numa_node(root, "0000:3B:00.0") == 1);
+  CHECK(pci_numa_node(root, "0000:3b:00.0") == 1);
+  // no NUMA
+  CHECK(pci_numa_node(root, "0000:AF:00.0") == -1);
+  // no such device
+  CHECK(pci_numa_node(root, "0000:01:00.0") == -1);
+  CHECK(pci_numa_node(root + "/missing", "0000:3B:00.0") == -1);
+
+  const std::string cmd = "rm -rf " + root;
+  CHECK(system(cmd.c_str()) == 0);
+}
+
+static void test_unified_memory() {
+  typedef UnifiedMemoryStats::Event Event;
+  typedef UnifiedMemoryStats::Kind Kind;
+  const auto noid = AllocationRecord::noid;
+  UnifiedMemoryStats::Table t;
+
+  t.add_allocation(1, 0x1000, 0x1000);
+  CHECK(t.find(0x0fff) == noid);
+  CHECK(t.find(0x1000) == 1);
+  CHECK(t.find(0x1fff) == 1);
+  CHECK(t.find(0x2000) == noid);
+  t.record(Event(Kind::HtoD, 0x1800, 4096, 10, 30));
+
+  // allocation 1 was freed and 2 reuses part of its range, so its addresses
+  // are charged to 2, and the rest of 1 to nothing
+  t.add_allocation(2, 0x1800, 0x1000);
+  CHECK(t.find(0x1000) == noid);
+  CHECK(t.find(0x1800) == 2);
+  CHECK(t.find(0x27ff) == 2);
+  CHECK(t.find(0x2800) == noid);
+  t.record(Event(Kind::GpuPageFault, 0x2000, 3));
+  t.record(Event(Kind::DtoH, 0x2000, 8192, 40, 45));
+
+  // outside every allocation
+  t.record(Event(Kind::CpuPageFault, 0x100, 1));
+  t.record(Event(Kind::CpuPageFault, 0x100000, 2));
+
+  const auto &totals = t.totals();
+  CHECK(totals.size() == 3);
+  const auto one = totals.find(1);
+  CHECK(one != totals.end());
+  if (one != totals.end()) {
+    CHECK(one->second.migrations() == 1);
+    CHECK(one->second.migrated_bytes() == 4096);
+    CHECK(one->second.migrationNs == 20);
+  }
+  const auto two = totals.find(2);
+  CHECK(two != totals.end());
+  if (two != totals.end()) {
+    CHECK(two->second.migrations() == 1);
+    CHECK(two->second.migrated_bytes() == 8192);
+    CHECK(two->second.migrationNs == 5);
+    CHECK(two->second.count[size_t(Kind::GpuPageFault)] == 1);
+    CHECK(two->second.value[size_t(Kind::GpuPageFault)] == 3);
+  }
+  const auto none = totals.find(noid);
+  CHECK(none != totals.end());
+  if (none != totals.end()) {
+    CHECK(none->second.migrations() == 0);
+    CHECK(none->second.count[size_t(Kind::CpuPageFault)] == 2);
+    CHECK(none->second.value[size_t(Kind::CpuPageFault)] == 3);
+  }
+
+  // one line per allocation
+  std::istringstream json(t.json());
+  std::string line;
+  size_t lines = 0;
+  while (std::getline(json, line)) {
+    ++lines;
+  }
+  CHECK(lines == 3);
+}
+
+int main() {
+  test_dirty();
+  test_pci_numa_node();
+  test_unified_memory();
+
+  if (failures) {
+    printf("%d checks failed\n", failures);
+  } else {
+    printf("all checks passed\n");
+  }
+  return failures;
+}
@@ -1,7 +1,8 @@
 #include "value.hpp"
 #include "allocations.hpp"
-#include "env.hpp"
+#include "trace_output.hpp"
 
+#include <algorithm>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <map>
@@ -13,14 +14,86 @@ using boost::property_tree::write_json;
 
 const Value::id_type Value::noid = reinterpret_cast<Value::id_type>(nullptr);
 
+Value::Value(const std::vector<Extent> &ranges,
+             AllocationRecord::id_type allocation, bool initialized)
+    : Extent(0, 0), is_initialized_(initialized), allocation_id_(allocation),
+      stride_(0), count_(1) {
+  std::vector<Extent> sorted;
+  for (const auto &r : ranges) {
+    if (r.size()) {
+      sorted.push_back(r);
+    }
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Extent &a, const Extent &b) {
+    return a.pos() < b.pos();
+  });
+
+  // merge ranges that overlap or touch
+  std::vector<Extent> merged;
+  for (const auto &r : sorted) {
+    if (!merged.empty() &&
+        r.pos() <= merged.back().pos() + merged.back().size()) {
+      const Extent &last = merged.back();
+      const uintptr_t end =
+          std::max(last.pos() + last.size(), r.pos() + r.size());
+      merged.back() = Extent(last.pos(), end - last.pos());
+    } else {
+      merged.push_back(r);
+    }
+  }
+  if (merged.empty()) {
+    return;
+  }
+  pos_ = merged.front().pos();
+  size_ = merged.back().pos() + merged.back().size() - pos_;
+  if (merged.size() == 1) {
+    return;
+  }
+
+  const size_t stride = merged[1].pos() - merged[0].pos();
+  bool even = true;
+  for (size_t i = 1; even && i < merged.size(); ++i) {
+    even = merged[i].size() == merged[0].size() &&
+           merged[i].pos() - merged[i - 1].pos() == stride;
+  }
+  if (even) {
+    stride_ = stride;
+    count_ = merged.size();
+  } else {
+    ranges_ = std::make_shared<const std::vector<Extent>>(std::move(merged));
+  }
+}
+
+std::vector<Extent> Value::blocks() const {
+  if (ranges_) {
+    return *ranges_;
+  }
+  std::vector<Extent> blocks;
+  for (size_t i = 0; i < count_; ++i) {
+    blocks.emplace_back(pos_ + i * stride_, block_size());
+  }
+  return blocks;
+}
+
+size_t Value::bytes() const {
+  if (!ranges_) {
+    return count_ * block_size();
+  }
+  size_t bytes = 0;
+  for (const auto &r : *ranges_) {
+    bytes += r.size();
+  }
+  return bytes;
+}
+
 void Value::add_depends_on(id_type id) {
   dependsOnIdx_.push_back(id);
   ptree pt;
   pt.put("dep.dst_id", Id());
   pt.put("dep.src_id", id);
-  std::ofstream buf(env::output_path(), std::ofstream::app);
+  std::ostringstream buf;
   write_json(buf, pt, false);
-  buf.flush();
+  TraceOutput::instance().write_event(buf.str());
 }
 
 std::string Value::json() const {
@@ -30,27 +103,75 @@ std::string Value::json() const {
   pt.put("val.size", size_);
   pt.put("val.allocation_id", allocation_id_);
   pt.put("val.initialized", is_initialized_);
+  if (digest_) {
+    pt.put("val.digest", digest_.value());
+  }
+  if (is_strided()) {
+    pt.put("val.stride", stride_);
+    pt.put("val.count", count_);
+  }
+  if (ranges_) {
+    ptree ranges;
+    for (const auto &r : *ranges_) {
+      ptree range;
+      range.put("pos", r.pos());
+      range.put("size", r.size());
+      ranges.push_back(std::make_pair("", range));
+    }
+    pt.add_child("val.ranges", ranges);
+  }
   std::stringstream buf;
   write_json(buf, pt, false);
   return buf.str();
 }
 
+bool Value::overlaps(const Extent &other) const {
+  // an extent or value of unknown size is its first byte
+  const Extent o(other.pos(), std::max(other.size(), size_t(1)));
+  if (!Extent(pos_, std::max(size_, size_t(1))).overlaps(o)) {
+    return false;
+  }
+  if (ranges_) {
+    // the last range starting before o ends
+    auto it = std::lower_bound(
+        ranges_->begin(), ranges_->end(), o.pos() + o.size(),
+        [](const Extent &r, uintptr_t pos) { return r.pos() < pos; });
+    if (it == ranges_->begin()) {
+      return false;
+    }
+    --it;
+    return it->pos() + it->size() > o.pos();
+  }
+  if (!is_strided() || stride_ <= block_size() || o.pos() <= pos_) {
+    return true;
+  }
+  // o starts inside the span: it overlaps the block it starts in, or
+  // reaches the start of the next one
+  const size_t offset = o.pos() - pos_;
+  const size_t block = offset / stride_;
+  if (offset - block * stride_ < block_size()) {
+    return true;
+  }
+  return block + 1 < count_ &&
+         pos_ + (block + 1) * stride_ < o.pos() + o.size();
+}
+
 void Value::record_meta_append(const std::string &s) {
   ptree pt;
   pt.put("meta.append", s);
   pt.put("meta.val_id", Id());
-  std::ofstream buf(env::output_path(), std::ofstream::app);
+  std::ostringstream buf;
   write_json(buf, pt, false);
-  buf.flush();
+  TraceOutput::instance().write_event(buf.str());
 }
 
 void Value::record_meta_set(const std::string &s) {
   ptree pt;
   pt.put("meta.set", s);
   pt.put("meta.val_id", Id());
-  std::ofstream buf(env::output_path(), std::ofstream::app);
+  std::ostringstream buf;
   write_json(buf, pt, false);
-  buf.flush();
+  TraceOutput::instance().write_event(buf.str());
 }
 
 /*
@@ -62,9 +183,7 @@ AddressSpace Value::address_space() const {
 
 void Value::set_size(size_t size) {
   size_ = size;
-  std::ofstream buf(env::output_path(), std::ofstream::app);
-  buf << *this;
-  buf.flush();
+  TraceOutput::instance().write_record(*this);
 }
 
 // Value &Value::UnknownValue() {
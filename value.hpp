@@ -8,7 +8,17 @@
 
 #include "allocation_record.hpp"
 #include "extent.hpp"
+#include "hash.hpp"
+#include "optional.hpp"
 
+// A version of the data in some bytes of an allocation. The extent is the span
+// of the bytes, which are one of
+//   a single range, the whole extent
+//   count blocks of one size, stride bytes apart, like the rows of a pitched
+//   copy or the matrices of a strided batched GEMM
+//   a sorted list of disjoint ranges, like the matrices of a batched GEMM
+// so scattered data is one value instead of one per block. Overlap queries
+// are constant time for the first two forms and logarithmic for the list.
 class Value : public Extent {
 public:
   typedef uintptr_t id_type;
@@ -17,7 +27,12 @@ public:
 private:
   bool is_initialized_;
   AllocationRecord::id_type
-      allocation_id_; // allocation that this value lives in
+      allocation_id_;       // allocation that this value lives in
+  optional<hash_t> digest_; // hash of the contents, if known
+  size_t stride_;           // bytes between blocks, 0 if contiguous
+  size_t count_;            // number of blocks
+  // the ranges, if the bytes are a list. Shared by duplicates.
+  std::shared_ptr<const std::vector<Extent>> ranges_;
 
 public:
   friend std::ostream &operator<<(std::ostream &os, const Value &v);
@@ -25,20 +40,51 @@ public:
   void add_depends_on(id_type id);
   const std::vector<size_t> &depends_on() const { return dependsOnIdx_; }
   bool is_known_size() const { return size_ != 0; }
+  bool is_initialized() const { return is_initialized_; }
+  size_t stride() const { return stride_; }
+  size_t count() const { return count_; }
+  const optional<hash_t> &digest() const { return digest_; }
+  bool is_strided() const { return count_ > 1; }
+  bool is_range_list() const { return bool(ranges_); }
+  size_t block_size() const { return size_ - (count_ - 1) * stride_; }
+  // the disjoint ranges of the value's bytes, in order, and how many bytes
+  // they cover
+  std::vector<Extent> blocks() const;
+  size_t bytes() const;
+
+  // Extent::overlaps, but only the bytes of the value count
+  bool overlaps(const Extent &other) const;
 
   AddressSpace address_space() const;
   std::string json() const;
   void set_size(size_t size);
+  void set_digest(hash_t digest) { digest_ = optional<hash_t>(digest); }
+  void clear_digest() { digest_ = optional<hash_t>(); }
 
   id_type Id() const { return reinterpret_cast<id_type>(this); }
+  AllocationRecord::id_type allocation_id() const { return allocation_id_; }
 
   Value(uintptr_t pos, size_t size, AllocationRecord::id_type allocation)
-      : Extent(pos, size), is_initialized_(false), allocation_id_(allocation) {}
+      : Extent(pos, size), is_initialized_(false), allocation_id_(allocation),
+        stride_(0), count_(1) {}
 
   Value(uintptr_t pos, size_t size, AllocationRecord::id_type allocation,
         bool initialized)
       : Extent(pos, size), is_initialized_(initialized),
-        allocation_id_(allocation) {}
+        allocation_id_(allocation), stride_(0), count_(1) {}
+
+  // count blocks of blockSize bytes, stride bytes apart. The extent is the
+  // span from the first byte of the first block to the last of the last.
+  Value(uintptr_t pos, size_t blockSize, size_t stride, size_t count,
+        AllocationRecord::id_type allocation, bool initialized)
+      : Extent(pos, count ? (count - 1) * stride + blockSize : 0),
+        is_initialized_(initialized), allocation_id_(allocation),
+        stride_(count > 1 ? stride : 0), count_(count ? count : 1) {}
+
+  // the bytes of ranges, which may be unsorted and may overlap. Evenly
+  // spaced ranges of one size are stored as blocks.
+  Value(const std::vector<Extent> &ranges,
+        AllocationRecord::id_type allocation, bool initialized);
 
   void record_meta_append(const std::string &s);
   void record_meta_set(const std::string &s);
@@ -1,31 +1,36 @@
 #include "values.hpp"
-#include "env.hpp"
+#include "trace_output.hpp"
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
 #include <map>
 
 const Values::id_type Values::noid = Value::noid;
 
+static Extent index_extent(const Value &v) {
+  if (v.is_known_size()) {
+    return Extent(v.pos(), v.size());
+  }
+  return Extent(v.pos(), UINTPTR_MAX - v.pos());
+}
+
 // FIXME: refactor this and other find_live and AddressSpace to take a
 // AddressSpace mask
 std::pair<Values::id_type, Values::value_type>
 Values::find_live(uintptr_t pos, size_t size, const AddressSpace &as) {
   std::lock_guard<std::mutex> guard(modify_mutex_);
-  if (values_.empty())
-    return std::make_pair(reinterpret_cast<Values::id_type>(nullptr),
-                          std::shared_ptr<Value>(nullptr));
 
-  Extent e(pos, size);
-  for (size_t i = value_order_.size() - 1; true; i--) {
+  const Extent e(pos, std::max(size, size_t(1)));
+  const Location loc(as);
+  const size_t n = value_order_.size();
+  for (size_t i = extents_.find_last(e); i < n; i = extents_.find_last(e, i)) {
+    if (!locations_[i].maybe_same_address_space(loc))
+      continue;
     const auto valKey = value_order_[i];
     const auto &val = values_[valKey];
     assert(val.get());
-    if (val->overlaps(e) && as.maybe_equal(val->address_space()))
+    if (val->overlaps(e))
       return std::make_pair(valKey, val);
-
-    if (i == 0)
-      break;
   }
 
   return std::make_pair(reinterpret_cast<Values::id_type>(nullptr),
@@ -40,24 +45,123 @@ Values::find_live(uintptr_t pos, const AddressSpace &as) {
 std::pair<Values::id_type, Values::value_type>
 Values::find_live_device(const uintptr_t pos, const size_t size) {
   std::lock_guard<std::mutex> guard(modify_mutex_);
-  if (values_.empty())
-    return std::make_pair(reinterpret_cast<Values::id_type>(nullptr),
-                          std::shared_ptr<Value>(nullptr));
 
-  Extent e(pos, size);
-  for (size_t i = value_order_.size() - 1; true; i--) {
+  const Extent e(pos, std::max(size, size_t(1)));
+  const size_t n = value_order_.size();
+  for (size_t i = extents_.find_last(e); i < n; i = extents_.find_last(e, i)) {
+    if (locations_[i].address_space_type() != AddressSpace::Type::Cuda)
+      continue;
     const auto valKey = value_order_[i];
     const auto &val = values_[valKey];
-    if (val->overlaps(e) && val->address_space().is_cuda())
+    if (val->overlaps(e))
       return std::make_pair(valKey, val);
-
-    if (i == 0)
-      break;
   }
   return std::make_pair(reinterpret_cast<Values::id_type>(nullptr),
                         std::shared_ptr<Value>(nullptr));
 }
 
+// Remove the bytes of b from gaps, true if there were any
+static bool cover(std::vector<Extent> &gaps, const Extent &b) {
+  bool covered = false;
+  std::vector<Extent> left;
+  for (const auto &g : gaps) {
+    if (!g.overlaps(b)) {
+      left.push_back(g);
+      continue;
+    }
+    covered = true;
+    const uintptr_t gEnd = g.pos() + g.size();
+    const uintptr_t bEnd = b.pos() + b.size();
+    if (g.pos() < b.pos()) {
+      left.emplace_back(g.pos(), b.pos() - g.pos());
+    }
+    if (bEnd < gEnd) {
+      left.emplace_back(bEnd, gEnd - bEnd);
+    }
+  }
+  gaps.swap(left);
+  return covered;
+}
+
+std::vector<std::vector<Values::id_type>>
+Values::find_all_live(const std::vector<Extent> &extents,
+                      const AddressSpace &as) {
+  std::vector<std::vector<id_type>> ids(extents.size());
+
+  // the bytes of each extent no value found so far has written, and extent
+  // indices sorted by position, so each value only visits the extents that
+  // could overlap it
+  std::vector<std::vector<Extent>> gaps(extents.size());
+  std::vector<size_t> order(extents.size());
+  size_t maxSize = 0;
+  for (size_t i = 0; i < extents.size(); ++i) {
+    gaps[i].emplace_back(extents[i].pos(),
+                         std::max(extents[i].size(), size_t(1)));
+    order[i] = i;
+    maxSize = std::max(maxSize, gaps[i][0].size());
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return extents[a].pos() < extents[b].pos();
+  });
+
+  const Location loc(as);
+  std::lock_guard<std::mutex> guard(modify_mutex_);
+  size_t unresolved = extents.size();
+  for (size_t vi = value_order_.size(); unresolved && vi-- > 0;) {
+    if (!locations_[vi].maybe_same_address_space(loc)) {
+      continue;
+    }
+    // the value's span comes from the index, so values nowhere near the
+    // extents are skipped without a map lookup
+    const Extent span = extents_[vi];
+    const uintptr_t lo = span.pos() > maxSize ? span.pos() - maxSize : 0;
+    const uintptr_t hi = span.pos() + span.size();
+    auto it = std::lower_bound(
+        order.begin(), order.end(), lo,
+        [&](size_t i, uintptr_t pos) { return extents[i].pos() < pos; });
+    const Value *val = nullptr;
+    std::vector<Extent> blocks;
+    for (; it != order.end() && extents[*it].pos() < hi; ++it) {
+      if (gaps[*it].empty()) {
+        continue;
+      }
+      if (!val) {
+        val = values_[value_order_[vi]].get();
+        assert(val);
+      }
+      if (!val->overlaps(extents[*it])) {
+        continue;
+      }
+      if (blocks.empty()) {
+        // a value of unknown size is its first byte
+        for (const auto &b : val->blocks()) {
+          blocks.emplace_back(b.pos(), std::max(b.size(), size_t(1)));
+        }
+      }
+      bool live = false;
+      for (const auto &b : blocks) {
+        live |= cover(gaps[*it], b);
+      }
+      if (live) {
+        ids[*it].push_back(value_order_[vi]);
+      }
+      if (gaps[*it].empty()) {
+        --unresolved;
+      }
+    }
+  }
+  return ids;
+}
+
+std::vector<Values::value_type> Values::newest(const size_t n) {
+  std::lock_guard<std::mutex> guard(modify_mutex_);
+  std::vector<value_type> ret;
+  for (size_t i = value_order_.size(); i-- > 0 && ret.size() < n;) {
+    ret.push_back(values_[value_order_[i]]);
+  }
+  return ret;
+}
+
 std::pair<bool, Values::id_type>
 Values::get_last_overlapping_value(uintptr_t pos, size_t size,
                                    const AddressSpace &as) {
@@ -77,13 +181,14 @@ std::pair<Values::map_type::iterator, bool>
 Values::insert(const value_type &v) {
   assert(v.get() && "Inserting invalid value!");
   const auto &valIdx = reinterpret_cast<id_type>(v.get());
+  const Location loc = Allocations::instance().location(v->allocation_id());
 
   std::lock_guard<std::mutex> guard(modify_mutex_);
   value_order_.push_back(valIdx);
+  extents_.push_back(index_extent(*v));
+  locations_.push_back(loc);
 
-  std::ofstream buf(env::output_path(), std::ofstream::app);
-  buf << *v;
-  buf.flush();
+  TraceOutput::instance().write_record(*v);
 
   return values_.insert(std::make_pair(valIdx, v));
 }
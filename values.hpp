@@ -17,6 +17,12 @@ private:
   typedef std::map<id_type, value_type> map_type;
   map_type values_;
   std::vector<id_type> value_order_;
+  // the extent of each value in value_order_, searched newest first. A value
+  // of unknown size may get one later, so it spans to the end of memory and
+  // each hit is checked against the value itself.
+  ExtentArray extents_;
+  // the location of each value's allocation, kept after it is freed
+  std::vector<Location> locations_;
   std::mutex modify_mutex_;
 
 public:
@@ -29,14 +35,25 @@ public:
                                            const AddressSpace &as);
   std::pair<id_type, value_type> find_live_device(const uintptr_t pos,
                                                   const size_t size);
+  // every live value overlapping each of many extents, under one lock and one
+  // pass over the values: the i-th list is the values with bytes in
+  // extents[i] that no newer value has overwritten, newest first
+  std::vector<std::vector<id_type>>
+  find_all_live(const std::vector<Extent> &extents, const AddressSpace &as);
 
   id_type find_id(const uintptr_t pos, const AddressSpace &as) const;
 
+  // the n newest values, newest first, copied under the lock
+  std::vector<value_type> newest(size_t n);
+
   std::pair<map_type::iterator, bool> insert(const value_type &v);
   std::pair<map_type::iterator, bool> insert(const Value &v);
 
+  // a new value over the extents of v, which were written, so its digest
+  // no longer describes them
   std::pair<id_type, value_type> duplicate_value(const value_type &v) {
     auto nv = std::shared_ptr<Value>(new Value(*v));
+    nv->clear_digest();
     auto p = insert(nv);
     assert(p.second && "Should be new value");
     return *p.first;
@@ -60,8 +77,40 @@ public:
     return *p.first;
   }
 
-  value_type &operator[](const id_type &k) { return values_[k]; }
-  value_type &operator[](id_type &&k) { return values_[k]; }
+  // count blocks of blockSize bytes, stride bytes apart
+  std::pair<id_type, value_type>
+  new_strided_value(const uintptr_t pos, const size_t blockSize,
+                    const size_t stride, const size_t count,
+                    const Allocations::id_type allocId,
+                    const bool initialized) {
+    assert((allocId != noid) && "Allocation should be valid");
+
+    auto v = new Value(pos, blockSize, stride, count, allocId, initialized);
+    auto p = insert(std::shared_ptr<Value>(v));
+    assert(p.second && "Expecting new value");
+    return *p.first;
+  }
+
+  // the bytes of ranges, see Value
+  std::pair<id_type, value_type>
+  new_ranges_value(const std::vector<Extent> &ranges,
+                   const Allocations::id_type allocId, const bool initialized) {
+    assert((allocId != noid) && "Allocation should be valid");
+
+    auto v = new Value(ranges, allocId, initialized);
+    auto p = insert(std::shared_ptr<Value>(v));
+    assert(p.second && "Expecting new value");
+    return *p.first;
+  }
+
+  value_type &operator[](const id_type &k) {
+    std::lock_guard<std::mutex> guard(modify_mutex_);
+    return values_[k];
+  }
+  value_type &operator[](id_type &&k) {
+    std::lock_guard<std::mutex> guard(modify_mutex_);
+    return values_[k];
+  }
 
   static Values &instance();
 